@@ -0,0 +1,335 @@
+/* batch.c - batch queries
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Specification.  */
+#include "batch.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* Number of answers for each job which may wait to be printed while the
+   answer to an earlier query is still coming.  */
+#define BATCH_WINDOW 4
+
+/* A batch of queries being made at once.  */
+struct batch {
+  const struct batch_ops *ops;
+  struct engine engine;
+  unsigned int running;
+};
+
+/* A query of a batch.  */
+struct batch_job {
+  struct batch *batch;
+  unsigned long number;
+  char *query;
+
+  /* Child process making the query, and the read of its output.  */
+  pid_t pid;
+  struct engine_query pipe;
+
+  /* Set to -1 if the query failed.  */
+  int status;
+  bool complete;
+
+  /* Output of the query which is not printed yet.  */
+  struct buffer out;
+
+  /* Set once the "[Query N: QUERY]" line is printed.  */
+  bool started;
+};
+
+/*
+ *  Returns the next query of `in', stripped of surrounding spaces and
+ *  stored in `*line', or NULL at the end of `in'.
+ */
+static char *
+batch_next (FILE *in, char **line, size_t *size)
+{
+  ssize_t len;
+  char *query;
+
+  while ((len = getline (line, size, in)) > 0)
+    {
+      query = *line;
+      while (len > 0 && isspace ((unsigned char) query[len - 1]))
+        query[--len] = '\0';
+      while (isspace ((unsigned char) *query))
+        query++;
+      if (*query != '\0' && *query != '#')
+        return query;
+    }
+  return NULL;
+}
+
+/*
+ *  Marks the query `data' as complete, with the status `status'.
+ */
+static void
+batch_done (void *data, int status)
+{
+  struct batch_job *job = data;
+
+  if (status < 0)
+    job->status = -1;
+  job->complete = true;
+  job->batch->running--;
+}
+
+/*
+ *  Waits for the child process of a job once its output is read.
+ */
+static void
+batch_child_done (struct engine_query *q)
+{
+  struct batch_job *job = q->data;
+  int status;
+
+  while (waitpid (job->pid, &status, 0) < 0)
+    if (errno != EINTR)
+      {
+        batch_done (job, -1);
+        return;
+      }
+  if (q->status < 0 || !WIFEXITED (status)
+      || WEXITSTATUS (status) != EXIT_SUCCESS)
+    batch_done (job, -1);
+  else
+    batch_done (job, 0);
+}
+
+/*
+ *  Starts a child process making the query of `job' by calling `fn' with
+ *  `arg', which prints the answer to a pipe read by the engine. Returns
+ *  -1 on error, 0 on success.
+ */
+static int
+batch_fork (struct batch *b, struct batch_job *job, int (*fn) (void *),
+            void *arg)
+{
+  int fds[2], ret;
+
+  if (pipe (fds) < 0)
+    return -1;
+
+  fflush (stdout);
+  job->pid = fork ();
+  if (job->pid < 0)
+    {
+      close (fds[0]);
+      close (fds[1]);
+      return -1;
+    }
+  if (job->pid == 0)
+    {
+      if (b->ops->child)
+        b->ops->child ();
+      close (fds[0]);
+      if (dup2 (fds[1], STDOUT_FILENO) < 0)
+        _exit (EXIT_FAILURE);
+      close (fds[1]);
+      ret = fn (arg);
+      fflush (stdout);
+      /* exit() would also flush the input streams shared with the parent,
+         moving the parent's position in them.  */
+      _exit (ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+  close (fds[1]);
+  job->pipe.text = &job->out;
+  job->pipe.done = batch_child_done;
+  job->pipe.data = job;
+  engine_read (&b->engine, &job->pipe, fds[0]);
+  return 0;
+}
+
+/*
+ *  Makes the query of the job `data' with the lookup function of its
+ *  batch.
+ */
+static int
+batch_lookup (void *data)
+{
+  struct batch_job *job = data;
+
+  return job->batch->ops->lookup (job->query);
+}
+
+/*
+ *  Makes the rest of the query of the job `data', started with the
+ *  engine, in a child process calling `fn' with `arg'.
+ */
+static int
+batch_spawn (void *data, int (*fn) (void *), void *arg)
+{
+  struct batch_job *job = data;
+
+  return batch_fork (job->batch, job, fn, arg);
+}
+
+/*
+ *  Starts making the query of `job', with the engine if the batch can,
+ *  or else in a child process.
+ */
+static void
+batch_start (struct batch *b, struct batch_job *job)
+{
+  b->running++;
+  if (b->ops->start
+      && b->ops->start (&b->engine, job->query, &job->out, batch_done,
+                        batch_spawn, job) == 0)
+    return;
+
+  buffer_reset (&job->out);
+  if (batch_fork (b, job, batch_lookup, job) < 0)
+    {
+      buffer_printf (&job->out, "[%s: %s]\n", _("Unable to start query"),
+                     strerror (errno));
+      batch_done (job, -1);
+    }
+}
+
+/*
+ *  Makes the queries of `in' one after the other in this process.
+ */
+static int
+batch_run_serial (FILE *in, int (*lookup) (const char *))
+{
+  char *line = NULL, *query;
+  size_t size = 0;
+  unsigned long count = 0;
+  int ret = 0;
+
+  while ((query = batch_next (in, &line, &size)))
+    {
+      count++;
+      printf ("[Query %lu: %s]\n", count, query);
+      if (lookup (query) < 0)
+        ret = -1;
+      printf ("[End of query %lu]\n", count);
+      fflush (stdout);
+    }
+
+  free (line);
+  return ferror (in) ? -1 : ret;
+}
+
+/*
+ *  Makes up to `jobs' queries of `in' at once. The jobs are kept in a
+ *  ring in the order of `in', and the answer to the first one is printed
+ *  as it comes, followed by those of the next ones which are complete.
+ */
+static int
+batch_run_jobs (FILE *in, unsigned int jobs, const struct batch_ops *ops)
+{
+  size_t window = (size_t) jobs * BATCH_WINDOW;
+  struct batch_job *ring, *job;
+  struct batch b;
+  size_t head = 0, pending = 0;
+  unsigned long count = 0;
+  char *line = NULL, *query;
+  size_t size = 0;
+  bool eof = false;
+  int ret = 0;
+
+  b.ops = ops;
+  b.running = 0;
+  if (engine_init (&b.engine) < 0)
+    return batch_run_serial (in, ops->lookup);
+  ring = xcalloc (window, sizeof *ring);
+
+  for (;;)
+    {
+      while (!eof && b.running < jobs && pending < window)
+        {
+          query = batch_next (in, &line, &size);
+          if (!query)
+            {
+              eof = true;
+              break;
+            }
+
+          job = &ring[(head + pending) % window];
+          job->batch = &b;
+          job->number = ++count;
+          job->query = xstrdup (query);
+          job->pid = 0;
+          job->status = 0;
+          job->complete = false;
+          job->started = false;
+          buffer_init (&job->out);
+          pending++;
+          batch_start (&b, job);
+        }
+
+      while (pending > 0)
+        {
+          job = &ring[head];
+          if (!job->started)
+            {
+              printf ("[Query %lu: %s]\n", job->number, job->query);
+              job->started = true;
+            }
+          fwrite (job->out.data, 1, job->out.len, stdout);
+          buffer_reset (&job->out);
+          if (!job->complete)
+            break;
+
+          printf ("[End of query %lu]\n", job->number);
+          if (job->status < 0)
+            ret = -1;
+          free (job->query);
+          buffer_free (&job->out);
+          head = (head + 1) % window;
+          pending--;
+        }
+      fflush (stdout);
+
+      if (b.running == 0)
+        {
+          if (eof)
+            break;
+          continue;
+        }
+      if (engine_wait (&b.engine, -1) < 0)
+        {
+          printf ("[%s: %s]\n", _("Error waiting for queries"),
+                  strerror (errno));
+          ret = -1;
+          break;
+        }
+    }
+
+  free (line);
+  free (ring);
+  engine_free (&b.engine);
+  return ferror (in) ? -1 : ret;
+}
+
+int
+batch_run (FILE *in, unsigned int jobs, const struct batch_ops *ops)
+{
+  if (jobs <= 1)
+    return batch_run_serial (in, ops->lookup);
+  return batch_run_jobs (in, jobs, ops);
+}
@@ -0,0 +1,69 @@
+/* batch.h - declarations for batch queries
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include "buffer.h"
+#include "engine.h"
+
+/* Function to call once a query started by the START function of a
+   batch is complete, with the DATA given to START and a STATUS of -1 if
+   the query failed, 0 otherwise.  */
+typedef void (*batch_done_t) (void *data, int status);
+
+/* Function to call instead of DONE to have a query started by the START
+   function of a batch made to its end in a child process, with the DATA
+   given to START.  FN is called there with ARG, prints the rest of the
+   answer on the standard output, to be appended to the output of the
+   query, and returns -1 if the query failed, 0 otherwise.  DONE is called
+   once the output is read.  Return 0 if the child process was started,
+   or -1 with errno set.  */
+typedef int (*batch_spawn_t) (void *data, int (*fn) (void *), void *arg);
+
+/* Functions making the queries of a batch.  */
+struct batch_ops {
+  /* Make QUERY and print its answer on the standard output.  Return -1 if
+     the query failed, 0 otherwise.  This is called in this process when
+     the queries are made one after the other, and else in a child
+     process for each query which START doesn't make.  */
+  int (*lookup) (const char *query);
+
+  /* Called first in each child process, or NULL.  */
+  void (*child) (void);
+
+  /* Start making QUERY with the engine E, and append its answer to OUT.
+     Return 0 if it was started, and DONE is called with DATA once it is
+     complete, possibly before START returns, or SPAWN is called with DATA
+     if the query can't be made to its end without blocking.  Return -1 if
+     it must be made by LOOKUP instead.  May be NULL.  */
+  int (*start) (struct engine *e, const char *query, struct buffer *out,
+                batch_done_t done, batch_spawn_t spawn, void *data);
+};
+
+/* Make a query with OPS for each line of IN, skipping empty lines and
+   lines starting with '#', and print the answers on the standard output
+   in the order of IN, each between a "[Query N: QUERY]" line and a
+   "[End of query N]" line.  With JOBS greater than 1, up to JOBS queries
+   are made at once.  Return -1 if IN couldn't be read or if a query
+   failed, 0 otherwise.  */
+extern int batch_run (FILE *in, unsigned int jobs,
+                      const struct batch_ops *ops);
+
+#endif /* BATCH_H */
@@ -0,0 +1,134 @@
+/* buffer.c - growable text buffers
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Specification.  */
+#include "buffer.h"
+
+#define BUFFER_INITIAL_SIZE 256
+
+void
+buffer_init (struct buffer *b)
+{
+  b->size = BUFFER_INITIAL_SIZE;
+  b->data = xmalloc (b->size);
+  b->data[0] = '\0';
+  b->len = 0;
+}
+
+void
+buffer_free (struct buffer *b)
+{
+  free (b->data);
+  b->data = NULL;
+  b->len = b->size = 0;
+}
+
+void
+buffer_reset (struct buffer *b)
+{
+  b->len = 0;
+  b->data[0] = '\0';
+}
+
+void
+buffer_truncate (struct buffer *b, size_t len)
+{
+  if (len < b->len)
+    {
+      b->len = len;
+      b->data[len] = '\0';
+    }
+}
+
+char *
+buffer_reserve (struct buffer *b, size_t n)
+{
+  if (n >= b->size - b->len)
+    {
+      size_t size = b->size;
+
+      while (n >= size - b->len)
+        {
+          if (size > (size_t) -1 / 2)
+            xalloc_die ();
+          size *= 2;
+        }
+      b->data = xrealloc (b->data, size);
+      b->size = size;
+    }
+  return b->data + b->len;
+}
+
+void
+buffer_append (struct buffer *b, const void *data, size_t n)
+{
+  memcpy (buffer_reserve (b, n), data, n);
+  b->len += n;
+  b->data[b->len] = '\0';
+}
+
+void
+buffer_puts (struct buffer *b, const char *s)
+{
+  buffer_append (b, s, strlen (s));
+}
+
+void
+buffer_printf (struct buffer *b, const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  /* Try to format into the spare room first, and again once enough has
+     been made when the result didn't fit.  */
+  va_start (ap, fmt);
+  n = vsnprintf (b->data + b->len, b->size - b->len, fmt, ap);
+  va_end (ap);
+  if (n < 0)
+    {
+      b->data[b->len] = '\0';
+      return;
+    }
+  if ((size_t) n >= b->size - b->len)
+    {
+      va_start (ap, fmt);
+      vsnprintf (buffer_reserve (b, n), n + 1, fmt, ap);
+      va_end (ap);
+    }
+  b->len += n;
+}
+
+ssize_t
+buffer_read (struct buffer *b, int fd)
+{
+  ssize_t ret;
+
+  /* Keep at least MAXBUFSIZE bytes of spare room, which the doubling of
+     the buffer turns into larger reads as the response grows.  */
+  buffer_reserve (b, MAXBUFSIZE);
+  ret = read (fd, b->data + b->len, b->size - b->len - 1);
+  if (ret > 0)
+    {
+      b->len += ret;
+      b->data[b->len] = '\0';
+    }
+  return ret;
+}
@@ -0,0 +1,64 @@
+/* buffer.h - declarations for growable text buffers
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* A buffer holds the LEN bytes of DATA, followed by a null byte so that
+   its contents can be used as a string.  SIZE is the number of bytes
+   allocated, which grows geometrically so that appending is done in
+   amortized constant time.  */
+struct buffer {
+  char *data;
+  size_t len;
+  size_t size;
+};
+
+/* Initialize the empty buffer B.  */
+extern void buffer_init (struct buffer *b);
+
+/* Release the memory used by B.  */
+extern void buffer_free (struct buffer *b);
+
+/* Empty B, keeping its memory for later use.  */
+extern void buffer_reset (struct buffer *b);
+
+/* Drop the bytes of B past the first LEN.  */
+extern void buffer_truncate (struct buffer *b, size_t len);
+
+/* Make room for N more bytes in B, besides the terminating null byte, and
+   return a pointer to the first of them.  */
+extern char *buffer_reserve (struct buffer *b, size_t n);
+
+/* Append the N bytes of DATA to B.  */
+extern void buffer_append (struct buffer *b, const void *data, size_t n);
+
+/* Append the string S to B.  */
+extern void buffer_puts (struct buffer *b, const char *s);
+
+/* Append to B the string built from FMT as by printf.  */
+extern void buffer_printf (struct buffer *b, const char *fmt, ...);
+
+/* Read from FD directly at the end of B.  Return the number of bytes read,
+   0 at the end of the file, or -1 with errno set.  */
+extern ssize_t buffer_read (struct buffer *b, int fd);
+
+#endif /* BUFFER_H */
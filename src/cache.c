@@ -22,6 +22,9 @@
 /* Specification.  */
 #include "cache.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 #ifdef HAVE_SYS_FCNTL_H
 # include <sys/fcntl.h>
 #endif
@@ -53,27 +56,248 @@
 #include <sys/time.h>
 #include "init.h"
 #include "jconfig.h"
+#include "mapcache.h"
 
 #define DBM_MODE           S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP
 
 #if !defined NOCACHE && defined HAVE_GDBM_OPEN
-# define dbm_open(a,b,c)    gdbm_open(a, 0, b, c, 0)
+/* Locking is done by cache_lock(), for a whole operation.  */
+# define dbm_open(a,b,c)    gdbm_open(a, 0, (b)|GDBM_NOLOCK, c, 0)
 # define DBM_COPTIONS       GDBM_WRCREAT
 # define DBM_WOPTIONS       GDBM_WRITER
-# define DBM_ROPTIONS       GDBM_READER
 # define DBM_IOPTIONS       GDBM_REPLACE
 # define dbm_store(a,b,c,d) gdbm_store(a,b,c,d)
 # define dbm_close(a)       gdbm_close(a)
 # define dbm_fetch(a,b)     gdbm_fetch(a,b)
+# define dbm_delete(a,b)    gdbm_delete(a,b)
+# define dbm_sync(a)        gdbm_sync(a)
+# define dbm_free_datum(d)  free((d).dptr)
+# define USE_DBM            1
+typedef GDBM_FILE dbm_file_t;
 #else
 # if !defined NOCACHE && defined HAVE_DBM_OPEN
 # define DBM_COPTIONS       O_RDWR|O_CREAT
 # define DBM_WOPTIONS       O_RDWR
-# define DBM_ROPTIONS       O_RDONLY
 # define DBM_IOPTIONS       DBM_REPLACE
+# define dbm_sync(a)        0
+# define dbm_free_datum(d)  ((void) 0)
+# define USE_DBM            1
+typedef DBM *dbm_file_t;
 # endif
 #endif
 
+/* Prefix of the name of a cache file selecting the map cache engine,
+   which is also used when no dbm library is available.  */
+#define MAPCACHE_PREFIX    "mmap:"
+
+#ifndef NOCACHE
+/* The cache database is opened once per process.  Other processes may
+   use it at the same time.  A map cache handles this by itself.  With a
+   dbm database, every operation is made under a lock of the lock file,
+   shared for reading and exclusive for writing.  The lock file also
+   holds a generation number increased by every store, which tells when
+   the database was modified by another process since it was opened, and
+   must be reopened before its contents can be trusted.  */
+static struct {
+  bool open;
+  bool native;
+  struct mapcache map;
+#ifdef USE_DBM
+  dbm_file_t db;
+  int lockfd;
+  uint64_t generation;
+#endif
+} cache = {
+  .open = false,
+#ifdef USE_DBM
+  .lockfd = -1,
+#endif
+};
+#endif /* !NOCACHE */
+
+#ifdef USE_DBM
+/*
+ *  Waits for a lock of type `type' on the lock file, which is F_RDLCK,
+ *  F_WRLCK or F_UNLCK. Returns -1 on error, 0 on success.
+ */
+static int
+cache_lock(short type)
+{
+  struct flock fl;
+
+  memset(&fl, 0, sizeof fl);
+  fl.l_type = type;
+  fl.l_whence = SEEK_SET;
+  while (fcntl(cache.lockfd, F_SETLKW, &fl) < 0)
+    if (errno != EINTR)
+      return -1;
+  return 0;
+}
+
+/*
+ *  Reads the generation number from the lock file, which must be locked.
+ *  A new lock file has generation 0.
+ */
+static uint64_t
+cache_read_generation(void)
+{
+  uint64_t generation;
+
+  if (pread(cache.lockfd, &generation, sizeof generation, 0)
+      != sizeof generation)
+    return 0;
+  return generation;
+}
+
+/*
+ *  Tells the other processes that the database was modified, so that
+ *  they reopen it. Called with the exclusive lock.
+ */
+static void
+cache_bump_generation(void)
+{
+  uint64_t generation = cache.generation + 1;
+
+  if (pwrite(cache.lockfd, &generation, sizeof generation, 0)
+      == sizeof generation)
+    cache.generation = generation;
+}
+
+/*
+ *  Locks the database with a lock of type `type' and reopens it if
+ *  another process has modified it. Returns -1 on error, 0 on success.
+ */
+static int
+cache_begin(short type)
+{
+  uint64_t generation;
+
+  if (cache_lock(type) < 0)
+    return -1;
+
+  generation = cache_read_generation();
+  if (generation != cache.generation)
+    {
+      dbm_close(cache.db);
+      cache.db = dbm_open(arguments->cfname, DBM_WOPTIONS, DBM_MODE);
+      if (!cache.db)
+	{
+	  cache_lock(F_UNLCK);
+	  cache_close();
+	  return -1;
+	}
+      cache.generation = generation;
+    }
+  return 0;
+}
+
+/*
+ *  This opens the dbm database and marks it with the version of its
+ *  format. Returns -1 on error, 0 on success.
+ */
+static int
+cache_open_dbm(void)
+{
+  datum dbkey = {(char *) "#jwhois#cacheversion#1", 22};
+  datum dbstore = {(char *) "1", 1};
+  datum version;
+  char *lockname;
+
+  umask(0);
+  lockname = xmalloc(strlen(arguments->cfname) + 6);
+  sprintf(lockname, "%s.lock", arguments->cfname);
+  cache.lockfd = open(lockname, O_RDWR|O_CREAT, DBM_MODE);
+  if (cache.lockfd < 0)
+    {
+      if (arguments->verbose)
+	printf ("[Cache: %s %s]\n", _("Unable to open"), lockname);
+      free(lockname);
+      return -1;
+    }
+  free(lockname);
+
+  /* The database may have to be created.  */
+  if (cache_lock(F_WRLCK) < 0)
+    {
+      cache_close();
+      return -1;
+    }
+  cache.db = dbm_open (arguments->cfname, DBM_COPTIONS, DBM_MODE);
+  if (!cache.db)
+    {
+      if (arguments->verbose)
+	printf ("[Cache: %s %s]\n", _("Unable to open"), arguments->cfname);
+      cache_lock(F_UNLCK);
+      cache_close();
+      return -1;
+    }
+  cache.open = true;
+  cache.generation = cache_read_generation();
+
+  version = dbm_fetch(cache.db, dbkey);
+  if (version.dptr)
+    dbm_free_datum(version);
+  else if (dbm_store(cache.db, dbkey, dbstore, DBM_IOPTIONS) < 0)
+    {
+      if (arguments->verbose)
+	printf("[Cache: %s]\n", _("Unable to store data in cache\n"));
+      cache_lock(F_UNLCK);
+      cache_close();
+      return -1;
+    }
+  cache_lock(F_UNLCK);
+  return 0;
+}
+/*
+ *  Deletes the record of `key', which has expired.
+ */
+static void
+cache_delete_dbm(datum key)
+{
+  if (cache_begin(F_WRLCK) < 0)
+    return;
+  if (dbm_delete(cache.db, key) == 0)
+    cache_bump_generation();
+  cache_lock(F_UNLCK);
+}
+#endif /* USE_DBM */
+
+#ifndef NOCACHE
+/*
+ *  Returns the value of the option `key', a number of bytes or entries
+ *  optionally followed by one of the suffixes K, M or G, or 0 if it is
+ *  not set.
+ */
+static size_t
+cache_get_limit(const char *key)
+{
+  struct jconfig *j = jconfig_getone("jwhois", key);
+  unsigned long long n;
+  char *end;
+
+  if (!j)
+    return 0;
+
+  errno = 0;
+  n = strtoull(j->value, &end, 10);
+  switch (*end)
+    {
+    case 'k': case 'K': n <<= 10; end++; break;
+    case 'm': case 'M': n <<= 20; end++; break;
+    case 'g': case 'G': n <<= 30; end++; break;
+    }
+  if (errno || end == j->value || *end != '\0' || n > (size_t) -1)
+    {
+      if (arguments->verbose)
+	printf("[Cache: %s %s: %s]\n", _("Invalid value of"), key, j->value);
+      return 0;
+    }
+  if (arguments->verbose > 1)
+    printf("[Cache: %s = %llu]\n", key, n);
+  return n;
+}
+#endif /* !NOCACHE */
+
 /*
  *  This function initialises the cache database and possibly converts it
  *  to a newer format if such exists. Returns -1 on error. 0 on success.
@@ -82,25 +306,15 @@ int
 cache_init(void)
 {
 #ifndef NOCACHE
-  datum dbkey = {xstrdup ("#jwhois#cacheversion#1"), 22};
-  datum dbstore = {xstrdup ("1"), 1};
-#ifdef HAVE_GDBM_OPEN
-  GDBM_FILE dbf;
-#else
-  DBM *dbf;
-#endif
-
   if (!arguments->cache)
     return 0;
 
-  jconfig_set();
   struct jconfig *j = jconfig_getone("jwhois", "cachefile");
   arguments->cfname = j ? j->value : xstrdup (LOCALSTATEDIR "/jwhois.db");
 
   if (arguments->verbose > 1)
     printf ("[Cache: Cache file name = \"%s\"]\n", arguments->cfname);
 
-  jconfig_set();
   j = jconfig_getone("jwhois", "cacheexpire");
 
   char *buf;
@@ -116,28 +330,98 @@ cache_init(void)
   if (arguments->verbose > 1)
     printf("[Cache: Expire time = %d]\n", arguments->cfexpire);
 
-  umask(0);
-  dbf = dbm_open (arguments->cfname, DBM_COPTIONS, DBM_MODE);
-  if (!dbf)
+  if (cache_open() < 0)
     {
-      if (arguments->verbose)
-	printf ("[Cache: %s %s]\n", _("Unable to open"), arguments->cfname);
       arguments->cache = 0;
       return -1;
     }
+#endif
+  return 0;
+}
+
+/*
+ *  This opens the cache database, unless it is already open. A name
+ *  starting with "mmap:" selects the map cache engine. Returns -1 on
+ *  error, 0 on success.
+ */
+int
+cache_open(void)
+{
+#ifndef NOCACHE
+  const char *name = arguments->cfname;
 
-  int iret = dbm_store(dbf, dbkey, dbstore, DBM_IOPTIONS);
-  if (iret < 0)
+  if (cache.open)
+    return 0;
+  /* cache_init() was not called.  */
+  if (!name)
+    return -1;
+
+  cache.native = STRNCASEEQ (name, MAPCACHE_PREFIX, strlen (MAPCACHE_PREFIX));
+  if (cache.native)
+    name += strlen (MAPCACHE_PREFIX);
+#ifdef USE_DBM
+  if (!cache.native)
+    return cache_open_dbm();
+#endif
+
+  cache.native = true;
+  if (mapcache_open(&cache.map, name) < 0)
     {
       if (arguments->verbose)
-	printf("[Cache: %s]\n", _("Unable to store data in cache\n"));
-      arguments->cache = 0;
+	printf ("[Cache: %s %s: %s]\n", _("Unable to open"), name,
+		strerror(errno));
+      return -1;
     }
-  dbm_close(dbf);
+  cache.map.max_size = cache_get_limit("cache-max-size");
+  cache.map.max_entries = cache_get_limit("cache-max-entries");
+  cache.map.max_age = (time_t) arguments->cfexpire * 60 * 60;
+  cache.open = true;
+#endif
+  return 0;
+}
+
+/*
+ *  This writes the changes made to the cache database to disk.
+ *  Returns -1 on error, 0 on success.
+ */
+int
+cache_flush(void)
+{
+#ifndef NOCACHE
+  if (!cache.open)
+    return 0;
+  if (cache.native)
+    return mapcache_sync(&cache.map);
+#ifdef USE_DBM
+  if (dbm_sync(cache.db) < 0)
+    return -1;
+#endif
 #endif
   return 0;
 }
 
+/*
+ *  This closes the cache database. It is opened again when it is next
+ *  read or written.
+ */
+void
+cache_close(void)
+{
+#ifndef NOCACHE
+  if (cache.open && cache.native)
+    mapcache_close(&cache.map);
+#ifdef USE_DBM
+  if (cache.open && !cache.native)
+    dbm_close(cache.db);
+  cache.db = NULL;
+  if (cache.lockfd >= 0)
+    close(cache.lockfd);
+  cache.lockfd = -1;
+#endif
+  cache.open = false;
+#endif
+}
+
 /*
  *  This stores the passed text in the database with the key `key'.
  *  Returns 0 on success and -1 on failure.
@@ -146,19 +430,20 @@ int
 cache_store(char *key, const char *text)
 {
 #ifndef NOCACHE
-  datum dbkey;
-  datum dbstore;
-  int ret;
-#ifdef HAVE_GDBM_OPEN
-  GDBM_FILE dbf;
-#else
-  DBM *dbf;
-#endif
-  time_t *timeptr;
-  char *ptr;
-
   if (arguments->cache)
     {
+      if (cache_open() < 0)
+	return -1;
+      if (cache.native)
+	return mapcache_store(&cache.map, key, text, strlen(text),
+			      time(NULL));
+#ifdef USE_DBM
+      datum dbkey;
+      datum dbstore;
+      int ret;
+      time_t *timeptr;
+      char *ptr;
+
       dbkey.dptr = key;
       dbkey.dsize = strlen(key);
 
@@ -172,17 +457,23 @@ cache_store(char *key, const char *text)
       
       dbstore.dptr = ptr;
       dbstore.dsize = strlen(text)+sizeof(time_t)+1;
-      
-      dbf = dbm_open(arguments->cfname, DBM_WOPTIONS, DBM_MODE);
-      if (!dbf)
-	return -1;
-      else
+
+      if (cache_begin(F_WRLCK) < 0)
 	{
-	  ret = dbm_store(dbf, dbkey, dbstore, DBM_IOPTIONS);
-	  if (ret < 0)
-	    return -1;
-	  dbm_close(dbf);
+	  free(ptr);
+	  return -1;
 	}
+      ret = dbm_store(cache.db, dbkey, dbstore, DBM_IOPTIONS);
+      free(ptr);
+      if (ret < 0)
+	{
+	  cache_lock(F_UNLCK);
+	  return -1;
+	}
+
+      cache_bump_generation();
+      cache_lock(F_UNLCK);
+#endif
     }
 #endif
   return 0;
@@ -191,53 +482,98 @@ cache_store(char *key, const char *text)
 /*
  *  Given a key, this function retrieves the text from the database
  *  and checks the expire time on it. If it is still valid data, it
- *  returns the number of bytes in text, else 0 or -1 on error.
+ *  stores a view of the text in `view' and returns 1, which must be
+ *  released by cache_release(), else 0 or -1 on error.
  */
 int
-cache_read(char *key, char **text)
+cache_read(char *key, struct cache_view *view)
 {
-#ifndef NOCACHE
-  datum dbkey;
-  datum dbstore;
-#ifdef HAVE_GDBM_OPEN
-  GDBM_FILE dbf;
-#else
-  DBM *dbf;
-#endif
-#endif
+  view->text = NULL;
+  view->len = 0;
+  view->owned = NULL;
+
   if (!arguments->cache)
     return 0;
 
 #ifndef NOCACHE
-  dbkey.dptr = key;
-  dbkey.dsize = strlen(key);
+  const char *data;
+  size_t len;
+  time_t time_c;
 
-  dbf = dbm_open (arguments->cfname, DBM_ROPTIONS, DBM_MODE);
-  if (!dbf)
+  if (cache_open() < 0)
     return -1;
-  dbstore = dbm_fetch(dbf, dbkey);
-  if ((dbstore.dptr == NULL))
+
+#ifdef USE_DBM
+  datum dbkey;
+  datum dbstore = {NULL, 0};
+
+  if (!cache.native)
     {
-      dbm_close(dbf);
-      return 0;
+      dbkey.dptr = key;
+      dbkey.dsize = strlen(key);
+
+      if (cache_begin(F_RDLCK) < 0)
+	return -1;
+      dbstore = dbm_fetch(cache.db, dbkey);
+      cache_lock(F_UNLCK);
+      if ((dbstore.dptr == NULL))
+	return 0;
+      if (dbstore.dsize < (int) sizeof(time_t) + 1)
+	{
+	  dbm_free_datum(dbstore);
+	  return 0;
+	}
+
+      /* Ensure suitable alignment.  */
+      memcpy (&time_c, dbstore.dptr, sizeof (time_c));
+      data = (char *)(dbstore.dptr)+sizeof(time_t);
+      len = dbstore.dsize-sizeof(time_t)-1;
+    }
+  else
+#endif
+    {
+      /* The text is used in place, in the mapping of the cache.  */
+      data = mapcache_fetch(&cache.map, key, &len, &time_c);
+      if (!data)
+	return 0;
     }
 
-  time_t time_c;
-  /* Ensure suitable alignment.  */
-  memcpy (&time_c, dbstore.dptr, sizeof (time_c));
-  if (((time(NULL) - time_c) / (60 * 60)) > arguments->cfexpire)
+  /* Records never expire when the expire time is 0.  */
+  if (arguments->cfexpire
+      && ((time(NULL) - time_c) / (60 * 60)) > arguments->cfexpire)
     {
-      dbm_close(dbf);
+#ifdef USE_DBM
+      if (!cache.native)
+	{
+	  dbm_free_datum(dbstore);
+	  cache_delete_dbm(dbkey);
+	}
+#endif
       return 0;
     }
-  *text = malloc(dbstore.dsize);
-  if (!*text)
-    return -1;
-  memcpy(*text, (char *)(dbstore.dptr)+sizeof(time_t), dbstore.dsize-sizeof(time_t));
-  dbm_close(dbf);
 
-  return (dbstore.dsize-sizeof(time_t));
+  view->text = data;
+  view->len = len;
+#if defined USE_DBM && defined HAVE_GDBM_OPEN
+  /* gdbm hands over the record it fetched.  */
+  if (!cache.native)
+    view->owned = dbstore.dptr;
+#endif
+  return 1;
 #else
+  (void) key;
   return 0;
 #endif /* !NOCACHE */
 }
+
+/*
+ *  This releases a view returned by cache_read().
+ */
+void
+cache_release(struct cache_view *view)
+{
+  free(view->owned);
+  view->text = NULL;
+  view->len = 0;
+  view->owned = NULL;
+}
@@ -19,8 +19,25 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include <stddef.h>
+
+/* A cached text, which is borrowed from the cache until it is released
+   by cache_release() or until the next call to a cache function.  The
+   text is followed by a null byte.  */
+struct cache_view {
+  const char *text;
+  size_t len;
+
+  /* Memory to free on release, if any.  */
+  void *owned;
+};
+
 int cache_init(void);
+int cache_open(void);
+int cache_flush(void);
+void cache_close(void);
 int cache_store(char *key, const char *text);
-int cache_read(char *key, char **text);
+int cache_read(char *key, struct cache_view *view);
+void cache_release(struct cache_view *view);
 
 #endif
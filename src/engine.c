@@ -0,0 +1,954 @@
+/* engine.c - query engine
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Specification.  */
+#include "engine.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <strings.h>
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#else
+# include <poll.h>
+#endif
+#include "c-strtod.h"
+#include "init.h"
+#include "lookup.h"
+#include "resolve.h"
+#include "utils.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+# define ENGINE_IN EPOLLIN
+# define ENGINE_OUT EPOLLOUT
+#else
+# define ENGINE_IN POLLIN
+# define ENGINE_OUT POLLOUT
+#endif
+
+/* A server closing the connection early must not kill the process.  */
+#ifdef MSG_NOSIGNAL
+# define ENGINE_SEND_FLAGS MSG_NOSIGNAL
+#else
+# define ENGINE_SEND_FLAGS 0
+#endif
+
+/* Number of events handled by a call to epoll_wait().  */
+#define ENGINE_EVENTS 256
+
+/* A connection attempted to an address of the server of a query.  */
+struct engine_attempt {
+  int fd;
+  uint64_t deadline;
+};
+
+/* Limits on the queries to a server, from its server options.  */
+struct engine_host {
+  char *name;
+
+  /* Milliseconds between the start of two queries, and number of queries
+     at once, or 0 for no limit.  */
+  uint64_t interval;
+  unsigned int max_connections;
+
+  /* Milliseconds the server may stay silent, and may take to answer a
+     query, or 0 for no limit.  */
+  uint64_t read_timeout, query_deadline;
+
+  /* Queries in progress, and time at which the next one may start.  */
+  unsigned int connections;
+  uint64_t next_start;
+
+  /* Queries waiting for the limits to let them start.  */
+  struct engine_query *queue, *last;
+
+  struct engine_host *next;
+};
+
+int
+engine_init (struct engine *e)
+{
+  e->active = e->completed = NULL;
+  e->count = 0;
+  e->hosts = NULL;
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev;
+  int fd = resolve_fd ();
+
+  e->fd = epoll_create1 (EPOLL_CLOEXEC);
+  if (e->fd < 0)
+    return -1;
+
+  /* The lookups of the resolver are told apart by their null pointer.  */
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  if (fd >= 0 && epoll_ctl (e->fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+      close (e->fd);
+      return -1;
+    }
+#else
+  e->fd = -1;
+#endif
+  return 0;
+}
+
+void
+engine_free (struct engine *e)
+{
+  struct engine_host *h;
+
+  while ((h = e->hosts))
+    {
+      e->hosts = h->next;
+      free (h->name);
+      free (h);
+    }
+  if (e->fd >= 0)
+    close (e->fd);
+  e->fd = -1;
+}
+
+/*
+ *  Returns the limits of the server `name', read from its server options
+ *  unless it is in use already.
+ */
+static struct engine_host *
+engine_host (struct engine *e, const char *name)
+{
+  struct engine_host *h;
+  const char *value;
+  char *end;
+  double qps;
+  unsigned long n;
+
+  for (h = e->hosts; h; h = h->next)
+    if (strcasecmp (h->name, name) == 0)
+      return h;
+
+  h = xcalloc (1, sizeof *h);
+  h->name = xstrdup (name);
+  h->next = e->hosts;
+  e->hosts = h;
+
+  value = get_whois_server_option (name, "max-qps");
+  if (value)
+    {
+      qps = c_strtod (value, &end);
+      if (end == value || *end != '\0' || !(qps > 0))
+        {
+          if (arguments->verbose)
+            printf ("[%s: %s max-qps = %s]\n", name, _("Invalid value"),
+                    value);
+        }
+      else if (qps < 1000)
+        h->interval = (uint64_t) (1000 / qps + 0.5);
+    }
+
+  value = get_whois_server_option (name, "max-connections");
+  if (value)
+    {
+      errno = 0;
+      n = strtoul (value, &end, 10);
+      if (end == value || *end != '\0' || n == 0 || n > UINT_MAX
+          || errno)
+        {
+          if (arguments->verbose)
+            printf ("[%s: %s max-connections = %s]\n", name,
+                    _("Invalid value"), value);
+        }
+      else
+        h->max_connections = n;
+    }
+
+  h->read_timeout = (uint64_t) get_whois_server_timeout
+    (name, "read-timeout", arguments->read_timeout) * 1000;
+  h->query_deadline = (uint64_t) get_whois_server_timeout
+    (name, "query-deadline", 0) * 1000;
+  return h;
+}
+
+/*
+ *  Waits for the socket of `q' to be ready for `events'.
+ */
+static void
+engine_watch (struct engine *e, struct engine_query *q, int events)
+{
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev;
+
+  q->events = events;
+  ev.events = events;
+  ev.data.ptr = q;
+  if (epoll_ctl (e->fd, q->watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, q->fd,
+                 &ev) == 0)
+    q->watched = true;
+#else
+  (void) e;
+  q->events = events;
+  q->watched = true;
+#endif
+}
+
+/*
+ *  Closes the socket of `q', unless it was only waited for. It is removed
+ *  from the epoll set first, since a copy of it may be left open in a
+ *  child process.
+ */
+static void
+engine_close (struct engine *e, struct engine_query *q)
+{
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev;
+
+  if (q->watched)
+    epoll_ctl (e->fd, EPOLL_CTL_DEL, q->fd, &ev);
+#else
+  (void) e;
+#endif
+  q->watched = false;
+  if (q->fd >= 0 && q->state != ENGINE_NOTIFY)
+    close (q->fd);
+  q->fd = -1;
+}
+
+/*
+ *  Gives up the connection attempt `i' of `q', which is replaced by its
+ *  last attempt.
+ */
+static void
+engine_abandon (struct engine *e, struct engine_query *q, unsigned int i)
+{
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev;
+
+  epoll_ctl (e->fd, EPOLL_CTL_DEL, q->attempts[i].fd, &ev);
+#else
+  (void) e;
+#endif
+  close (q->attempts[i].fd);
+  q->attempts[i] = q->attempts[--q->attempting];
+}
+
+/*
+ *  Closes the connection of `q' and those still attempted, and forgets
+ *  the addresses of its server.
+ */
+static void
+engine_disconnect (struct engine *e, struct engine_query *q)
+{
+  engine_close (e, q);
+  while (q->attempting > 0)
+    engine_abandon (e, q, 0);
+  free (q->attempts);
+  q->attempts = NULL;
+  resolve_free (q->addrs);
+  q->addrs = q->addr = NULL;
+}
+
+/*
+ *  Adds `q' to the queries in progress.
+ */
+static void
+engine_link (struct engine *e, struct engine_query *q)
+{
+  q->prev = NULL;
+  q->next = e->active;
+  if (e->active)
+    e->active->prev = q;
+  e->active = q;
+  e->count++;
+}
+
+/*
+ *  Removes `q' from the queries in progress.
+ */
+static void
+engine_unlink (struct engine *e, struct engine_query *q)
+{
+  if (q->prev)
+    q->prev->next = q->next;
+  else
+    e->active = q->next;
+  if (q->next)
+    q->next->prev = q->prev;
+  q->prev = NULL;
+}
+
+/*
+ *  Moves `q' to the completed queries, with the status `status'.
+ */
+static void
+engine_finish (struct engine *e, struct engine_query *q, int status)
+{
+  engine_disconnect (e, q);
+  free (q->request);
+  q->request = NULL;
+  if (q->host)
+    q->host->connections--;
+  q->host = NULL;
+  q->status = status;
+  q->deadline = 0;
+  if (status == 0)
+    q->state = ENGINE_DONE;
+
+  engine_unlink (e, q);
+  q->next = e->completed;
+  e->completed = q;
+}
+
+/*
+ *  Sets the time by which `q' must have made progress reading or writing
+ *  its socket.
+ */
+static void
+engine_idle (struct engine_query *q, uint64_t now)
+{
+  uint64_t timeout = q->host ? q->host->read_timeout : 0;
+
+  q->deadline = q->expires;
+  if (timeout && (!q->deadline || now + timeout < q->deadline))
+    q->deadline = now + timeout;
+}
+
+/*
+ *  Starts connecting to the next address of `q', or to the following
+ *  ones if it fails at once. Returns false if no connection could be
+ *  started.
+ */
+static bool
+engine_attempt (struct engine *e, struct engine_query *q, uint64_t now)
+{
+  struct engine_attempt *a = &q->attempts[q->attempting];
+  const struct addrinfo *ai;
+  int flags;
+
+  while ((ai = q->addr))
+    {
+      q->addr = ai->ai_next;
+      a->fd = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (a->fd < 0)
+        continue;
+
+      flags = fcntl (a->fd, F_GETFL, 0);
+      if (fcntl (a->fd, F_SETFL, flags | O_NONBLOCK) == 0
+          && (connect (a->fd, ai->ai_addr, ai->ai_addrlen) == 0
+              || errno == EINPROGRESS))
+        {
+#ifdef HAVE_SYS_EPOLL_H
+          struct epoll_event ev;
+
+          /* The events of all the attempts of `q' point to it.  */
+          ev.events = ENGINE_OUT;
+          ev.data.ptr = q;
+          epoll_ctl (e->fd, EPOLL_CTL_ADD, a->fd, &ev);
+#else
+          (void) e;
+#endif
+          a->deadline = now + (uint64_t) arguments->connect_timeout * 1000;
+          q->attempting++;
+          return true;
+        }
+      close (a->fd);
+    }
+  return false;
+}
+
+/*
+ *  Moves the connection of `q' on, as RFC 8305 recommends: keeps the
+ *  first attempt which succeeded, gives up those which failed or took too
+ *  long, and attempts to connect to the next address of the server
+ *  CONNECT_ATTEMPT_DELAY milliseconds after the last attempt, or at once
+ *  if an attempt was given up. Returns true once connected.
+ */
+static bool
+engine_connect (struct engine *e, struct engine_query *q)
+{
+  struct sockaddr_storage peer;
+  uint64_t now = clock_ms ();
+  socklen_t len;
+  unsigned int i;
+  int error;
+
+  q->state = ENGINE_CONNECT;
+  if (q->expires && q->expires <= now)
+    {
+      engine_finish (e, q, -4);
+      return false;
+    }
+  for (i = 0; i < q->attempting;)
+    {
+      len = sizeof error;
+      if (getsockopt (q->attempts[i].fd, SOL_SOCKET, SO_ERROR, &error,
+                      &len) < 0 || error)
+        {
+          engine_abandon (e, q, i);
+          q->next_attempt = now;
+          continue;
+        }
+
+      /* The address of the peer is only known once connected.  */
+      len = sizeof peer;
+      if (getpeername (q->attempts[i].fd, (struct sockaddr *) &peer,
+                       &len) == 0)
+        {
+          q->fd = q->attempts[i].fd;
+          q->events = ENGINE_OUT;
+          q->watched = true;
+          q->attempts[i] = q->attempts[--q->attempting];
+          while (q->attempting > 0)
+            engine_abandon (e, q, 0);
+          q->state = ENGINE_WRITE;
+          engine_idle (q, now);
+          return true;
+        }
+
+      if (q->attempts[i].deadline <= now)
+        {
+          engine_abandon (e, q, i);
+          q->next_attempt = now;
+        }
+      else
+        i++;
+    }
+
+  if ((q->attempting == 0 || (q->addr && now >= q->next_attempt))
+      && engine_attempt (e, q, now))
+    q->next_attempt = now + CONNECT_ATTEMPT_DELAY;
+  if (q->attempting == 0)
+    {
+      engine_finish (e, q, -1);
+      return false;
+    }
+
+  q->deadline = q->addr ? q->next_attempt : UINT64_MAX;
+  for (i = 0; i < q->attempting; i++)
+    if (q->attempts[i].deadline < q->deadline)
+      q->deadline = q->attempts[i].deadline;
+  if (q->expires && q->expires < q->deadline)
+    q->deadline = q->expires;
+  return false;
+}
+
+/*
+ *  Connects to the addresses of `q' once they are looked up.
+ */
+static void
+engine_resolved (struct resolve_request *r)
+{
+  struct engine_query *q = r->data;
+  const struct addrinfo *ai;
+  unsigned int count = 0;
+
+  if (r->error)
+    {
+      engine_finish (q->engine, q, -1);
+      return;
+    }
+  /* The lookup is not given up when the deadline passes, but the
+     connection is not attempted.  */
+  if (q->expires && q->expires <= clock_ms ())
+    {
+      resolve_free (r->addrs);
+      r->addrs = NULL;
+      engine_finish (q->engine, q, -4);
+      return;
+    }
+  q->addrs = q->addr = r->addrs;
+  r->addrs = NULL;
+  for (ai = q->addrs; ai; ai = ai->ai_next)
+    count++;
+  q->attempts = xcalloc (count, sizeof *q->attempts);
+  engine_connect (q->engine, q);
+}
+
+/*
+ *  Starts `q' now that the limits of its server let it.
+ */
+static void
+engine_start (struct engine *e, struct engine_query *q, uint64_t now)
+{
+  struct engine_host *h = q->host;
+
+  h->connections++;
+  h->next_start = now + h->interval;
+  q->expires = q->wq->deadline;
+  if (h->query_deadline
+      && (!q->expires || now + h->query_deadline < q->expires))
+    q->expires = now + h->query_deadline;
+  q->deadline = 0;
+  q->state = ENGINE_RESOLVE;
+  q->lookup.done = engine_resolved;
+  q->lookup.data = q;
+  if (resolve_start (&q->lookup, q->wq->host, q->wq->port) == 0)
+    engine_resolved (&q->lookup);
+}
+
+/*
+ *  Returns true if the limits of `h' let a query start at `now'.
+ */
+static bool
+engine_host_ready (const struct engine_host *h, uint64_t now)
+{
+  return (!h->max_connections || h->connections < h->max_connections)
+    && h->next_start <= now;
+}
+
+void
+engine_whois (struct engine *e, struct engine_query *q)
+{
+  uint64_t now = clock_ms ();
+  struct engine_host *h;
+
+  q->engine = e;
+  q->fd = -1;
+  q->watched = false;
+  q->addrs = q->addr = NULL;
+  q->attempts = NULL;
+  q->attempting = 0;
+  q->length = strlen (q->wq->query) + 2;
+  q->request = xmalloc (q->length + 1);
+  sprintf (q->request, "%s\r\n", q->wq->query);
+  q->sent = 0;
+  q->start = q->text->len;
+  q->tries = 0;
+  q->expires = q->deadline = q->wq->deadline;
+  q->queued = NULL;
+  q->state = ENGINE_WAIT;
+  engine_link (e, q);
+
+  h = q->host = engine_host (e, q->wq->host);
+  if (!h->queue && engine_host_ready (h, now))
+    {
+      engine_start (e, q, now);
+      return;
+    }
+  if (h->last)
+    h->last->queued = q;
+  else
+    h->queue = q;
+  h->last = q;
+}
+
+/*
+ *  Starts the waiting queries which the limits of their server let start.
+ *  Returns the time in milliseconds until the next one may start, or -1
+ *  if none is waiting for time to pass. The servers left with no query
+ *  and no limit to wait for are forgotten, so that only those in use are
+ *  kept.
+ */
+static int
+engine_schedule (struct engine *e)
+{
+  struct engine_host **p, *h;
+  struct engine_query *q;
+  uint64_t now = clock_ms (), first = 0;
+
+  for (p = &e->hosts; (h = *p);)
+    {
+      if (!h->queue && !h->connections && h->next_start <= now)
+        {
+          *p = h->next;
+          free (h->name);
+          free (h);
+          continue;
+        }
+      p = &h->next;
+
+      while (h->queue && engine_host_ready (h, now))
+        {
+          q = h->queue;
+          h->queue = q->queued;
+          if (!h->queue)
+            h->last = NULL;
+          q->queued = NULL;
+          engine_start (e, q, now);
+        }
+      /* A query waiting for a connection to close is started once one
+         is complete.  */
+      if (h->queue && (!h->max_connections
+                       || h->connections < h->max_connections)
+          && (!first || h->next_start < first))
+        first = h->next_start;
+    }
+  return first ? (int) (first - now) : -1;
+}
+
+void
+engine_read (struct engine *e, struct engine_query *q, int fd)
+{
+  q->wq = NULL;
+  q->engine = e;
+  q->fd = fd;
+  q->watched = false;
+  q->addrs = q->addr = NULL;
+  q->attempts = NULL;
+  q->attempting = 0;
+  q->request = NULL;
+  q->lines = NULL;
+  q->expires = q->deadline = 0;
+  q->host = NULL;
+  q->queued = NULL;
+  q->state = ENGINE_READ;
+  engine_link (e, q);
+  engine_watch (e, q, ENGINE_IN);
+}
+
+void
+engine_notify (struct engine *e, struct engine_query *q, int fd,
+               bool write, int timeout)
+{
+  q->wq = NULL;
+  q->engine = e;
+  q->fd = fd;
+  q->watched = false;
+  q->addrs = q->addr = NULL;
+  q->attempts = NULL;
+  q->attempting = 0;
+  q->request = NULL;
+  q->lines = NULL;
+  q->expires = 0;
+  q->deadline = timeout > 0 ? clock_ms () + timeout : 0;
+  q->host = NULL;
+  q->queued = NULL;
+  q->state = ENGINE_NOTIFY;
+  engine_link (e, q);
+  engine_watch (e, q, write ? ENGINE_OUT : ENGINE_IN);
+}
+
+void
+engine_cancel (struct engine *e, struct engine_query *q)
+{
+  struct engine_query **p;
+
+  /* The query may be complete already, waiting for its DONE function to
+     be called.  */
+  for (p = &e->completed; *p && *p != q; p = &(*p)->next)
+    ;
+  if (*p)
+    *p = q->next;
+  else
+    {
+      engine_close (e, q);
+      engine_unlink (e, q);
+    }
+  q->next = NULL;
+  e->count--;
+}
+
+/*
+ *  Completes `q' once its answer is read, unless the answer tells that
+ *  the rate limit of the server was exceeded. The query is then put back
+ *  first in the queue of the server, which takes no query until the
+ *  delay for the next try is over.
+ */
+static void
+engine_answered (struct engine *e, struct engine_query *q)
+{
+  struct engine_host *h = q->host;
+  uint64_t next;
+  int delay;
+
+  delay = lookup_rate_limit (q->wq, q->text->data + q->start, q->tries);
+  if (delay != 0)
+    buffer_truncate (q->text, q->start);
+  if (delay <= 0)
+    {
+      engine_finish (e, q, delay < 0 ? -2 : 0);
+      return;
+    }
+
+  /* The query can't be made again before its deadline.  */
+  next = clock_ms () + (uint64_t) delay * 1000;
+  if (q->wq->deadline && q->wq->deadline <= next)
+    {
+      engine_finish (e, q, -4);
+      return;
+    }
+
+  engine_disconnect (e, q);
+  q->sent = 0;
+  q->tries++;
+  q->state = ENGINE_WAIT;
+  q->expires = q->deadline = q->wq->deadline;
+  h->connections--;
+
+  if (h->next_start < next)
+    h->next_start = next;
+  q->queued = h->queue;
+  h->queue = q;
+  if (!h->last)
+    h->last = q;
+}
+
+/*
+ *  Hands the complete lines of the answer of `q' read since the last
+ *  call to its LINES function.
+ */
+static void
+engine_lines (struct engine_query *q)
+{
+  const char *text = q->text->data + q->scanned;
+  size_t len = q->text->len - q->scanned;
+
+  while (len > 0 && text[len - 1] != '\n')
+    len--;
+  if (len == 0)
+    return;
+  q->scanned += len;
+  if (q->lines (q, text, len))
+    q->lines = NULL;
+}
+
+/*
+ *  Moves `q' on now that its socket is ready.
+ */
+static void
+engine_event (struct engine *e, struct engine_query *q)
+{
+  ssize_t ret;
+
+  /* The events of sockets closed by an earlier event of the same wait
+     may still come.  */
+  if (q->fd < 0 && q->attempting == 0)
+    return;
+
+  switch (q->state)
+    {
+    case ENGINE_CONNECT:
+      if (!engine_connect (e, q))
+        return;
+      /* Fall through.  */
+
+    case ENGINE_WRITE:
+      ret = send (q->fd, q->request + q->sent, q->length - q->sent,
+                  ENGINE_SEND_FLAGS);
+      if (ret < 0)
+        {
+          if (errno != EAGAIN && errno != EINTR)
+            engine_finish (e, q, -1);
+          return;
+        }
+      q->sent += ret;
+      if (q->deadline)
+        engine_idle (q, clock_ms ());
+      if (q->sent < q->length)
+        return;
+
+      q->state = ENGINE_READ;
+      buffer_printf (q->text, "[%s]\n", q->wq->host);
+      q->scanned = q->text->len;
+      engine_watch (e, q, ENGINE_IN);
+      return;
+
+    case ENGINE_READ:
+      ret = buffer_read (q->text, q->fd);
+      if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+      if (ret < 0)
+        engine_finish (e, q, -1);
+      else if (ret > 0)
+        {
+          if (q->deadline)
+            engine_idle (q, clock_ms ());
+          if (q->lines)
+            engine_lines (q);
+        }
+      else if (q->wq)
+        engine_answered (e, q);
+      else
+        engine_finish (e, q, 0);
+      return;
+
+    case ENGINE_NOTIFY:
+      engine_finish (e, q, 0);
+      return;
+
+    case ENGINE_WAIT:
+    case ENGINE_RESOLVE:
+    case ENGINE_DONE:
+      return;
+    }
+}
+
+/*
+ *  Removes `q' from the queries waiting for its server.
+ */
+static void
+engine_unqueue (struct engine_query *q)
+{
+  struct engine_host *h = q->host;
+  struct engine_query *prev = NULL, *p;
+
+  for (p = h->queue; p != q; p = p->queued)
+    prev = p;
+  if (prev)
+    prev->queued = q->queued;
+  else
+    h->queue = q->queued;
+  if (h->last == q)
+    h->last = prev;
+  q->queued = NULL;
+}
+
+/*
+ *  Moves `q' on once its deadline is reached at `now': its connection
+ *  attempts which took too long are given up, or the query if it took
+ *  too long or its server stopped sending.
+ */
+static void
+engine_timeout (struct engine *e, struct engine_query *q, uint64_t now)
+{
+  switch (q->state)
+    {
+    case ENGINE_CONNECT:
+      engine_connect (e, q);
+      return;
+
+    case ENGINE_WAIT:
+      /* The query holds no connection of its server.  */
+      engine_unqueue (q);
+      q->host = NULL;
+      engine_finish (e, q, -4);
+      return;
+
+    case ENGINE_WRITE:
+    case ENGINE_READ:
+      engine_finish (e, q, q->expires && q->expires <= now ? -4 : -3);
+      return;
+
+    case ENGINE_NOTIFY:
+      engine_finish (e, q, -3);
+      return;
+
+    case ENGINE_RESOLVE:
+    case ENGINE_DONE:
+      return;
+    }
+}
+
+/*
+ *  Gives up the connections which took too long. Returns the time in
+ *  milliseconds until the next deadline, or -1 if there is none.
+ */
+static int
+engine_expire (struct engine *e)
+{
+  struct engine_query *q, *next;
+  uint64_t now = clock_ms (), first = 0;
+
+  for (q = e->active; q; q = next)
+    {
+      next = q->next;
+      if (!q->deadline)
+        continue;
+      if (q->deadline <= now)
+        engine_timeout (e, q, now);
+      else if (!first || q->deadline < first)
+        first = q->deadline;
+    }
+  return first ? (int) (first - now) : -1;
+}
+
+int
+engine_wait (struct engine *e, int timeout)
+{
+  struct engine_query *q;
+  int next, n, i;
+
+  next = engine_schedule (e);
+  if (next >= 0 && (timeout < 0 || next < timeout))
+    timeout = next;
+  next = engine_expire (e);
+  if (next >= 0 && (timeout < 0 || next < timeout))
+    timeout = next;
+  if (e->completed)
+    timeout = 0;
+
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event events[ENGINE_EVENTS];
+
+  n = epoll_wait (e->fd, events, ENGINE_EVENTS, timeout);
+  if (n < 0 && errno != EINTR)
+    return -1;
+  for (i = 0; i < n; i++)
+    if (events[i].data.ptr)
+      engine_event (e, events[i].data.ptr);
+    else
+      resolve_finish ();
+#else
+  struct engine_query **polled;
+  struct pollfd *fds;
+  unsigned int j;
+
+  n = e->count + 1;
+  for (q = e->active; q; q = q->next)
+    n += q->attempting;
+  polled = xcalloc (n, sizeof *polled);
+  fds = xcalloc (n, sizeof *fds);
+  n = 0;
+  if (resolve_fd () >= 0)
+    {
+      fds[n].fd = resolve_fd ();
+      fds[n].events = ENGINE_IN;
+      polled[n++] = NULL;
+    }
+  for (q = e->active; q; q = q->next)
+    if (q->watched)
+      {
+        fds[n].fd = q->fd;
+        fds[n].events = q->events;
+        polled[n++] = q;
+      }
+    else
+      for (j = 0; j < q->attempting; j++)
+        {
+          fds[n].fd = q->attempts[j].fd;
+          fds[n].events = ENGINE_OUT;
+          polled[n++] = q;
+        }
+  if (poll (fds, n, timeout) < 0)
+    n = errno == EINTR ? 0 : -1;
+  for (i = 0; i < n; i++)
+    if (fds[i].revents && polled[i])
+      engine_event (e, polled[i]);
+    else if (fds[i].revents)
+      resolve_finish ();
+  free (fds);
+  free (polled);
+  if (n < 0)
+    return -1;
+#endif
+
+  engine_expire (e);
+  while ((q = e->completed))
+    {
+      e->completed = q->next;
+      q->next = NULL;
+      e->count--;
+      q->done (q);
+    }
+  return e->count;
+}
@@ -0,0 +1,154 @@
+/* engine.h - declarations for the query engine
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "buffer.h"
+#include "resolve.h"
+#include "whois.h"
+
+/* An engine makes many queries at once in a single thread.  Each query
+   is a state machine which moves on when its socket is ready, as told by
+   epoll, or by poll where epoll is missing.  Queries are only completed
+   from engine_wait(), which calls their DONE function.  The addresses
+   of the servers are looked up by the threads of the resolver, whose
+   results are waited for along with the sockets.  The addresses of a
+   server are connected to in turn, without waiting for the previous
+   attempts to fail, and the first connection made is kept.
+
+   The queries to a server whose options set max-qps or max-connections
+   wait in the engine until the limits allow them to start.  A query
+   whose answer matches a rate-limit pattern of the server is made again
+   later, and the other queries to the server wait as long.
+
+   A query is given up when its server stops sending for the
+   read-timeout of the server, or when the deadline of WQ, or the
+   query-deadline of the server counted from the start of the query,
+   is reached.
+
+   The lines of an answer can be looked at as they arrive, so that the
+   caller may act on them before the end of the answer, for instance to
+   follow a redirection at once.
+
+   Other file descriptors, such as listening sockets, can be waited for
+   along with the queries, each by a query of its own.  */
+
+struct engine_attempt;
+struct engine_host;
+
+/* States of a query.  */
+enum engine_state {
+  ENGINE_WAIT,
+  ENGINE_RESOLVE,
+  ENGINE_CONNECT,
+  ENGINE_WRITE,
+  ENGINE_READ,
+  ENGINE_NOTIFY,
+  ENGINE_DONE
+};
+
+struct engine_query {
+  /* Query to send to WQ->host and WQ->port, or NULL to read or wait for
+     a file descriptor.  */
+  whois_query_t wq;
+
+  /* Buffer to which the answer is appended.  */
+  struct buffer *text;
+
+  /* Function called once the query is complete, and its data.  */
+  void (*done) (struct engine_query *q);
+  void *data;
+
+  /* Function called, unless NULL, with the LEN bytes of complete lines
+     at TEXT each time the answer has new ones, until it returns true.
+     It may start other queries.  Only used by engine_whois().  */
+  bool (*lines) (struct engine_query *q, const char *text, size_t len);
+
+  /* Set to 0 once the answer is read, or the file descriptor is ready,
+     to -1 on error, in which case STATE is the state in which the query
+     failed, to -2 if the server still answered that its rate limit was
+     exceeded after the last try, to -3 if the server stopped sending for
+     its read timeout, or the file descriptor wasn't ready in time, or to
+     -4 if the deadline of the query, or of its server, was reached.
+     The lookup of the host, which failed if STATE is ENGINE_RESOLVE, has
+     its error code in LOOKUP.error.  */
+  int status;
+  enum engine_state state;
+  struct resolve_request lookup;
+
+  /* Private to the engine.  */
+  struct engine *engine;
+  int fd, events;
+  bool watched;
+  struct addrinfo *addrs, *addr;
+  struct engine_attempt *attempts;
+  unsigned int attempting;
+  uint64_t next_attempt;
+  char *request;
+  size_t sent, length, start, scanned;
+  int tries;
+  uint64_t deadline, expires;
+  struct engine_host *host;
+  struct engine_query *prev, *next, *queued;
+};
+
+struct engine {
+  int fd;
+
+  /* Queries in progress, and completed queries whose DONE function is
+     still to be called.  */
+  struct engine_query *active, *completed;
+  unsigned int count;
+
+  /* Limits of the servers being queried, or waited for.  */
+  struct engine_host *hosts;
+};
+
+/* Initialize the engine E.  Return 0 on success, or -1 with errno set.  */
+extern int engine_init (struct engine *e);
+
+/* Release the resources of E, which must have no query left.  */
+extern void engine_free (struct engine *e);
+
+/* Start sending Q->wq->query to Q->wq->host and reading the answer, as
+   whois_query() does, with the "[HOST]" line before the answer.  The
+   query waits first if the limits of the server are reached.  */
+extern void engine_whois (struct engine *e, struct engine_query *q);
+
+/* Start reading FD until its end, which is closed afterwards.  */
+extern void engine_read (struct engine *e, struct engine_query *q, int fd);
+
+/* Wait for FD to be readable, or writable if WRITE is true, for up to
+   TIMEOUT milliseconds, or forever if TIMEOUT is 0.  FD is left open, and
+   Q is complete once it is ready, or has timed out.  */
+extern void engine_notify (struct engine *e, struct engine_query *q, int fd,
+                           bool write, int timeout);
+
+/* Stop waiting for the file descriptor of Q, started by engine_notify(),
+   whose DONE function is not called, even if Q is complete already.  */
+extern void engine_cancel (struct engine *e, struct engine_query *q);
+
+/* Wait up to TIMEOUT milliseconds, or forever if TIMEOUT is negative, for
+   queries of E to make progress, and complete those which are done.
+   Return the number of queries in progress, or -1 with errno set.  */
+extern int engine_wait (struct engine *e, int timeout);
+
+#endif /* ENGINE_H */
@@ -37,7 +37,7 @@
  *
  * Returns -1 on error, 0 on success.
  */
-int http_query (whois_query_t wq, char **text)
+int http_query (whois_query_t wq, struct buffer *text)
 {
     const char *method = get_whois_server_option(wq->host, "http-method");
     const char *action = get_whois_server_option(wq->host, "http-action");
@@ -241,7 +241,6 @@ int http_query (whois_query_t wq, char **text)
 
     /* Go on and do something */
     printf("[%s http://%s%s]\n", _("Querying"), wq->host, action);
-    *text = NULL;
 
     /* Setup communication pipes */
     if (0 != pipe(from_browser) || 0 != pipe(to_browser))
@@ -281,8 +280,6 @@ int http_query (whois_query_t wq, char **text)
       {
         /* This is the parent process */
         char data[MAXBUFSIZE];
-        int datalen;
-        int readbytes;
 	
         close(to_browser[0]);
         close(from_browser[1]);
@@ -316,16 +313,8 @@ int http_query (whois_query_t wq, char **text)
         close(to_browser[1]);
 	
         /* Get data from browser */
-        *text = NULL;
-        datalen = 0;
-        data[MAXBUFSIZE - 1] = 0;
-        while ((readbytes = read(from_browser[0], data, sizeof data - 1)) > 0)
-	  {
-            *text = (char *) realloc(*text, datalen + readbytes + 1);
-            data[readbytes] = 0;
-            strcpy(*text + datalen, data);
-            datalen += readbytes;
-	  }
+        while (buffer_read(text, from_browser[0]) > 0)
+          ;
 	
         close(from_browser[0]);
       }
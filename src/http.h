@@ -21,6 +21,6 @@
 
 #include "whois.h"
 
-int http_query (whois_query_t, char **);
+int http_query (whois_query_t, struct buffer *);
 
 #endif
@@ -0,0 +1,281 @@
+/* image.c - compiled configuration images
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Specification.  */
+#include "image.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#include "jconfig.h"
+#include "lookup.h"
+
+#define IMAGE_MAGIC "JWHOISCF"
+
+/* Written in native byte order, to recognize images of other machines.  */
+#define IMAGE_BYTE_ORDER 0x01020304u
+
+/* Start of an image.  The size and modification time of the
+   configuration file are those it had when the image was written.  */
+struct image_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  int64_t mtime;
+  int64_t mtime_nsec;
+  uint64_t size;
+
+  /* Offsets of the configuration and of the routing tables.  */
+  uint64_t jconfig;
+  uint64_t lookup;
+};
+
+void
+image_writer_init (struct image_writer *w)
+{
+  w->size = 65536;
+  w->data = xmalloc (w->size);
+  w->len = 0;
+}
+
+void
+image_writer_free (struct image_writer *w)
+{
+  free (w->data);
+  w->data = NULL;
+  w->len = w->size = 0;
+}
+
+uint64_t
+image_put (struct image_writer *w, const void *data, size_t len)
+{
+  size_t offset = (w->len + 7) & ~(size_t) 7;
+
+  if (offset + len > w->size)
+    {
+      while (offset + len > w->size)
+        w->size *= 2;
+      w->data = xrealloc (w->data, w->size);
+    }
+  memset (w->data + w->len, 0, offset - w->len);
+  memcpy (w->data + offset, data, len);
+  w->len = offset + len;
+  return offset;
+}
+
+const void *
+image_get (const struct image *img, uint64_t offset, size_t n, size_t size)
+{
+  if (offset > img->len || (size && n > (img->len - offset) / size))
+    return NULL;
+  return img->data + offset;
+}
+
+const char *
+image_get_string (const struct image *img, uint64_t offset)
+{
+  if (offset >= img->len
+      || !memchr (img->data + offset, '\0', img->len - offset))
+    return NULL;
+  return img->data + offset;
+}
+
+char *
+image_file_name (const char *config)
+{
+  char *name = xmalloc (strlen (config) + 5);
+
+  strcpy (name, config);
+  strcat (name, ".bin");
+  return name;
+}
+
+/*
+ *  Stores the modification time of `st' in `h'.
+ */
+static void
+image_set_mtime (struct image_header *h, const struct stat *st)
+{
+  h->mtime = st->st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+  h->mtime_nsec = st->st_mtim.tv_nsec;
+#else
+  h->mtime_nsec = 0;
+#endif
+}
+
+int
+image_write (const char *config)
+{
+  struct image_writer w;
+  struct image_header h;
+  struct stat st;
+  char *name, *tmp;
+  size_t done = 0;
+  ssize_t ret;
+  int fd, saved_errno;
+
+  if (stat (config, &st) < 0)
+    return -1;
+
+  memset (&h, 0, sizeof h);
+  memcpy (h.magic, IMAGE_MAGIC, sizeof h.magic);
+  h.version = IMAGE_VERSION;
+  h.byte_order = IMAGE_BYTE_ORDER;
+  image_set_mtime (&h, &st);
+  h.size = st.st_size;
+
+  image_writer_init (&w);
+  image_put (&w, &h, sizeof h);
+  h.jconfig = jconfig_image_save (&w);
+  h.lookup = lookup_image_save (&w);
+  memcpy (w.data, &h, sizeof h);
+
+  /* Write to a temporary file renamed over the image, so that concurrent
+     runs see either the old image or the complete new one.  */
+  name = image_file_name (config);
+  tmp = xmalloc (strlen (name) + 7);
+  sprintf (tmp, "%sXXXXXX", name);
+  fd = mkstemp (tmp);
+  if (fd < 0)
+    goto fail;
+
+  while (done < w.len)
+    {
+      ret = write (fd, w.data + done, w.len - done);
+      if (ret < 0 && errno != EINTR)
+        break;
+      if (ret > 0)
+        done += ret;
+    }
+  if (done < w.len || fchmod (fd, 0644) < 0)
+    {
+      saved_errno = errno;
+      close (fd);
+      errno = saved_errno;
+      goto fail_unlink;
+    }
+  if (close (fd) < 0 || rename (tmp, name) < 0)
+    goto fail_unlink;
+
+  free (tmp);
+  free (name);
+  image_writer_free (&w);
+  return 0;
+
+ fail_unlink:
+  saved_errno = errno;
+  unlink (tmp);
+  errno = saved_errno;
+ fail:
+  saved_errno = errno;
+  free (tmp);
+  free (name);
+  image_writer_free (&w);
+  errno = saved_errno;
+  return -1;
+}
+
+int
+image_load (const char *config)
+{
+  const struct image_header *h;
+  struct image_header expected;
+  struct image img;
+  struct stat st, ist;
+  char *name, *data;
+  int fd;
+
+  if (stat (config, &st) < 0)
+    return -1;
+
+  name = image_file_name (config);
+  fd = open (name, O_RDONLY);
+  free (name);
+  if (fd < 0)
+    return -1;
+  if (fstat (fd, &ist) < 0 || (size_t) ist.st_size < sizeof *h)
+    {
+      close (fd);
+      return -1;
+    }
+
+  /* The image is never unmapped, since the configuration strings are
+     used in place.  */
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H
+  data = mmap (NULL, ist.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    return -1;
+#else
+  size_t done = 0;
+  ssize_t ret;
+
+  data = xmalloc (ist.st_size);
+  while (done < (size_t) ist.st_size)
+    {
+      ret = read (fd, data + done, ist.st_size - done);
+      if (ret < 0 && errno == EINTR)
+        continue;
+      if (ret <= 0)
+        break;
+      done += ret;
+    }
+  close (fd);
+  if (done < (size_t) ist.st_size)
+    {
+      free (data);
+      return -1;
+    }
+#endif
+
+  img.data = data;
+  img.len = ist.st_size;
+  h = image_get (&img, 0, 1, sizeof *h);
+  image_set_mtime (&expected, &st);
+
+  if (memcmp (h->magic, IMAGE_MAGIC, sizeof h->magic)
+      || h->version != IMAGE_VERSION || h->byte_order != IMAGE_BYTE_ORDER
+      || h->mtime != expected.mtime || h->mtime_nsec != expected.mtime_nsec
+      || h->size != (uint64_t) st.st_size)
+    goto fail;
+
+  if (jconfig_image_load (&img, h->jconfig) < 0)
+    goto fail;
+  if (lookup_image_load (&img, h->lookup) < 0)
+    {
+      jconfig_free ();
+      goto fail;
+    }
+  return 0;
+
+ fail:
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H
+  munmap (data, img.len);
+#else
+  free (data);
+#endif
+  return -1;
+}
@@ -0,0 +1,81 @@
+/* image.h - declarations for compiled configuration images
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A configuration image holds the parsed configuration and the routing
+   tables built from it, laid out so that it can be mapped in memory and
+   used in place.  Its parts refer to each other by offset from the start
+   of the image.  Images are only meant to be read on the machine which
+   wrote them.  */
+
+/* Version of the layout of images, to be increased whenever it changes.  */
+#define IMAGE_VERSION 1
+
+/* An image being written.  */
+struct image_writer {
+  char *data;
+  size_t len;
+  size_t size;
+};
+
+/* An image mapped in memory.  */
+struct image {
+  const char *data;
+  size_t len;
+};
+
+/* Initialize the empty image W.  */
+extern void image_writer_init (struct image_writer *w);
+
+/* Release the memory used by W.  */
+extern void image_writer_free (struct image_writer *w);
+
+/* Append the LEN bytes of DATA to W, aligned on 8 bytes, and return
+   their offset.  */
+extern uint64_t image_put (struct image_writer *w, const void *data,
+                           size_t len);
+
+/* Return the N objects of SIZE bytes at OFFSET in IMG, or NULL if they
+   don't all lie inside IMG.  */
+extern const void *image_get (const struct image *img, uint64_t offset,
+                              size_t n, size_t size);
+
+/* Return the string at OFFSET in IMG, or NULL if it doesn't end inside
+   IMG.  */
+extern const char *image_get_string (const struct image *img,
+                                     uint64_t offset);
+
+/* Return the name of the image of the configuration file CONFIG, in a
+   newly allocated string.  */
+extern char *image_file_name (const char *config);
+
+/* Write the image of the configuration, which was read from the file
+   CONFIG.  Return 0 on success, or -1 with errno set.  */
+extern int image_write (const char *config);
+
+/* Load the configuration and the routing tables from the image of the
+   configuration file CONFIG.  Return 0 on success, or -1 if the image
+   is missing, invalid or older than CONFIG.  */
+extern int image_load (const char *config);
+
+#endif /* IMAGE_H */
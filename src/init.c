@@ -38,7 +38,12 @@ static struct arguments _arguments = {
   .rwhois = false,
   .rwhois_display = NULL,
   .rwhois_limit = 0,
-  .enable_whoisservers = true
+  .enable_whoisservers = true,
+  .compile_config = false,
+  .batch = NULL,
+  .jobs = 1,
+  .listen = NULL,
+  .listen_port = 0
 };
 
 struct arguments *arguments = &_arguments;
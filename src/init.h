@@ -76,6 +76,28 @@ struct arguments {
 
   /* Timeout value for connect calls in seconds */
   int connect_timeout;
+
+  /* Seconds after which a server which stopped sending its answer is
+     given up, and seconds a query may take with its redirections, or 0
+     for no limit */
+  int read_timeout;
+  int query_deadline;
+
+  /* Set to TRUE to write the image of the configuration file instead of
+     making a query */
+  bool compile_config;
+
+  /* Name of the file of queries to make, or "-" for the standard input */
+  char *batch;
+
+  /* Number of queries of the batch file, or of local clients, made at
+     once */
+  int jobs;
+
+  /* Unix domain socket and port of the loopback address on which to
+     answer the queries of local clients, or NULL and 0 */
+  char *listen;
+  int listen_port;
 };
 
 /* XXX: Temporary global variable necessary until the rest of the code uses it
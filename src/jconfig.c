@@ -23,27 +23,358 @@
 #include "jconfig.h"
 
 #include <ctype.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #include "init.h"
 
-static struct jconfig *jconfig_tmpptr = NULL;
-static struct jconfig *jconfig_ptr = NULL;
-static struct jconfig *jconfig_addptr = NULL;
+/* Entries of the configuration, in the order they were added.  */
+static struct jconfig *jconfig_entries = NULL;
+static size_t jconfig_count = 0;
+static size_t jconfig_alloc = 0;
+
+/* Domains of the configuration.  A domain is recorded when it has
+   entries or sub-domains, in the order of its first appearance.  */
+struct jconfig_domain {
+  char *name;
+  unsigned int hash;
+
+  /* First and last entries of the domain, or -1.  */
+  int first;
+  int last;
+
+  /* Parent domain, first and last sub-domains and next sibling, or -1.  */
+  int parent;
+  int child;
+  int lastchild;
+  int sibling;
+};
+
+static struct jconfig_domain *jconfig_domains = NULL;
+static size_t jconfig_ndomains = 0;
+static size_t jconfig_domains_alloc = 0;
+
+/* Open addressing hash tables holding indexes plus one, 0 marking an
+   empty slot.  The first maps (domain, key) pairs to their first entry,
+   the second maps domain names to their record.  Their size is a power
+   of two kept above twice the number of elements.  */
+static unsigned int *jconfig_key_index = NULL;
+static size_t jconfig_key_size = 0;
+static unsigned int *jconfig_domain_index = NULL;
+static size_t jconfig_domain_size = 0;
+
+#define JCONFIG_HASH_INIT 2166136261u
+
+/* Strings of the configuration are interned in an arena of large blocks.
+   The blocks are never moved, so entries and callers can keep pointers
+   to the strings.  */
+struct jconfig_block {
+  struct jconfig_block *next;
+  size_t used;
+  size_t size;
+  char data[];
+};
+
+#define JCONFIG_BLOCK_SIZE 65536
+
+static struct jconfig_block *jconfig_arena = NULL;
+
+/* Open addressing hash table of the interned strings.  */
+static char **jconfig_strings = NULL;
+static size_t jconfig_nstrings = 0;
+static size_t jconfig_strings_size = 0;
+
+/* Number of changes made to the configuration.  */
+static unsigned int jconfig_changes = 0;
+
+/* Layout of the configuration in an image.  Strings are offsets in its
+   string table, which holds the blocks of the arena one after the
+   other.  The hash tables are stored as they are.  */
+struct jconfig_image {
+  uint64_t strings;
+  uint64_t entries;
+  uint64_t domains;
+  uint64_t key_index;
+  uint64_t domain_index;
+  uint32_t strings_len;
+  uint32_t count;
+  uint32_t ndomains;
+  uint32_t key_size;
+  uint32_t domain_size;
+  uint32_t unused;
+};
+
+struct jconfig_image_entry {
+  uint32_t domain_id;
+  uint32_t key;
+  uint32_t value;
+  int32_t line;
+  int32_t dnext;
+};
+
+struct jconfig_image_domain {
+  uint32_t name;
+  uint32_t hash;
+  int32_t first;
+  int32_t last;
+  int32_t parent;
+  int32_t child;
+  int32_t lastchild;
+  int32_t sibling;
+};
+
+/* Text of a configuration file being parsed.  */
+struct jconfig_scanner {
+  const char *pos;
+  const char *end;
+  int line;
+
+  /* Buffer where tokens holding backslash escapes are unescaped.  */
+  char *scratch;
+  size_t scratch_size;
+};
 
 /*
- *  Resets the pointer to point to the first entry in linked list
- *  containing the configuration parameters.
+ *  Case insensitive FNV-1a hash of `s', continuing from `hash'.
  */
-void
-jconfig_set(void)
+static unsigned int
+jconfig_hash (unsigned int hash, const char *s)
+{
+  for (; *s; s++)
+    {
+      hash ^= (unsigned char) tolower ((unsigned char) *s);
+      hash *= 16777619u;
+    }
+  return hash;
+}
+
+/*
+ *  Hash of the (domain, key) pair of an entry.
+ */
+static unsigned int
+jconfig_key_hash (unsigned int domain_hash, const char *key)
+{
+  return jconfig_hash (domain_hash * 16777619u, key);
+}
+
+/*
+ *  Case sensitive FNV-1a hash of the `len' bytes at `s'.
+ */
+static unsigned int
+jconfig_string_hash (const char *s, size_t len)
+{
+  unsigned int hash = JCONFIG_HASH_INIT;
+
+  while (len--)
+    {
+      hash ^= (unsigned char) *s++;
+      hash *= 16777619u;
+    }
+  return hash;
+}
+
+/*
+ *  Allocates `len' bytes in the string arena.
+ */
+static char *
+jconfig_arena_alloc (size_t len)
 {
-  jconfig_tmpptr = jconfig_ptr;
-  return;
+  struct jconfig_block *b = jconfig_arena;
+
+  if (b && b->size - b->used >= len)
+    {
+      b->used += len;
+      return b->data + b->used - len;
+    }
+
+  b = xmalloc (offsetof (struct jconfig_block, data)
+	       + (len > JCONFIG_BLOCK_SIZE ? len : JCONFIG_BLOCK_SIZE));
+  b->used = len;
+  b->size = len > JCONFIG_BLOCK_SIZE ? len : JCONFIG_BLOCK_SIZE;
+
+  /* A string too large for a fresh block gets a block of its own, which
+     leaves the room of the current block to the following strings.  */
+  if (jconfig_arena && len >= JCONFIG_BLOCK_SIZE)
+    {
+      b->next = jconfig_arena->next;
+      jconfig_arena->next = b;
+    }
+  else
+    {
+      b->next = jconfig_arena;
+      jconfig_arena = b;
+    }
+  return b->data;
 }
 
+/*
+ *  Returns a copy in the string arena of the `len' bytes at `s', shared
+ *  with the earlier copies of the same string.
+ */
+static char *
+jconfig_intern (const char *s, size_t len)
+{
+  char **old = jconfig_strings, *p;
+  size_t i, mask, oldsize = jconfig_strings_size;
+  unsigned int hash = jconfig_string_hash (s, len);
+
+  if (2 * (jconfig_nstrings + 1) > jconfig_strings_size)
+    {
+      jconfig_strings_size = oldsize ? 2 * oldsize : 1024;
+      jconfig_strings = xcalloc (jconfig_strings_size, sizeof (char *));
+      mask = jconfig_strings_size - 1;
+      for (size_t k = 0; k < oldsize; k++)
+	if (old[k])
+	  {
+	    i = jconfig_string_hash (old[k], strlen (old[k])) & mask;
+	    while (jconfig_strings[i])
+	      i = (i + 1) & mask;
+	    jconfig_strings[i] = old[k];
+	  }
+      free (old);
+    }
+
+  mask = jconfig_strings_size - 1;
+  for (i = hash & mask; (p = jconfig_strings[i]); i = (i + 1) & mask)
+    if (strncmp (p, s, len) == 0 && p[len] == '\0')
+      return p;
+
+  p = jconfig_arena_alloc (len + 1);
+  memcpy (p, s, len);
+  p[len] = '\0';
+  jconfig_strings[i] = p;
+  jconfig_nstrings++;
+  return p;
+}
+
+/*
+ *  Returns the index of domain `name' with hash `hash', or -1.
+ */
+static int
+jconfig_find_domain (const char *name, unsigned int hash)
+{
+  size_t i, mask = jconfig_domain_size - 1;
+  struct jconfig_domain *d;
+
+  if (!jconfig_domain_size)
+    return -1;
+
+  for (i = hash & mask; jconfig_domain_index[i]; i = (i + 1) & mask)
+    {
+      d = &jconfig_domains[jconfig_domain_index[i] - 1];
+      if (d->hash == hash && STRCASEEQ (d->name, name))
+	return jconfig_domain_index[i] - 1;
+    }
+  return -1;
+}
+
+/*
+ *  Inserts `value' with hash `hash' in the hash table `table' of size
+ *  `size', which must have a free slot.
+ */
+static void
+jconfig_index_insert (unsigned int *table, size_t size, unsigned int hash,
+		      unsigned int value)
+{
+  size_t i, mask = size - 1;
+
+  for (i = hash & mask; table[i]; i = (i + 1) & mask)
+    ;
+  table[i] = value;
+}
+
+/*
+ *  Makes room in a hash table for one more of `count' elements,
+ *  rehashing it with `hashof' if it grows.
+ */
+static void
+jconfig_index_grow (unsigned int **table, size_t *size, size_t count,
+		    unsigned int (*hashof) (unsigned int))
+{
+  unsigned int *old = *table;
+  size_t i, oldsize = *size;
+
+  if (2 * (count + 1) <= oldsize)
+    return;
+
+  *size = oldsize ? 2 * oldsize : 256;
+  *table = xcalloc (*size, sizeof (unsigned int));
+  for (i = 0; i < oldsize; i++)
+    if (old[i])
+      jconfig_index_insert (*table, *size, hashof (old[i] - 1), old[i]);
+  free (old);
+}
+
+static unsigned int
+jconfig_domain_hashof (unsigned int d)
+{
+  return jconfig_domains[d].hash;
+}
+
+static unsigned int
+jconfig_entry_hashof (unsigned int e)
+{
+  const struct jconfig *j = &jconfig_entries[e];
+  return jconfig_key_hash (jconfig_domains[j->domain_id].hash, j->key);
+}
+
+/*
+ *  Returns the index of domain `name', adding it as a sub-domain of the
+ *  domain of index `parent', or as a top-level domain if `parent' is -1,
+ *  if it isn't known yet.
+ */
+static int
+jconfig_add_domain (const char *name, int parent)
+{
+  struct jconfig_domain *d;
+  unsigned int hash = jconfig_hash (JCONFIG_HASH_INIT, name);
+  int id;
+
+  id = jconfig_find_domain (name, hash);
+  if (id >= 0)
+    return id;
+
+  if (jconfig_ndomains == jconfig_domains_alloc)
+    {
+      jconfig_domains_alloc = jconfig_domains_alloc
+	? 2 * jconfig_domains_alloc : 64;
+      jconfig_domains = xrealloc (jconfig_domains, jconfig_domains_alloc
+				  * sizeof (struct jconfig_domain));
+    }
+  jconfig_index_grow (&jconfig_domain_index, &jconfig_domain_size,
+		      jconfig_ndomains, jconfig_domain_hashof);
+
+  id = jconfig_ndomains++;
+  d = &jconfig_domains[id];
+  d->name = jconfig_intern (name, strlen (name));
+  d->hash = hash;
+  d->first = d->last = -1;
+  d->parent = parent;
+  d->child = d->lastchild = d->sibling = -1;
+  if (parent >= 0)
+    {
+      if (jconfig_domains[parent].lastchild >= 0)
+	jconfig_domains[jconfig_domains[parent].lastchild].sibling = id;
+      else
+	jconfig_domains[parent].child = id;
+      jconfig_domains[parent].lastchild = id;
+    }
+  jconfig_index_insert (jconfig_domain_index, jconfig_domain_size, hash,
+			id + 1);
+  return id;
+}
+
+/*
+ *  Resets the cursor `cur' so that it starts a new iteration over the
+ *  configuration.
+ */
 void
-jconfig_end(void)
+jconfig_set(struct jconfig_cursor *cur)
 {
-  return;
+  cur->started = false;
+  cur->pos = -1;
 }
 
 /*
@@ -53,47 +384,68 @@ jconfig_end(void)
 struct jconfig *
 jconfig_getone(const char *domain, const char *key)
 {
-  struct jconfig *ptr;
+  unsigned int hash, dhash;
+  size_t i, mask = jconfig_key_size - 1;
+  struct jconfig *j;
 
-  if (!jconfig_ptr)
+  if (!jconfig_count)
     return NULL;
-  
-
-  ptr = jconfig_ptr;
 
-  while (ptr)
+  dhash = jconfig_hash (JCONFIG_HASH_INIT, domain);
+  hash = jconfig_key_hash (dhash, key);
+  for (i = hash & mask; jconfig_key_index[i]; i = (i + 1) & mask)
     {
-      if (STRCASEEQ (ptr->domain, domain) && STRCASEEQ (ptr->key, key))
-	return ptr;
-      ptr = ptr->next;
+      j = &jconfig_entries[jconfig_key_index[i] - 1];
+      if (jconfig_domains[j->domain_id].hash == dhash
+	  && STRCASEEQ (j->key, key) && STRCASEEQ (j->domain, domain))
+	return j;
     }
 
   return NULL;
 }
 
 /*
- *  Returns a pointer to the next entry in the configuration file which
- *  matches the specified domain.
+ *  Returns the index of the entry `j' in the configuration.
+ */
+int
+jconfig_index(const struct jconfig *j)
+{
+  return j - jconfig_entries;
+}
+
+/*
+ *  Returns the entry of index `i' in the configuration, or NULL.
  */
 struct jconfig *
-jconfig_next(const char *domain)
+jconfig_entry(int i)
 {
-  struct jconfig *ptr;
-  
-  if (!jconfig_tmpptr)
+  if (i < 0 || (size_t) i >= jconfig_count)
     return NULL;
-  
-  while (jconfig_tmpptr)
+  return &jconfig_entries[i];
+}
+
+/*
+ *  Returns a pointer to the next entry in the configuration file which
+ *  matches the specified domain, advancing the cursor `cur'.
+ */
+struct jconfig *
+jconfig_next(struct jconfig_cursor *cur, const char *domain)
+{
+  int id;
+
+  if (!cur->started)
     {
-      if (STRCASEEQ (jconfig_tmpptr->domain, domain))
-	{
-	  ptr = jconfig_tmpptr;
-	  jconfig_tmpptr = jconfig_tmpptr->next;
-	  return ptr;
-	}
-      jconfig_tmpptr = jconfig_tmpptr->next;
+      cur->started = true;
+      id = jconfig_find_domain (domain, jconfig_hash (JCONFIG_HASH_INIT,
+						      domain));
+      cur->pos = id >= 0 ? jconfig_domains[id].first : -1;
     }
-  return NULL;
+  if (cur->pos < 0)
+    return NULL;
+
+  id = cur->pos;
+  cur->pos = jconfig_entries[id].dnext;
+  return &jconfig_entries[id];
 }
 
 /*
@@ -102,26 +454,135 @@ jconfig_next(const char *domain)
  *  it returns matches also for substrings of domain.
  */
 struct jconfig *
-jconfig_next_all(const char *domain)
+jconfig_next_all(struct jconfig_cursor *cur, const char *domain)
 {
-  struct jconfig *ptr;
-  
-  if (!jconfig_tmpptr)
+  size_t len = strlen (domain);
+
+  if (!cur->started)
+    {
+      cur->started = true;
+      cur->pos = 0;
+    }
+  if (cur->pos < 0)
     return NULL;
-    
-  while (jconfig_tmpptr)
+
+  while ((size_t) cur->pos < jconfig_count)
     {
-      if (STRNCASEEQ (jconfig_tmpptr->domain, domain, strlen (domain)))
-	{
-	  ptr = jconfig_tmpptr;
-	  jconfig_tmpptr = jconfig_tmpptr->next;
-	  return ptr;
-	}
-      jconfig_tmpptr = jconfig_tmpptr->next;
+      struct jconfig *j = &jconfig_entries[cur->pos++];
+      if (STRNCASEEQ (j->domain, domain, len))
+	return j;
     }
+  cur->pos = -1;
   return NULL;
 }
 
+/*
+ *  Returns the name of the next sub-domain of the specified domain, in
+ *  the order they appear in the configuration file.
+ */
+const char *
+jconfig_next_child(struct jconfig_cursor *cur, const char *domain)
+{
+  int id;
+
+  if (!cur->started)
+    {
+      cur->started = true;
+      id = jconfig_find_domain (domain, jconfig_hash (JCONFIG_HASH_INIT,
+						      domain));
+      cur->pos = id >= 0 ? jconfig_domains[id].child : -1;
+    }
+  if (cur->pos < 0)
+    return NULL;
+
+  id = cur->pos;
+  cur->pos = jconfig_domains[id].sibling;
+  return jconfig_domains[id].name;
+}
+
+/*
+ *  Adds the entry of an interned key and value to the domain of index
+ *  `id'.
+ */
+static void
+jconfig_add_entry (int id, char *key, char *value, int line)
+{
+  struct jconfig *ptr;
+  struct jconfig_domain *d;
+  unsigned int *slot, hash;
+  size_t i, mask;
+
+  if (jconfig_count == jconfig_alloc)
+    {
+      jconfig_alloc = jconfig_alloc ? 2 * jconfig_alloc : 256;
+      jconfig_entries = xrealloc (jconfig_entries,
+				  jconfig_alloc * sizeof (struct jconfig));
+    }
+  jconfig_index_grow (&jconfig_key_index, &jconfig_key_size, jconfig_count,
+		      jconfig_entry_hashof);
+
+  d = &jconfig_domains[id];
+  ptr = &jconfig_entries[jconfig_count];
+  ptr->domain = d->name;
+  ptr->key = key;
+  ptr->value = value;
+  ptr->line = line;
+  ptr->domain_id = id;
+  ptr->dnext = -1;
+
+  if (d->last >= 0)
+    jconfig_entries[d->last].dnext = jconfig_count;
+  else
+    d->first = jconfig_count;
+  d->last = jconfig_count;
+
+  /* Only the first entry of a (domain, key) pair is indexed, since it is
+     the one jconfig_getone returns.  */
+  hash = jconfig_key_hash (d->hash, key);
+  mask = jconfig_key_size - 1;
+  for (i = hash & mask; *(slot = &jconfig_key_index[i]); i = (i + 1) & mask)
+    if (jconfig_entries[*slot - 1].domain_id == id
+	&& STRCASEEQ (jconfig_entries[*slot - 1].key, key))
+      break;
+  if (!*slot)
+    *slot = jconfig_count + 1;
+  jconfig_count++;
+  jconfig_changes++;
+}
+
+/*
+ *  Returns the index of domain `name', adding it and its parents if they
+ *  aren't known yet. The parent of a domain is the part of its name
+ *  before its last '|' which isn't escaped by a backslash, since a '|'
+ *  may be part of the regular expression naming a block.
+ */
+static int
+jconfig_add_path (const char *name)
+{
+  const char *p, *bar = NULL;
+  char *parent_name;
+  int id, parent = -1;
+
+  id = jconfig_find_domain (name, jconfig_hash (JCONFIG_HASH_INIT, name));
+  if (id >= 0)
+    return id;
+
+  for (p = name; *p; p++)
+    if (*p == '\\' && p[1])
+      p++;
+    else if (*p == '|')
+      bar = p;
+  if (bar)
+    {
+      parent_name = xmalloc (bar - name + 1);
+      memcpy (parent_name, name, bar - name);
+      parent_name[bar - name] = '\0';
+      parent = jconfig_add_path (parent_name);
+      free (parent_name);
+    }
+  return jconfig_add_domain (name, parent);
+}
+
 /*
  *  Adds a key/value pair to the specified domain. line can be used to
  *  pass information to the application on where in the configuration file
@@ -130,274 +591,490 @@ jconfig_next_all(const char *domain)
 int
 jconfig_add(const char *domain, const char *key, const char *value, int line)
 {
-  struct jconfig *ptr;
+  jconfig_add_entry (jconfig_add_path (domain),
+		     jconfig_intern (key, strlen (key)),
+		     jconfig_intern (value, strlen (value)), line);
+  return 1;
+}
+
+/*
+ *  Frees all allocated memory.
+ */
+void
+jconfig_free(void)
+{
+  struct jconfig_block *b;
 
-  /*
-  char *tmps;
-  while (isspace(*value)) value++;
-  while (isspace(*domain)) domain++;
-  while (isspace(*key)) key++;
-  tmps = value+strlen(value)-1; while (isspace(*tmps)) { *tmps = 0; tmps--; }
-  tmps = domain+strlen(domain)-1; while (isspace(*tmps)) { *tmps = 0; tmps--; }
-  tmps = key+strlen(key)-1; while (isspace(*tmps)) { *tmps = 0; tmps--; }
-  */
-
-  ptr = malloc(sizeof(struct jconfig));
-  if (!ptr)
-    return 0;
-    
-  ptr->key = malloc(strlen(key)+1);
-  if (!ptr->key)
+  while ((b = jconfig_arena) != NULL)
     {
-      free(ptr);
-      return 0;
+      jconfig_arena = b->next;
+      free (b);
     }
-  ptr->value = malloc(strlen(value)+1);
-  if (!ptr->value)
+  free (jconfig_strings);
+  free (jconfig_entries);
+  free (jconfig_domains);
+  free (jconfig_key_index);
+  free (jconfig_domain_index);
+
+  jconfig_strings = NULL;
+  jconfig_nstrings = jconfig_strings_size = 0;
+  jconfig_entries = NULL;
+  jconfig_domains = NULL;
+  jconfig_key_index = jconfig_domain_index = NULL;
+  jconfig_count = jconfig_alloc = 0;
+  jconfig_ndomains = jconfig_domains_alloc = 0;
+  jconfig_key_size = jconfig_domain_size = 0;
+  jconfig_changes++;
+}
+
+/*
+ *  Returns a number which changes whenever the configuration does.
+ */
+unsigned int
+jconfig_generation(void)
+{
+  return jconfig_changes;
+}
+
+/*
+ *  Returns the offset of the interned string `str' in the string table
+ *  of an image.
+ */
+static uint32_t
+jconfig_string_offset (const char *str)
+{
+  struct jconfig_block *b;
+  size_t offset = 0;
+
+  for (b = jconfig_arena; b; b = b->next)
+    {
+      if (str >= b->data && str < b->data + b->used)
+	return offset + (str - b->data);
+      offset += b->used;
+    }
+  abort ();
+}
+
+uint64_t
+jconfig_image_save(struct image_writer *w)
+{
+  struct jconfig_image ji;
+  struct jconfig_image_entry *e;
+  struct jconfig_image_domain *d;
+  struct jconfig_block *b;
+  char *strings;
+  size_t i, len = 0;
+
+  memset (&ji, 0, sizeof ji);
+
+  /* A final empty string makes sure that the table is not empty and that
+     it ends with a null character.  */
+  for (b = jconfig_arena; b; b = b->next)
+    len += b->used;
+  strings = xmalloc (len + 1);
+  for (len = 0, b = jconfig_arena; b; b = b->next)
     {
-      free(ptr->key);
-      free(ptr);
-      return 0;
+      memcpy (strings + len, b->data, b->used);
+      len += b->used;
     }
-  ptr->domain = malloc(strlen(domain)+1);
-  if (!ptr->domain)
+  strings[len++] = '\0';
+  ji.strings = image_put (w, strings, len);
+  ji.strings_len = len;
+  free (strings);
+
+  e = xcalloc (jconfig_count + 1, sizeof *e);
+  for (i = 0; i < jconfig_count; i++)
     {
-      free(ptr->key);
-      free(ptr->value);
-      free(ptr);
-      return 0;
+      e[i].domain_id = jconfig_entries[i].domain_id;
+      e[i].key = jconfig_string_offset (jconfig_entries[i].key);
+      e[i].value = jconfig_string_offset (jconfig_entries[i].value);
+      e[i].line = jconfig_entries[i].line;
+      e[i].dnext = jconfig_entries[i].dnext;
     }
-  strncpy(ptr->key, key, strlen(key)+1);
-  strncpy(ptr->value, value, strlen(value)+1);
-  strncpy(ptr->domain, domain, strlen(domain)+1);
-  ptr->line = line;
-  ptr->next = NULL;
+  ji.entries = image_put (w, e, jconfig_count * sizeof *e);
+  ji.count = jconfig_count;
+  free (e);
 
-  if (jconfig_addptr)
+  d = xcalloc (jconfig_ndomains + 1, sizeof *d);
+  for (i = 0; i < jconfig_ndomains; i++)
     {
-      jconfig_addptr->next = ptr;
-      jconfig_addptr = ptr;
+      d[i].name = jconfig_string_offset (jconfig_domains[i].name);
+      d[i].hash = jconfig_domains[i].hash;
+      d[i].first = jconfig_domains[i].first;
+      d[i].last = jconfig_domains[i].last;
+      d[i].parent = jconfig_domains[i].parent;
+      d[i].child = jconfig_domains[i].child;
+      d[i].lastchild = jconfig_domains[i].lastchild;
+      d[i].sibling = jconfig_domains[i].sibling;
     }
-  else
-    jconfig_addptr = jconfig_ptr = ptr;
+  ji.domains = image_put (w, d, jconfig_ndomains * sizeof *d);
+  ji.ndomains = jconfig_ndomains;
+  free (d);
 
-  /* This suddenly stopped working. Somehow adding things changed
-     direction. Huh? We should find away to match things according
-     to the longest match, not according to in which order things
-     occur in the configuration file. */
-  /*  ptr->next = jconfig_ptr;
-      jconfig_ptr = ptr; */
+  ji.key_index = image_put (w, jconfig_key_index,
+			    jconfig_key_size * sizeof (unsigned int));
+  ji.key_size = jconfig_key_size;
+  ji.domain_index = image_put (w, jconfig_domain_index,
+			       jconfig_domain_size * sizeof (unsigned int));
+  ji.domain_size = jconfig_domain_size;
 
-  return 1;
+  return image_put (w, &ji, sizeof ji);
 }
 
 /*
- *  Frees all allocated memory.
+ *  Checks that the hash table `table' of size `size' holds indexes plus
+ *  one below `count' and keeps a free slot.
  */
-void
-jconfig_free(void)
+static bool
+jconfig_image_table_valid (const unsigned int *table, size_t size,
+			   size_t count)
 {
-  struct jconfig *ptr;
-  
-  while (jconfig_ptr) {
-    free(jconfig_ptr->value);
-    free(jconfig_ptr->key);
-    ptr = jconfig_ptr;
-    jconfig_ptr = jconfig_ptr->next;
-    free(ptr);
-  }
+  size_t i, used = 0;
+
+  if (size & (size - 1))
+    return false;
+  for (i = 0; i < size; i++)
+    if (table[i] && (table[i] > count || ++used == size))
+      return false;
+  return size > 0 || count == 0;
 }
 
 /*
- *  "Safely" concatenates a string. Reallocating the string to hold the
- *  necessary space.
+ *  Checks that `i' is -1 or an index below `count'.
  */
-char *
-jconfig_safe_strcat(char *s1, const char *s2)
+static bool
+jconfig_image_index_valid (int32_t i, size_t count)
 {
-  char *s3;
+  return i >= -1 && i < (int64_t) count;
+}
 
-  if (!s1 || !s2)
-    return NULL;
+int
+jconfig_image_load(const struct image *img, uint64_t offset)
+{
+  const struct jconfig_image *ji;
+  const struct jconfig_image_entry *e;
+  const struct jconfig_image_domain *d;
+  const unsigned int *key_index, *domain_index;
+  const char *strings;
+  size_t i;
+
+  ji = image_get (img, offset, 1, sizeof *ji);
+  if (!ji)
+    return -1;
+  strings = image_get (img, ji->strings, ji->strings_len, 1);
+  e = image_get (img, ji->entries, ji->count, sizeof *e);
+  d = image_get (img, ji->domains, ji->ndomains, sizeof *d);
+  key_index = image_get (img, ji->key_index, ji->key_size,
+			 sizeof (unsigned int));
+  domain_index = image_get (img, ji->domain_index, ji->domain_size,
+			    sizeof (unsigned int));
+  if (!strings || !ji->strings_len || strings[ji->strings_len - 1]
+      || !e || !d || !key_index || !domain_index
+      || !jconfig_image_table_valid (key_index, ji->key_size, ji->count)
+      || !jconfig_image_table_valid (domain_index, ji->domain_size,
+				     ji->ndomains))
+    return -1;
+
+  for (i = 0; i < ji->count; i++)
+    if (e[i].domain_id >= ji->ndomains || e[i].key >= ji->strings_len
+	|| e[i].value >= ji->strings_len
+	|| !jconfig_image_index_valid (e[i].dnext, ji->count))
+      return -1;
+  for (i = 0; i < ji->ndomains; i++)
+    if (d[i].name >= ji->strings_len
+	|| !jconfig_image_index_valid (d[i].first, ji->count)
+	|| !jconfig_image_index_valid (d[i].last, ji->count)
+	|| !jconfig_image_index_valid (d[i].parent, ji->ndomains)
+	|| !jconfig_image_index_valid (d[i].child, ji->ndomains)
+	|| !jconfig_image_index_valid (d[i].lastchild, ji->ndomains)
+	|| !jconfig_image_index_valid (d[i].sibling, ji->ndomains))
+      return -1;
 
-  s3 = xrealloc (s1, strlen (s1) + strlen (s2) + 1);
-  strncat(s3, s2, strlen(s2)+1);
-  return s3;
+  jconfig_free ();
+
+  /* The strings are used in place, the tables are copied since adding
+     entries modifies them.  */
+  jconfig_count = jconfig_alloc = ji->count;
+  jconfig_entries = xcalloc (jconfig_alloc + 1, sizeof (struct jconfig));
+  jconfig_ndomains = jconfig_domains_alloc = ji->ndomains;
+  jconfig_domains = xcalloc (jconfig_domains_alloc + 1,
+			     sizeof (struct jconfig_domain));
+
+  for (i = 0; i < jconfig_ndomains; i++)
+    {
+      jconfig_domains[i].name = (char *) strings + d[i].name;
+      jconfig_domains[i].hash = d[i].hash;
+      jconfig_domains[i].first = d[i].first;
+      jconfig_domains[i].last = d[i].last;
+      jconfig_domains[i].parent = d[i].parent;
+      jconfig_domains[i].child = d[i].child;
+      jconfig_domains[i].lastchild = d[i].lastchild;
+      jconfig_domains[i].sibling = d[i].sibling;
+    }
+  for (i = 0; i < jconfig_count; i++)
+    {
+      jconfig_entries[i].domain = jconfig_domains[e[i].domain_id].name;
+      jconfig_entries[i].key = (char *) strings + e[i].key;
+      jconfig_entries[i].value = (char *) strings + e[i].value;
+      jconfig_entries[i].line = e[i].line;
+      jconfig_entries[i].domain_id = e[i].domain_id;
+      jconfig_entries[i].dnext = e[i].dnext;
+    }
+
+  jconfig_key_size = ji->key_size;
+  jconfig_key_index = xcalloc (jconfig_key_size + 1, sizeof (unsigned int));
+  memcpy (jconfig_key_index, key_index,
+	  jconfig_key_size * sizeof (unsigned int));
+  jconfig_domain_size = ji->domain_size;
+  jconfig_domain_index = xcalloc (jconfig_domain_size + 1,
+				  sizeof (unsigned int));
+  memcpy (jconfig_domain_index, domain_index,
+	  jconfig_domain_size * sizeof (unsigned int));
+
+  return 0;
 }
 
 /*
- *  Allocates memory for and returns a pointer to a quoted line gotten
- *  from `in'.
+ *  Reads the whole of `in', mapping it in memory when it is a regular
+ *  file.  Sets *mapped when the text is to be released with munmap
+ *  rather than free.
  */
-char *
-jconfig_get_quoted(FILE *in, int *line)
+static char *
+jconfig_read_file (FILE *in, size_t *len, bool *mapped)
 {
-  int ch, nextch, len = 0;
-  char *s1 = xmalloc (MAXBUFSIZE);
+  char *text = NULL;
+  size_t n, size = 0;
+
+  *len = 0;
+  *mapped = false;
 
-  while (!feof(in))
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H
+  struct stat st;
+
+  if (fstat (fileno (in), &st) == 0 && S_ISREG (st.st_mode)
+      && st.st_size > 0)
     {
-      if (len >= (MAXBUFSIZE-1))
+      text = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno (in), 0);
+      if (text != MAP_FAILED)
 	{
-          printf ("[%s: %s %d]\n", arguments->config,
-                  _("String out of bounds on line"), *line);
-	  exit (EXIT_FAILURE);
+	  *len = st.st_size;
+	  *mapped = true;
+	  return text;
 	}
+      text = NULL;
+    }
+#endif
 
-      ch = fgetc(in);
-      switch (ch)
+  do
+    {
+      if (*len == size)
 	{
-	case '\\':
-	  if (!feof(in))
-	    nextch = fgetc(in);
-	  else
-	    nextch = '\\';
-	  s1[len++] = nextch;
-	  break;
-	case '"':
-	  s1[len] = '\0';
-	  return s1;
-	case '\n':
-	  s1[len++] = ch;
-	  (*line) ++;
-	  break;
-	default:
-	  s1[len++] = ch;
+	  size = size ? 2 * size : 65536;
+	  text = xrealloc (text, size);
 	}
+      n = fread (text + *len, 1, size - *len, in);
+      *len += n;
     }
-  printf ("[%s: %s %d]\n", arguments->config,
-          _("End of file looking for '\"' on line"), *line);
-  exit (EXIT_FAILURE);
+  while (n > 0);
+
+  return text;
 }
 
 /*
- *  Allocates memory for and returns a pointer to a unquoted line gotten
- *  from `in'.
+ *  Scans a token starting at the position of `sc' and returns it
+ *  interned.  A quoted token ends with a '"', which is skipped; an
+ *  unquoted one ends before a ';', a space or a tab.  Backslash escapes
+ *  the next character.
  */
-char *
-jconfig_get_unquoted(FILE *in, int *line)
+static char *
+jconfig_scan_token (struct jconfig_scanner *sc, bool quoted)
 {
-  int ch, nextch, len = 0;
-  char *s1 = xmalloc (MAXBUFSIZE);
-  
-  while (!feof(in))
+  const char *p, *start = sc->pos;
+  bool escapes = false;
+  size_t len;
+
+  for (p = start; p < sc->end; p++)
     {
-      if (len >= (MAXBUFSIZE-1))
+      if (*p == '\\')
 	{
-          printf ("[%s: %s %d]\n", arguments->config,
-                  _("String out of bounds on line"), *line);
-	  exit (EXIT_FAILURE);
+	  escapes = true;
+	  if (++p == sc->end)
+	    break;
 	}
+      else if (quoted ? *p == '"' : (*p == ';' || *p == ' ' || *p == '\t'))
+	break;
 
-      ch = fgetc(in);
-      switch (ch)
-	{
-	case '\\':
-	  if (!feof(in))
-	    nextch = fgetc(in);
-	  else
-	    nextch = '\\';
-	  s1[len++] = nextch;
-	  break;
-	case ';':
-	case ' ':
-	case '\t':
-	  s1[len] = '\0';
-	  ungetc(ch, in);
-	  return s1;
-	case '\n':
-	  s1[len++] = ch;
-	  (*line) ++;
-	  break;
-	default:
-	  s1[len++] = ch;
-	}
+      if (*p == '\n')
+	sc->line++;
     }
-  printf ("[%s: %s %d]\n", arguments->config,
-          _("Unexpected end of file on line"), *line);
-  exit (EXIT_FAILURE);
+
+  if (p >= sc->end)
+    {
+      if (quoted)
+	printf ("[%s: %s %d]\n", arguments->config,
+		_("End of file looking for '\"' on line"), sc->line);
+      else
+	printf ("[%s: %s %d]\n", arguments->config,
+		_("Unexpected end of file on line"), sc->line);
+      exit (EXIT_FAILURE);
+    }
+
+  sc->pos = quoted ? p + 1 : p;
+  if (!escapes)
+    return jconfig_intern (start, p - start);
+
+  if (sc->scratch_size < (size_t) (p - start))
+    {
+      sc->scratch_size = p - start;
+      sc->scratch = xrealloc (sc->scratch, sc->scratch_size);
+    }
+  for (len = 0; start < p; start++)
+    {
+      if (*start == '\\')
+	start++;
+      sc->scratch[len++] = *start;
+    }
+  return jconfig_intern (sc->scratch, len);
+}
+
+/*
+ *  Returns the index of the domain of the blocks open while parsing,
+ *  whose names end at the offsets `ends' of `domain', adding it and its
+ *  parents if they aren't known yet. Their indexes are kept in `ids',
+ *  where -1 stands for a domain not looked up yet.
+ */
+static int
+jconfig_parse_domain (char *domain, const size_t *ends, int *ids,
+		      size_t depth)
+{
+  size_t i;
+  char ch;
+
+  for (i = 0; i <= depth; i++)
+    if (ids[i] < 0)
+      {
+	ch = domain[ends[i]];
+	domain[ends[i]] = '\0';
+	ids[i] = jconfig_add_domain (domain, i > 0 ? ids[i - 1] : -1);
+	domain[ends[i]] = ch;
+      }
+  return ids[depth];
 }
 
 /*
  *  Parses a configuration file and adds found information to the
- *  config structure using jconfig_add.
+ *  config structure.
  */
 void
 jconfig_parse_file(FILE *in)
 {
-  int ch, line = 1, nextch;
-  char *token = NULL, *key = NULL;
-  char /* *t1, */ *t2;
+  struct jconfig_scanner sc;
+  char *text, *domain, *token = NULL, *key = NULL;
+  size_t len, toklen, domain_len, domain_size;
+  size_t *ends, depth = 0, depth_size = 8;
+  bool mapped;
+  int ch, *ids;
+
+  text = jconfig_read_file (in, &len, &mapped);
+  sc.pos = text;
+  sc.end = text + len;
+  sc.line = 1;
+  sc.scratch = NULL;
+  sc.scratch_size = 0;
+
+  domain_len = strlen (PACKAGE);
+  domain_size = 256;
+  domain = xmalloc (domain_size);
+  memcpy (domain, PACKAGE, domain_len + 1);
 
-  char *domain = xmalloc (MAXBUFSIZE);
-  strncpy(domain, PACKAGE, strlen(PACKAGE)+1);
+  /* The blocks open, each ending where its parent starts a sub-block,
+     since the name of a block may contain '|'.  */
+  ends = xmalloc (depth_size * sizeof *ends);
+  ids = xmalloc (depth_size * sizeof *ids);
+  ends[0] = domain_len;
+  ids[0] = -1;
 
-  while (!feof(in))
+  while (sc.pos < sc.end)
     {
-      ch = fgetc(in);
+      ch = (unsigned char) *sc.pos++;
       if (ch == '\n')
-	line++;
-      if (!isspace(ch) && (ch != EOF))
-	switch (ch)
-	  {
-	  case '#':
-	    while ((fgetc(in) != '\n') && (!feof(in)));
-	    line++;
-	    break;
-	  case '{':
-	    domain = jconfig_safe_strcat(domain, "|");
-	    domain = jconfig_safe_strcat(domain, token);
-	    break;
-	  case '}':
-	    /*	    t1 = (char *)strstr(domain, "\\.");
-	    if (t1)
-	      {
-		t1 -= 2;
-		*t1 = '\0';
-		t2 = (char *)strrchr(domain, '.');
-	      }
-	      else */
-	    t2 = (char *)strrchr(domain, '|');
-
-	    if (t2)
-	      *t2 = '\0';
-	    if (!feof(in))
-	      {
-		nextch = fgetc(in);
-		if (nextch != ';')
-		  ungetc(nextch, in);
-	      }
-	    break;
-	  case '"':
-	    free(token);
-	    token = jconfig_get_quoted(in, &line);
-	    break;
-	  case '=':
-            if (key)
-              printf ("[%s: %s %d]\n", arguments->config,
-                      _("Multiple keys on line"), line);
-	    key = xmalloc (strlen (token) + 1);
-	    strcpy(key,token);
-	    break;
-	  case ';':
-	    if (!key)
-	      {
-                printf ("[%s: %s %d]\n", arguments->config,
-                        _("Missing key on line"), line);
-		exit (EXIT_FAILURE);
-	      }
-	    jconfig_add(domain, key, token, line);
-	    free(key);
-	    key = NULL;
-	    break;
-	  default:
-	    ungetc(ch, in);
-	    free(token);
-	    token = jconfig_get_unquoted(in, &line);
-	    break;
-	  }
+	sc.line++;
+      if (isspace (ch))
+	continue;
+
+      switch (ch)
+	{
+	case '#':
+	  sc.pos = memchr (sc.pos, '\n', sc.end - sc.pos);
+	  sc.pos = sc.pos ? sc.pos + 1 : sc.end;
+	  sc.line++;
+	  break;
+	case '{':
+	  toklen = token ? strlen (token) : 0;
+	  if (domain_len + toklen + 2 > domain_size)
+	    {
+	      domain_size = 2 * (domain_len + toklen + 2);
+	      domain = xrealloc (domain, domain_size);
+	    }
+	  domain[domain_len++] = '|';
+	  memcpy (domain + domain_len, token ? token : "", toklen + 1);
+	  domain_len += toklen;
+	  if (++depth == depth_size)
+	    {
+	      depth_size *= 2;
+	      ends = xrealloc (ends, depth_size * sizeof *ends);
+	      ids = xrealloc (ids, depth_size * sizeof *ids);
+	    }
+	  ends[depth] = domain_len;
+	  ids[depth] = -1;
+	  break;
+	case '}':
+	  if (depth > 0)
+	    {
+	      depth--;
+	      domain_len = ends[depth];
+	      domain[domain_len] = '\0';
+	    }
+	  if (sc.pos < sc.end && *sc.pos == ';')
+	    sc.pos++;
+	  break;
+	case '"':
+	  token = jconfig_scan_token (&sc, true);
+	  break;
+	case '=':
+	  if (key)
+	    printf ("[%s: %s %d]\n", arguments->config,
+		    _("Multiple keys on line"), sc.line);
+	  key = token;
+	  break;
+	case ';':
+	  if (!key)
+	    {
+	      printf ("[%s: %s %d]\n", arguments->config,
+		      _("Missing key on line"), sc.line);
+	      exit (EXIT_FAILURE);
+	    }
+	  if (!token)
+	    token = jconfig_intern ("", 0);
+	  jconfig_add_entry (jconfig_parse_domain (domain, ends, ids, depth),
+			     key, token, sc.line);
+	  key = NULL;
+	  break;
+	default:
+	  sc.pos--;
+	  token = jconfig_scan_token (&sc, false);
+	  break;
+	}
     }
-  free(token);
-  free(key);
-  free(domain);
+
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H
+  if (mapped)
+    munmap (text, len);
+  else
+#endif
+    free (text);
+  free (sc.scratch);
+  free (domain);
+  free (ends);
+  free (ids);
 }
@@ -19,22 +19,51 @@
 #ifndef JCONFIG_H
 #define JCONFIG_H
 
+#include "image.h"
+
 struct jconfig {
 	char	*domain;
 	char	*key;
 	char	*value;
 	int	line;
-	struct jconfig	*next;
+
+	/* Index of the domain, and of the next entry of the same domain
+	   or -1.  */
+	int	domain_id;
+	int	dnext;
+};
+
+/* Position of an iteration over the configuration.  Each iteration uses
+   its own cursor, reset with jconfig_set, so that iterations can be
+   nested or run concurrently.  */
+struct jconfig_cursor {
+	bool	started;
+	int	pos;
 };
 
-void jconfig_set(void);
-struct jconfig *jconfig_next(const char *);
-struct jconfig *jconfig_next_all(const char *);
-void jconfig_end(void);
+void jconfig_set(struct jconfig_cursor *);
+struct jconfig *jconfig_next(struct jconfig_cursor *, const char *);
+struct jconfig *jconfig_next_all(struct jconfig_cursor *, const char *);
+const char *jconfig_next_child(struct jconfig_cursor *, const char *);
 struct jconfig *jconfig_getone(const char *, const char *);
+int jconfig_index(const struct jconfig *);
+struct jconfig *jconfig_entry(int);
 
 int jconfig_add(const char *, const char *, const char *, int);
 void jconfig_free(void);
 void jconfig_parse_file(FILE *);
 
+/* Return a number which changes whenever the configuration does, so that
+   what is built from it can be told to be out of date.  */
+unsigned int jconfig_generation(void);
+
+/* Store the configuration in an image, and return its offset.  This is
+   only possible for a configuration parsed from text.  */
+uint64_t jconfig_image_save(struct image_writer *);
+
+/* Replace the configuration by the one at the offset of an image, which
+   must stay mapped as long as the configuration is used.  Returns 0 on
+   success, or -1 if the image is invalid.  */
+int jconfig_image_load(const struct image *, uint64_t);
+
 #endif
@@ -38,22 +38,48 @@
 #include <regex.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include "batch.h"
+#include "buffer.h"
 #include "cache.h"
+#include "engine.h"
 #include "http.h"
+#include "image.h"
 #include "init.h"
 #include "jconfig.h"
 #include "lookup.h"
 #include "rwhois.h"
+#include "serve.h"
 #include "utils.h"
 #include "whois.h"
 
 /* Forward declarations.  */
-static int jwhois_query (whois_query_t wq, char **text);
+struct jwhois_job;
+static int jwhois_query (whois_query_t wq, struct buffer *text);
+static int jwhois_lookup (const char *query);
+static int jwhois_single (const char *query);
+static int jwhois_batch (const char *name);
+static int jwhois_serve (void);
+static void jwhois_print (struct buffer *out, const char *text, size_t len);
+static int jwhois_start (struct engine *e, const char *query,
+                         struct buffer *out, batch_done_t done,
+                         batch_spawn_t spawn, void *data);
+static void jwhois_child (void);
+static void jwhois_hop_done (struct engine_query *q);
+static bool jwhois_hop_lines (struct engine_query *q, const char *text,
+                              size_t len);
 static error_t parse_opt (int key, char *arg, struct argp_state *state);
 
 /* Keys for options without short-options.  */
 enum
-{ OPT_DISPLAY = CHAR_MAX + 1, OPT_LIMIT };
+{ OPT_DISPLAY = CHAR_MAX + 1, OPT_LIMIT, OPT_COMPILE_CONFIG, OPT_BATCH, OPT_JOBS,
+  OPT_LISTEN, OPT_LISTEN_PORT };
+
+/* Number of queries of local clients made at once unless --jobs is
+   given.  */
+#define JWHOIS_SERVE_JOBS 64
+
+/* Set if --jobs is given.  */
+static bool jobs_given;
 
 /* Static variables for argp. */
 static struct argp_option options[] = {
@@ -79,6 +105,19 @@ static struct argp_option options[] = {
    N_("sets the display option in rwhois queries")},
   {"rwhois-limit", OPT_LIMIT, N_("LIMIT"), 0,
    N_("sets the maximum number of matches to return")},
+  {"compile-config", OPT_COMPILE_CONFIG, 0, 0,
+   N_("write an image of the configuration file, loaded instead of the"
+      " file by later runs until the file is modified")},
+  {"batch", OPT_BATCH, N_("FILE"), 0,
+   N_("query each line of FILE, or of the standard input if FILE is -")},
+  {"jobs", OPT_JOBS, N_("N"), 0,
+   N_("make up to N queries at once with --batch or --listen")},
+  {"listen", OPT_LISTEN, N_("SOCKET"), 0,
+   N_("answer the whois queries of local clients on the Unix domain"
+      " socket SOCKET")},
+  {"listen-port", OPT_LISTEN_PORT, N_("PORT"), 0,
+   N_("answer the whois queries of local clients on PORT of the loopback"
+      " address")},
 #ifndef NOCACHE
   {"force-lookup", 'f', 0, 0,
    N_("force lookup even if the entry is cached")},
@@ -91,10 +130,16 @@ static struct argp_option options[] = {
 static struct argp argp = {
   .options = options,
   .parser = parse_opt,
-  .args_doc = N_("QUERY"),
+  .args_doc = N_("QUERY\n--batch=FILE\n--listen=SOCKET"),
   .doc = N_("Request information about QUERY.")
 };
 
+static const struct batch_ops batch_ops = {
+  .lookup = jwhois_lookup,
+  .child = jwhois_child,
+  .start = jwhois_start
+};
+
 static const char *authors[] = { "the JWhois authors", NULL };
 
 const char *argp_program_bug_address = PACKAGE_BUGREPORT;
@@ -103,8 +148,6 @@ int
 main (int argc, char *argv[])
 {
   int ret;
-  char *text;
-  whois_query_t wq;
 
   set_program_name (argv[0]);
   setlocale (LC_ALL, "");
@@ -112,97 +155,382 @@ main (int argc, char *argv[])
   textdomain (PACKAGE);
 
   re_syntax_options = RE_SYNTAX_EMACS;
-  wq = wq_init ();
 
   /* Parse command line arguments and initialize the cache */
   argp_version_setup (program_name, authors);
   argp_parse (&argp, argc, argv, 0, NULL, NULL);
   cache_init ();
   timeout_init ();
+  lookup_init ();
+
+  if (arguments->compile_config)
+    {
+      if (!arguments->config)
+        {
+          printf ("[%s]\n", _("No configuration file to compile"));
+          exit (EXIT_FAILURE);
+        }
+
+      char *name = image_file_name (arguments->config);
+
+      if (image_write (arguments->config) < 0)
+        {
+          printf ("[%s: %s]\n", name, strerror (errno));
+          exit (EXIT_FAILURE);
+        }
+      if (arguments->verbose)
+        printf ("[%s: %s]\n", name, _("Configuration image written"));
+      free (name);
+      exit (EXIT_SUCCESS);
+    }
+
+  if (arguments->batch)
+    ret = jwhois_batch (arguments->batch);
+  else if (arguments->listen || arguments->listen_port)
+    ret = jwhois_serve ();
+  else
+    {
+      ret = jwhois_single (arguments->query_string);
+      free (arguments->query_string);
+    }
+  cache_close ();
+  exit (ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/*
+ *  This prepares the query `query': it finds the host to query, and
+ *  looks in the cache. What is printed goes to `out'. Returns 0 and sets
+ *  `*wqp' and `*cachestr' if the host must be asked, 1 if the cached
+ *  answer was printed, or -1 on error. Unless `resolve' is set, returns
+ *  2 if the host to query takes a DNS lookup to be found.
+ */
+static int
+jwhois_prepare (const char *query, whois_query_t *wqp, char **cachestr,
+                bool resolve, struct buffer *out)
+{
+  int ret;
+  whois_query_t wq;
+
+  wq = wq_init ();
+  if (arguments->query_deadline)
+    wq->deadline = clock_ms () + (uint64_t) arguments->query_deadline * 1000;
+  *cachestr = NULL;
 
 #ifdef LIBIDN
   char *idn;
-  int rc = idna_to_ascii_lz (arguments->query_string, &idn, 0);
+  int rc = idna_to_ascii_lz (query, &idn, 0);
   if (rc != IDNA_SUCCESS)
     {
-      printf ("[IDN encoding of '%s' failed with error code %d]\n",
-              arguments->query_string, rc);
-      exit (EXIT_FAILURE);
+      buffer_printf (out, "[IDN encoding of '%s' failed with error code %d]\n",
+                     query, rc);
+      wq_free (wq);
+      return -1;
     }
   wq_set_query (wq, idn);
   free (idn);
 #else
-  wq_set_query (wq, arguments->query_string);
+  wq_set_query (wq, query);
 #endif
-  free (arguments->query_string);
 
   if (arguments->ghost)
     {
       if (arguments->verbose > 1)
-	printf ("[Calling %s:%d directly]\n",
-		arguments->ghost, arguments->gport);
+	buffer_printf (out, "[Calling %s:%d directly]\n",
+		       arguments->ghost, arguments->gport);
 
-      wq->host = arguments->ghost;
+      wq_set_host (wq, arguments->ghost);
       wq->port = arguments->gport;
     }
   else if (split_host_from_query (wq))
     {
       if (arguments->verbose > 1)
-	printf("[Calling %s directly]\n", wq->host);
+	buffer_printf (out, "[Calling %s directly]\n", wq->host);
     }
   else
     {
-      ret = lookup_host(wq, NULL);
+      ret = lookup_host(wq, NULL, resolve);
       if (ret < 0)
 	{
-	  printf ("[%s]\n", _("Fatal error searching for host to query"));
-	  exit (EXIT_FAILURE);
+	  buffer_printf (out, "[%s]\n",
+			 _("Fatal error searching for host to query"));
+	  wq_free (wq);
+	  return -1;
+	}
+      if (ret > 0)
+	{
+	  wq_free (wq);
+	  return 2;
 	}
     }
 
-  text = NULL;
-
 #ifndef NOCACHE
-  char *cachestr = xmalloc (strlen (wq->query) + strlen (wq->host) + 2);
-  snprintf(cachestr, strlen (wq->query) + strlen (wq->host) + 2, "%s:%s",
+  *cachestr = xmalloc (strlen (wq->query) + strlen (wq->host) + 2);
+  snprintf(*cachestr, strlen (wq->query) + strlen (wq->host) + 2, "%s:%s",
            wq->host, wq->query);
 
   if (!arguments->forcelookup && arguments->cache)
     {
       if (arguments->verbose > 1)
-        printf ("[Looking up entry in cache]\n");
+        buffer_printf (out, "[Looking up entry in cache]\n");
 
-      ret = cache_read (cachestr, &text);
-      if (ret < 0)
-        {
-          printf ("[%s]\n", _("Error reading cache"));
-          exit (EXIT_FAILURE);
-        }
-      else if (ret > 0)
+      struct cache_view cached;
+
+      ret = cache_read (*cachestr, &cached);
+      if (ret != 0)
         {
-          printf ("[%s]\n%s", _("Cached"), text);
-          exit (EXIT_SUCCESS);
+          if (ret < 0)
+            buffer_printf (out, "[%s]\n", _("Error reading cache"));
+          else
+            {
+              buffer_printf (out, "[%s]\n", _("Cached"));
+              jwhois_print (out, cached.text, cached.len);
+              cache_release (&cached);
+            }
+          free (*cachestr);
+          *cachestr = NULL;
+          wq_free (wq);
+          return ret;
         }
     }
 #endif
 
-  jwhois_query (wq, &text);
-  wq_free (wq);
+  *wqp = wq;
+  return 0;
+}
 
+/*
+ *  This stores the answer `text' in the cache under the key `cachestr',
+ *  and prints it to `out'.
+ */
+static void
+jwhois_answer (const char *cachestr, struct buffer *text, struct buffer *out)
+{
 #ifndef NOCACHE
   if (arguments->cache)
     {
       if (arguments->verbose > 1)
-        printf ("[Storing in cache]\n");
+        buffer_printf (out, "[Storing in cache]\n");
 
-      ret = cache_store (cachestr, text);
-      if (ret < 0)
-        printf ("[%s]\n", _("Error writing to cache"));
+      if (cache_store ((char *) cachestr, text->data) < 0)
+        buffer_printf (out, "[%s]\n", _("Error writing to cache"));
     }
+#else
+  (void) cachestr;
 #endif
 
-  printf("%s", text);
-  exit (EXIT_SUCCESS);
+  jwhois_print (out, text->data, text->len);
+}
+
+/*
+ *  This looks up `query' and prints the result: it finds the host to
+ *  query, and looks in the cache before asking the host. Returns -1 if
+ *  the query failed, 0 otherwise.
+ */
+static int
+jwhois_lookup (const char *query)
+{
+  int ret;
+  char *cachestr;
+  struct buffer text, out;
+  whois_query_t wq;
+
+  buffer_init (&out);
+  ret = jwhois_prepare (query, &wq, &cachestr, true, &out);
+  fwrite (out.data, 1, out.len, stdout);
+  buffer_reset (&out);
+  if (ret != 0)
+    {
+      buffer_free (&out);
+      return ret < 0 ? -1 : 0;
+    }
+
+  buffer_init (&text);
+  ret = jwhois_query (wq, &text);
+  wq_free (wq);
+  if (ret >= 0)
+    jwhois_answer (cachestr, &text, &out);
+  fwrite (out.data, 1, out.len, stdout);
+  free (cachestr);
+  buffer_free (&text);
+  buffer_free (&out);
+  return ret < 0 ? -1 : 0;
+}
+
+/* The query of jwhois_single(): its output not printed yet, and its
+   status.  */
+struct jwhois_single {
+  struct buffer out;
+  int ret;
+};
+
+/*
+ *  This is called once the query of jwhois_single() is done.
+ */
+static void
+jwhois_single_done (void *data, int status)
+{
+  struct jwhois_single *single = data;
+
+  single->ret = status;
+}
+
+/*
+ *  This makes the rest of the query of jwhois_single() by calling `fn'
+ *  with `arg' in this process, where blocking holds up no other query.
+ */
+static int
+jwhois_single_spawn (void *data, int (*fn) (void *), void *arg)
+{
+  struct jwhois_single *single = data;
+
+  fwrite (single->out.data, 1, single->out.len, stdout);
+  buffer_reset (&single->out);
+  jwhois_single_done (single, fn (arg));
+  fflush (stdout);
+  return 0;
+}
+
+/*
+ *  This looks up `query' as jwhois_lookup() does, but with the engine if
+ *  the host to query speaks whois, so that a redirection found in its
+ *  answer is followed while the rest of the answer arrives. Returns -1
+ *  if the query failed, 0 otherwise.
+ */
+static int
+jwhois_single (const char *query)
+{
+  struct engine e;
+  struct jwhois_single single;
+  struct buffer *out = &single.out;
+
+  if (engine_init (&e) < 0)
+    return jwhois_lookup (query);
+
+  buffer_init (out);
+  single.ret = 0;
+  if (jwhois_start (&e, query, out, jwhois_single_done,
+                    jwhois_single_spawn, &single) < 0)
+    {
+      engine_free (&e);
+      buffer_free (out);
+      return jwhois_lookup (query);
+    }
+
+  /* The output is printed as it comes.  A query answered from the cache,
+     or which couldn't be prepared, is done already, and the engine is
+     only waited for while some of its queries are in progress.  */
+  for (;;)
+    {
+      fwrite (out->data, 1, out->len, stdout);
+      fflush (stdout);
+      buffer_reset (out);
+      if (e.count == 0)
+        break;
+      if (engine_wait (&e, -1) < 0)
+        {
+          printf ("[%s: %s]\n", _("Error waiting for queries"),
+                  strerror (errno));
+          single.ret = -1;
+          break;
+        }
+    }
+
+  engine_free (&e);
+  buffer_free (out);
+  return single.ret;
+}
+
+/*
+ *  This prints the `len' bytes of `text' to `out'. In batch mode, a
+ *  newline is added if the text doesn't end with one, so that the end of
+ *  the record starts a line.
+ */
+static void
+jwhois_print (struct buffer *out, const char *text, size_t len)
+{
+  buffer_append (out, text, len);
+  if (arguments->batch && len > 0 && text[len - 1] != '\n')
+    buffer_append (out, "\n", 1);
+}
+
+/*
+ *  This looks up each line of the file `name', or of the standard input
+ *  if `name' is "-", with up to `arguments->jobs' queries at once.
+ *  Returns -1 if the file couldn't be read or if a query failed, 0
+ *  otherwise.
+ */
+static int
+jwhois_batch (const char *name)
+{
+  int ret;
+  FILE *in;
+
+  if (STREQ (name, "-"))
+    in = stdin;
+  else
+    {
+      in = fopen (name, "r");
+      if (!in)
+        {
+          printf ("[%s: %s]\n", name, _("Unable to open"));
+          return -1;
+        }
+    }
+
+  ret = batch_run (in, arguments->jobs, &batch_ops);
+  if (ferror (in))
+    printf ("[%s: %s]\n", name, strerror (errno));
+
+  if (in != stdin)
+    fclose (in);
+  return ret;
+}
+
+/*
+ *  This answers the queries of the local clients connecting to the
+ *  sockets given by --listen and --listen-port, until jwhois is sent
+ *  SIGTERM or SIGINT. Returns -1 if no socket could be opened or if the
+ *  server failed, 0 otherwise.
+ */
+static int
+jwhois_serve (void)
+{
+  int fds[3], ret, count = 0;
+
+  if (arguments->listen)
+    {
+      fds[count] = serve_listen_unix (arguments->listen);
+      if (fds[count] < 0)
+        {
+          printf ("[%s: %s]\n", arguments->listen, strerror (errno));
+          return -1;
+        }
+      count++;
+    }
+  if (arguments->listen_port)
+    {
+      ret = serve_listen_tcp (arguments->listen_port, fds + count);
+      if (ret < 0)
+        {
+          printf ("[%s %d: %s]\n", _("Unable to listen on port"),
+                  arguments->listen_port, strerror (errno));
+          while (count > 0)
+            close (fds[--count]);
+          return -1;
+        }
+      count += ret;
+    }
+
+  if (arguments->verbose)
+    printf ("[%s]\n", _("Waiting for queries"));
+  fflush (stdout);
+  ret = serve_run (fds, count, jobs_given ? arguments->jobs
+                   : JWHOIS_SERVE_JOBS, &batch_ops);
+  if (ret < 0)
+    printf ("[%s: %s]\n", _("Unable to answer queries"), strerror (errno));
+  if (arguments->listen)
+    unlink (arguments->listen);
+  return ret;
 }
 
 /* Parse a single option.  */
@@ -247,6 +575,27 @@ parse_opt (int key, char *arg, struct argp_state *state)
     case OPT_DISPLAY:
       arguments->rwhois_display = arg;
       break;
+    case OPT_COMPILE_CONFIG:
+      arguments->compile_config = 1;
+      break;
+    case OPT_BATCH:
+      arguments->batch = arg;
+      break;
+    case OPT_JOBS:
+      arguments->jobs = strtol (arg, &ret, 10);
+      if (*ret != '\0' || arguments->jobs < 1)
+        argp_error (state, "%s: %s", _("Invalid number of jobs"), arg);
+      jobs_given = true;
+      break;
+    case OPT_LISTEN:
+      arguments->listen = arg;
+      break;
+    case OPT_LISTEN_PORT:
+      arguments->listen_port = strtol (arg, &ret, 10);
+      if (*ret != '\0' || arguments->listen_port < 1
+          || arguments->listen_port > 65535)
+        argp_error (state, "%s: %s", _("Invalid port number"), arg);
+      break;
     case OPT_LIMIT:
       arguments->rwhois_limit = strtol (arg, &ret, 10);
       if (*ret != '\0')
@@ -258,9 +607,15 @@ parse_opt (int key, char *arg, struct argp_state *state)
         printf ("[%s: %s]\n", _("Invalid port number"), arg);
       break;
     case ARGP_KEY_NO_ARGS:
-      argp_usage (state);
+      if (!arguments->compile_config && !arguments->batch
+          && !arguments->listen && !arguments->listen_port)
+        argp_usage (state);
       break;
     case ARGP_KEY_ARGS:
+      if (arguments->batch)
+        argp_error (state, _("no query may be given with --batch"));
+      if (arguments->listen || arguments->listen_port)
+        argp_error (state, _("no query may be given with --listen"));
       arguments->query_string =
         strjoinv (" ", state->argc - state->next,
                   /* Fix 'incompatible-pointer-types' warning.  */
@@ -288,7 +643,11 @@ parse_opt (int key, char *arg, struct argp_state *state)
         }
       if (in)
         {
-          jconfig_parse_file(in);
+          if (arguments->compile_config
+              || image_load (arguments->config) < 0)
+            jconfig_parse_file(in);
+          else if (arguments->verbose > 1)
+            printf ("[Using image of %s]\n", arguments->config);
           fclose(in);
         }
       if (arguments->verbose > 1)
@@ -303,16 +662,16 @@ parse_opt (int key, char *arg, struct argp_state *state)
 
 
 /*
- * Attempt to convert string if result encoding is specified in the config
- * file.
+ * Attempt to convert the data answered by host if result encoding is
+ * specified in the config file.
  * */
-static char *
-convert_charset (whois_query_t wq, char *curdata)
+static void
+convert_charset (const char *host, struct buffer *data)
 {
 #ifdef HAVE_ICONV
   const char *charset;
 
-  charset = get_whois_server_option(wq->host, "answer-charset");
+  charset = get_whois_server_option(host, "answer-charset");
   if (charset != NULL)
     {
       iconv_t cd;
@@ -320,48 +679,81 @@ convert_charset (whois_query_t wq, char *curdata)
       cd = iconv_open(nl_langinfo(CODESET), charset);
       if (cd != (iconv_t)-1)
 	{
-	  char *buf, *src;
-	  size_t src_left, dest_size, dest_pos, res;
-
-	  src = curdata;
-	  src_left = strlen(src);
-	  dest_size = src_left;
-	  buf = malloc(dest_size);
-	  if (buf == NULL)
-	    goto error;
-	  dest_pos = 0;
-
-	  res = 0;
+	  struct buffer out;
+	  char *src;
+	  size_t src_left, room, res;
+
+	  src = data->data;
+	  src_left = data->len;
+	  room = src_left;
+	  buffer_init(&out);
+
 	  while (src_left != 0)
 	    {
 	      char *dest;
 	      size_t dest_left;
-	      
-	      dest = buf + dest_pos;
-	      dest_left = dest_size - dest_pos;
+
+	      dest = buffer_reserve(&out, room);
+	      dest_left = out.size - out.len - 1;
 	      res = iconv(cd, &src, &src_left, &dest, &dest_left);
-	      if (res == (size_t)-1 && errno != E2BIG)
-		goto error;
-	      dest_pos = dest - buf;
-	      dest_size *= 2;
-	      buf = realloc(buf, dest_size);
-	      if (buf == NULL)
-		goto error;
+	      out.len = dest - out.data;
+	      if (res == (size_t)-1)
+		{
+		  if (errno != E2BIG)
+		    {
+		      buffer_free(&out);
+		      iconv_close(cd);
+		      return;
+		    }
+		  room *= 2;
+		}
 	    }
-	  buf[dest_pos] = 0;
-	  
-	  iconv_close(cd);
-	  free (curdata);
-	  return buf;
-	  
-	error:
-	  free(buf);
+	  out.data[out.len] = '\0';
+
 	  iconv_close(cd);
+	  buffer_free(data);
+	  *data = out;
 	}
     }
 #endif
-  (void)wq;
-  return curdata;
+  (void)host;
+  (void)data;
+}
+
+/*
+ *  This tells whether the host of `wq' is asked with the whois protocol,
+ *  rather than with rwhois or through the web.
+ */
+static bool
+jwhois_is_whois (whois_query_t wq)
+{
+  const char *rwhois = get_whois_server_option (wq->host, "rwhois");
+  const char *http = get_whois_server_option (wq->host, "http");
+
+  return !arguments->rwhois
+    && !(rwhois && STRCASEEQ (rwhois, "true"))
+    && !(http && STRCASEEQ (http, "true"));
+}
+
+/*
+ *  This asks the host of `wq' with the method it uses, and appends the
+ *  answer to `data'. Returns -1 on error, 1 if the answer redirects to
+ *  another host, 0 otherwise.
+ */
+static int
+jwhois_ask (whois_query_t wq, struct buffer *data)
+{
+  const char *tmp;
+
+  tmp = get_whois_server_option(wq->host, "rwhois");
+  if ((tmp && STRCASEEQ (tmp, "true")) || arguments->rwhois)
+    return rwhois_query(wq, data);
+
+  tmp = get_whois_server_option(wq->host, "http");
+  if (tmp && STRCASEEQ (tmp, "true"))
+    return http_query(wq, data);
+
+  return whois_query(wq, data);
 }
 
 /*
@@ -369,16 +761,17 @@ convert_charset (whois_query_t wq, char *curdata)
  *  the method to use for the host and then calls the correct routine
  *  to make the query. If the return value of the subroutine is above
  *  0, it found a redirect to another server, so jwhois_query() promptly
- *  follows it there. A return value of -1 is always a fatal error.
+ *  follows it there. A return value of -1 means that the query failed.
  */
 static int
-jwhois_query (whois_query_t wq, char **text)
+jwhois_query (whois_query_t wq, struct buffer *text)
 {
-  char *tmp, *tmp2, *oldquery = NULL, *curdata;
+  char *oldquery = NULL, *host;
+  struct buffer curdata;
   int ret;
 
   if (!arguments->display_redirections)
-    *text = NULL;
+    buffer_reset (text);
   
   if (!arguments->raw_query)
     {
@@ -386,46 +779,441 @@ jwhois_query (whois_query_t wq, char **text)
       wq->query = (char *)lookup_query_format(wq);
     }
 
-  tmp = (char *)get_whois_server_option(wq->host, "rwhois");
-  tmp2 = (char *)get_whois_server_option(wq->host, "http");
-  curdata = NULL;
+  /* A redirection changes the host of `wq'.  */
+  host = xstrdup (wq->host);
+  buffer_init (&curdata);
+  ret = jwhois_ask (wq, &curdata);
 
-  if ((tmp && STRCASEEQ (tmp, "true")) || arguments->rwhois)
+  if (!arguments->raw_query)
+    {
+      free(wq->query);
+      wq->query = oldquery;
+    }
+
+  if (ret < 0)
     {
-      ret = rwhois_query(wq, &curdata);
+      free (host);
+      buffer_free (&curdata);
+      return -1;
     }
+
+  convert_charset(host, &curdata);
+  free (host);
+  buffer_append (text, curdata.data, curdata.len);
+  buffer_free (&curdata);
+
+  if (ret > 0)
+    return jwhois_query(wq, text);
   else
+    return 0;
+}
+
+/* A host asked by a query of the engine.  */
+struct jwhois_hop {
+  struct jwhois_job *job;
+
+  /* The host, its port and the query it is asked, and its answer, which
+     is complete once COMPLETE is set.  */
+  whois_query_t wq;
+  struct buffer text;
+  struct engine_query eq;
+  bool complete;
+
+  /* What was printed about the host if it was asked before the answer of
+     the previous host was complete, to be output once that answer is
+     handled.  */
+  struct buffer log;
+
+  /* The host the answer redirects to, once it is asked.  */
+  struct jwhois_hop *next;
+};
+
+/* A query of a batch made by the engine.  */
+struct jwhois_job {
+  whois_query_t wq;
+  char *cachestr;
+
+  /* The answer.  */
+  struct buffer text;
+
+  /* The first host asked, the host whose answer is to be handled next,
+     and the number of hosts still asked by the engine.  */
+  struct jwhois_hop *hops, *hop;
+  unsigned int asking;
+
+  struct engine *engine;
+
+  /* Where the output of the query goes, what to call once done, or NULL
+     once the query is over, and what to call to have it made to its end
+     in a child process.  */
+  struct buffer *out;
+  batch_done_t done;
+  batch_spawn_t spawn;
+  void *data;
+};
+
+/*
+ *  This releases `job' and its hosts.
+ */
+static void
+jwhois_job_free (struct jwhois_job *job)
+{
+  struct jwhois_hop *hop;
+
+  while ((hop = job->hops))
     {
-      if (tmp2 && STRCASEEQ (tmp2, "true"))
-	ret = http_query(wq, &curdata);
-      else
-	ret = whois_query(wq, &curdata);
-      
+      job->hops = hop->next;
+      wq_free (hop->wq);
+      buffer_free (&hop->text);
+      buffer_free (&hop->log);
+      free (hop);
     }
+  wq_free (job->wq);
+  free (job->cachestr);
+  buffer_free (&job->text);
+  free (job);
+}
+
+/*
+ *  This ends the query `job', which failed if `ret' is negative. The job
+ *  is released once the engine is done with the hosts it still asks.
+ */
+static void
+jwhois_job_end (struct jwhois_job *job, int ret)
+{
+  if (ret >= 0)
+    jwhois_answer (job->cachestr, &job->text, job->out);
+  job->done (job->data, ret < 0 ? -1 : 0);
+  job->done = NULL;
+  job->hop = NULL;
+
+  if (!job->asking)
+    jwhois_job_free (job);
+}
+
+/*
+ *  This returns a copy of `wq' asking the query of `job'.
+ */
+static whois_query_t
+jwhois_hop_query (struct jwhois_job *job, whois_query_t wq)
+{
+  whois_query_t copy = wq_init ();
+
+  wq_set_host (copy, wq->host);
+  copy->port = wq->port;
+  copy->domain = wq->domain;
+  copy->deadline = wq->deadline;
+  wq_set_query (copy, job->wq->query);
+  return copy;
+}
+
+/*
+ *  This starts asking the host of `wq' for `job', which keeps `wq', with
+ *  the engine, telling so in `out'. Hosts which don't speak whois, if a
+ *  redirection leads to them, are asked once the answer is handled.
+ */
+static struct jwhois_hop *
+jwhois_hop_new (struct jwhois_job *job, whois_query_t wq, struct buffer *out)
+{
+  struct jwhois_hop *hop = xcalloc (1, sizeof *hop);
+  char *query;
+
+  hop->job = job;
+  hop->wq = wq;
+  buffer_init (&hop->text);
+  buffer_init (&hop->log);
 
   if (!arguments->raw_query)
     {
+      query = lookup_query_format(wq);
       free(wq->query);
-      wq->query = oldquery;
+      wq->query = query;
     }
 
-  if (ret < 0)
-    exit (EXIT_FAILURE);
-    
-  if (curdata != NULL)
+  if (!jwhois_is_whois (wq))
     {
-      curdata = convert_charset(wq, curdata);
-      if (*text == NULL)
-	*text = curdata;
-      else
-	{
-	  *text = xrealloc (*text, strlen (*text) + strlen (curdata) + 1);
-	  strcat(*text, curdata);
-	  free(curdata);
-	}
+      hop->complete = true;
+      return hop;
     }
-  if (ret > 0)
-    return jwhois_query(wq, text);
-  else
+
+  buffer_printf (out, "[%s %s]\n", _("Querying"), wq->host);
+  hop->eq.wq = wq;
+  hop->eq.text = &hop->text;
+  hop->eq.done = jwhois_hop_done;
+  hop->eq.lines = arguments->redirect ? jwhois_hop_lines : NULL;
+  hop->eq.data = hop;
+  job->asking++;
+  engine_whois (job->engine, &hop->eq);
+  return hop;
+}
+
+/*
+ *  This prints to `out' what went wrong with the host of `hop', if
+ *  anything. Returns -1 if the engine failed to get its answer, 0
+ *  otherwise.
+ */
+static int
+jwhois_hop_status (struct jwhois_hop *hop, struct buffer *out)
+{
+  struct engine_query *q = &hop->eq;
+  whois_query_t wq = hop->wq;
+
+  if (q->status >= 0)
     return 0;
+  if (q->status == -2)
+    buffer_printf (out, "[%s: %s]\n", wq->host, _("Rate limit exceeded"));
+  else if (q->status == -3)
+    buffer_printf (out, "[%s %s:%d]\n", _("Timeout reading data from"),
+                   wq->host, wq->port);
+  else if (q->status == -4)
+    buffer_printf (out, "[%s: %s]\n", wq->host,
+                   _("Query deadline exceeded"));
+  else if (q->state == ENGINE_RESOLVE)
+    {
+      buffer_printf (out, "[%s: %s]\n", wq->host,
+                     gai_strerror (q->lookup.error));
+      buffer_puts (out, _("[Unable to connect to remote host]\n"));
+    }
+  else if (q->state == ENGINE_CONNECT)
+    buffer_puts (out, _("[Unable to connect to remote host]\n"));
+  else
+    buffer_printf (out, "[%s %s:%d]\n", _("Error reading data from"),
+                   wq->host, wq->port);
+  return -1;
+}
+
+/*
+ *  This is called in a child process to ask the host of `data', a job
+ *  whose current host doesn't speak whois, and the hosts its answer
+ *  redirects to, as jwhois_lookup() does. Returns -1 if the query
+ *  failed, 0 otherwise.
+ */
+static int
+jwhois_job_child (void *data)
+{
+  struct jwhois_job *job = data;
+  whois_query_t wq = jwhois_hop_query (job, job->hop->wq);
+  struct buffer out;
+  int ret;
+
+  ret = jwhois_query (wq, &job->text);
+  wq_free (wq);
+  if (ret >= 0)
+    {
+      buffer_init (&out);
+      jwhois_answer (job->cachestr, &job->text, &out);
+      fwrite (out.data, 1, out.len, stdout);
+      buffer_free (&out);
+    }
+  return ret < 0 ? -1 : 0;
+}
+
+/*
+ *  This has the rest of `job' made in a child process, since rwhois and
+ *  HTTP hosts are asked synchronously, which would hold up the other
+ *  queries of the engine.
+ */
+static void
+jwhois_job_spawn (struct jwhois_job *job)
+{
+  if (job->spawn (job->data, jwhois_job_child, job) < 0)
+    {
+      buffer_printf (job->out, "[%s: %s]\n", _("Unable to start query"),
+                     strerror (errno));
+      jwhois_job_end (job, -1);
+      return;
+    }
+
+  /* The answer is made by the child process, and the hosts still asked
+     only have to be waited for.  */
+  job->done = NULL;
+  job->hop = NULL;
+  if (!job->asking)
+    jwhois_job_free (job);
+}
+
+/*
+ *  This handles the answers of the hosts of `job' in turn, as long as
+ *  they are complete, as jwhois_query() does, and ends the job after
+ *  the last one. A host whose answer redirects to another one was asked
+ *  already if the redirection was found before the answer was complete.
+ *  What is printed goes to the output of the job.
+ */
+static void
+jwhois_job_run (struct jwhois_job *job)
+{
+  struct jwhois_hop *hop;
+  whois_query_t next;
+  int ret;
+
+  while ((hop = job->hop) && hop->complete)
+    {
+      next = NULL;
+      if (!hop->eq.wq)
+        {
+          jwhois_job_spawn (job);
+          return;
+        }
+      if ((ret = jwhois_hop_status (hop, job->out)) == 0 && hop->next)
+        ret = 1;
+      else if (ret == 0 && arguments->redirect)
+        {
+          next = jwhois_hop_query (job, hop->wq);
+          if (lookup_redirect (next, hop->text.data, job->out) > 0)
+            ret = 1;
+          else
+            {
+              wq_free (next);
+              next = NULL;
+            }
+        }
+
+      if (ret < 0)
+        {
+          jwhois_job_end (job, -1);
+          return;
+        }
+
+      if (!arguments->display_redirections)
+        buffer_reset (&job->text);
+      convert_charset(hop->wq->host, &hop->text);
+      buffer_append (&job->text, hop->text.data, hop->text.len);
+      buffer_free (&hop->text);
+
+      if (ret == 0)
+        {
+          jwhois_job_end (job, 0);
+          return;
+        }
+      if (next)
+        hop->next = jwhois_hop_new (job, next, job->out);
+      else
+        buffer_append (job->out, hop->next->log.data, hop->next->log.len);
+      job->hop = hop->next;
+    }
+}
+
+/*
+ *  This is called by the engine once a host of the job has answered.
+ */
+static void
+jwhois_hop_done (struct engine_query *q)
+{
+  struct jwhois_hop *hop = q->data;
+  struct jwhois_job *job = hop->job;
+
+  hop->complete = true;
+  job->asking--;
+
+  /* The hosts still asked when the query failed only had to be waited
+     for, and an answer is handled once those before it are.  */
+  if (!job->done)
+    {
+      if (!job->asking)
+        jwhois_job_free (job);
+      return;
+    }
+  if (hop != job->hop)
+    return;
+
+  jwhois_job_run (job);
+}
+
+/*
+ *  This is called by the engine with the lines of the answer of a host
+ *  as they arrive. A line redirecting to a host which speaks whois has
+ *  that host asked at once, while the rest of the answer is read. The
+ *  query is only copied once such a line is found. Returns true once the
+ *  lines need not be looked at anymore.
+ */
+static bool
+jwhois_hop_lines (struct engine_query *q, const char *text, size_t len)
+{
+  struct jwhois_hop *hop = q->data;
+  struct jwhois_job *job = hop->job;
+  struct buffer log;
+  whois_query_t wq;
+  const char *line;
+  size_t n;
+  int ret;
+
+  if (!job->done)
+    return true;
+  ret = lookup_redirect_lines (hop->wq, text, len, &line, &n);
+  if (ret <= 0)
+    return ret != 0;
+
+  wq = jwhois_hop_query (job, hop->wq);
+  buffer_init (&log);
+  ret = lookup_redirect_follow (wq, line, n, &log);
+  if (ret > 0 && jwhois_is_whois (wq))
+    {
+      hop->next = jwhois_hop_new (job, wq, &log);
+      buffer_free (&hop->next->log);
+      hop->next->log = log;
+      return true;
+    }
+  buffer_free (&log);
+  wq_free (wq);
+  return ret != 0;
+}
+
+/*
+ *  This starts the query `query' of a batch with the engine `e', unless
+ *  its host doesn't speak whois or takes a DNS lookup to be found. The
+ *  output of the query is appended to `out', and `done' is called with
+ *  `data' once it is complete, or `spawn' if a redirection leads to a
+ *  host which doesn't speak whois. Returns -1 if the query must be made
+ *  by jwhois_lookup() instead, 0 otherwise.
+ */
+static int
+jwhois_start (struct engine *e, const char *query, struct buffer *out,
+              batch_done_t done, batch_spawn_t spawn, void *data)
+{
+  struct jwhois_job *job;
+  whois_query_t wq;
+  char *cachestr;
+  size_t len;
+  int ret;
+
+  len = out->len;
+  ret = jwhois_prepare (query, &wq, &cachestr, false, out);
+  if (ret == 2 || (ret == 0 && !jwhois_is_whois (wq)))
+    {
+      if (ret == 0)
+        {
+          wq_free (wq);
+          free (cachestr);
+        }
+      buffer_truncate (out, len);
+      return -1;
+    }
+  if (ret != 0)
+    {
+      done (data, ret < 0 ? -1 : 0);
+      return 0;
+    }
+
+  job = xcalloc (1, sizeof *job);
+  job->wq = wq;
+  job->cachestr = cachestr;
+  buffer_init (&job->text);
+  job->engine = e;
+  job->out = out;
+  job->done = done;
+  job->spawn = spawn;
+  job->data = data;
+  job->hops = job->hop = jwhois_hop_new (job, jwhois_hop_query (job, wq),
+                                         out);
+  return 0;
+}
+
+/*
+ *  This is called first in the child processes making the queries of a
+ *  batch, which open the cache of their own.
+ */
+static void
+jwhois_child (void)
+{
+  cache_close ();
 }
@@ -28,122 +28,223 @@
 
 #include <arpa/inet.h>
 #include <ctype.h>
+#include <limits.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <regex.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include "image.h"
 #include "init.h"
 #include "jconfig.h"
+#include "radix.h"
+#include "resolve.h"
+#include "suffix.h"
 #include "utils.h"
 #include "whois.h"
 
 int lookup_whois_servers (const char *, whois_query_t);
 
+/* The prefixes of a cidr or cidr6 block, built once into a radix tree
+   whose values are indexes in ENTRIES, the entries holding the hosts.  */
+struct cidr_block
+{
+  char *name;
+  int family;
+  struct radix_tree tree;
+  size_t count;
+  const struct jconfig **entries;
+
+  /* Set if one of the netmasks is invalid.  */
+  bool invalid;
+
+  struct cidr_block *next;
+};
+
+static struct cidr_block *cidr_blocks = NULL;
+
 /*
- *  Looks up an IPv4 address `val' against `block' and returns a pointer
- *  if an entry is found, otherwise NULL.
+ *  Converts the numbers of a dotted IPv4 address into a key of 4 bytes in
+ *  network order.
  */
-char *
-find_cidr (whois_query_t wq, const char *block)
+static void
+cidr_ipv4_key (unsigned char *key, unsigned int a0, unsigned int a1,
+	       unsigned int a2, unsigned int a3)
 {
-  struct in_addr ip;
-  struct in_addr ipmaskip;
-  struct jconfig *j;
-  unsigned int ipmask, bits, res, match_bits;
-  unsigned int a0, a1, a2, a3;
-  char *host = NULL;
+  uint32_t ip = (a0 << 24) + (a1 << 16) + (a2 << 8) + a3;
 
-  res = sscanf(wq->query, "%u.%u.%u.%u", &a0, &a1, &a2, &a3);
-  if (res == 3) a3 = 0;
-  else if (res == 2) a2 = a3 = 0;
-  else if (res == 1) a1 = a2 = a3 = 0;
-  else if (res != 4) return NULL;
+  key[0] = ip >> 24;
+  key[1] = ip >> 16;
+  key[2] = ip >> 8;
+  key[3] = ip;
+}
 
-  match_bits = 0;
+/*
+ *  Parses the network address and prefix length of the entry `j' of a
+ *  cidr6 block into `key' and `bits'.  Returns 0 on success, or -1 after
+ *  printing an error.
+ */
+#ifdef HAVE_INET_PTON_IPV6
+static int
+cidr_ipv6_entry (const struct jconfig *j, unsigned char *key,
+		 unsigned int *bits)
+{
+  char *p, *addr;
+  size_t len;
+  int res;
 
-#ifdef WORDS_BIGENDIAN
-  ip.s_addr = (a3<<24)+(a2<<16)+(a1<<8)+a0;
-#else
-  ip.s_addr = (a0<<24)+(a1<<16)+(a2<<8)+a3;
+  p = strchr(j->key, '/');
+  if (p == NULL)
+    {
+      printf (_("[%s: Missing prefix length on line %d]\n"),
+	      arguments->config, j->line);
+      return -1;
+    }
+  if (sscanf(p + 1, "%u", bits) != 1 || *bits > 128)
+    {
+      printf (_("[%s: Invalid prefix length on line %d]\n"),
+	      arguments->config, j->line);
+      return -1;
+    }
+  len = p - j->key;
+  addr = xmalloc (len + 1);
+  memcpy(addr, j->key, len);
+  addr[len] = '\0';
+  res = inet_pton(AF_INET6, addr, key);
+  free(addr);
+  if (res != 1)
+    {
+      printf (_("[%s: Invalid network address on line %d]\n"),
+	      arguments->config, j->line);
+      return -1;
+    }
+  return 0;
+}
 #endif
 
-  jconfig_set();
-  while ((j = jconfig_next (block)) != NULL)
+/*
+ *  Reads all entries of `block' into a new radix tree of addresses of
+ *  `family'.  The 'default' entry matches every address.  The last
+ *  entry wins when a prefix is listed twice.
+ */
+static struct cidr_block *
+cidr_block_build (const char *block, int family)
+{
+  struct cidr_block *cb;
+  struct jconfig_cursor cur;
+  struct jconfig *j;
+  unsigned char key[16];
+  unsigned int a0, a1, a2, a3, bits;
+  size_t alloc = 64;
+
+  cb = xmalloc (sizeof (struct cidr_block));
+  cb->name = xstrdup (block);
+  cb->family = family;
+  radix_tree_init (&cb->tree);
+  cb->count = 0;
+  cb->entries = xmalloc (alloc * sizeof (struct jconfig *));
+  cb->invalid = false;
+
+  jconfig_set (&cur);
+  while ((j = jconfig_next (&cur, block)) != NULL)
     {
-      if (!STRCASEEQ (j->key, "type") && !STRCASEEQ (j->key, "default"))
-        {
-          ipmaskip.s_addr = 0;
-          ipmask = 0;
-          bits = 0;
-        }
+      if (STRCASEEQ (j->key, "type"))
+	continue;
+
+      if (STRCASEEQ (j->key, "default"))
+	bits = 0;
+      else if (family == AF_INET)
+	{
+	  if (sscanf (j->key, "%u.%u.%u.%u/%u", &a0, &a1, &a2, &a3, &bits) != 5
+	      || bits > 32)
+	    {
+	      printf ("[%s: %s %d]\n", arguments->config,
+		      _("Invalid netmask on line"), j->line);
+	      cb->invalid = true;
+	      break;
+	    }
+	  cidr_ipv4_key (key, a0, a1, a2, a3);
+	}
       else
-        {
-          res = sscanf (j->key, "%u.%u.%u.%u/%u", &a0, &a1, &a2, &a3, &bits);
-          if (res != 5 || bits > 32)
-            {
-              printf ("[%s: %s %d]\n", arguments->config,
-                      _("Invalid netmask on line"), j->line);
-              return NULL;
-            }
-#ifdef WORDS_BIGENDIAN
-          ipmaskip.s_addr = (a3 << 24) + (a2 << 16) + (a1 << 8) + a0;
-          ipmask = (0xffffffff >> (32-bits));
-#else
-          ipmaskip.s_addr = (a0 << 24) + (a1 << 16) + (a2 << 8) + a3;
-          ipmask = (0xffffffff << (32-bits));
+	{
+#ifdef HAVE_INET_PTON_IPV6
+	  if (cidr_ipv6_entry (j, key, &bits) < 0)
+	    continue;
 #endif
-        }
-      if (((ip.s_addr & ipmask) == (ipmaskip.s_addr & ipmask))
-          && (bits >= match_bits))
-        {
-          host = j->value;
-          match_bits = bits;
-        }
+	}
+
+      if (cb->count == alloc)
+	{
+	  alloc *= 2;
+	  cb->entries = xrealloc (cb->entries,
+				  alloc * sizeof (struct jconfig *));
+	}
+      radix_tree_insert (&cb->tree, key, bits, cb->count);
+      cb->entries[cb->count++] = j;
     }
-  jconfig_end();
 
-  return host;
+  cb->next = cidr_blocks;
+  cidr_blocks = cb;
+  return cb;
 }
 
 /*
- * Checks whether IPv6 address `addr` is in the network `net'/`bits`.
+ *  Returns the radix tree of `block', building it on first use.
  */
-#ifdef HAVE_INET_PTON_IPV6
-static int ipv6_address_is_in_network(const struct in6_addr *addr,
-				      const struct in6_addr *net,
-				      unsigned bits)
+static struct cidr_block *
+cidr_block_get (const char *block, int family)
 {
-  size_t i;
+  struct cidr_block *cb;
 
-  for (i = 0; i < bits / 8; i++)
-    {
-      if (addr->s6_addr[i] != net->s6_addr[i])
-	return 0;
-    }
-  /* i == bits / 8 */
-  if (bits % 8 != 0
-      && (addr->s6_addr[i] & (0xFFu << (8 - (bits % 8)))) != net->s6_addr[i])
-    return 0;
+  for (cb = cidr_blocks; cb; cb = cb->next)
+    if (cb->family == family && STRCASEEQ (cb->name, block))
+      return cb;
 
-  return 1;
+  return cidr_block_build (block, family);
 }
-#endif
 
 /*
- *  Looks up an IPv6 address `val' against `block' and returns a pointer
+ *  Looks up an IPv4 address `val' against `block' and returns a pointer
  *  if an entry is found, otherwise NULL.
  */
+char *
+find_cidr (whois_query_t wq, const char *block)
+{
+  struct cidr_block *cb;
+  unsigned char key[4];
+  unsigned int bits, res;
+  unsigned int a0, a1, a2, a3;
+  int i;
+
+  res = sscanf(wq->query, "%u.%u.%u.%u", &a0, &a1, &a2, &a3);
+  if (res == 3) a3 = 0;
+  else if (res == 2) a2 = a3 = 0;
+  else if (res == 1) a1 = a2 = a3 = 0;
+  else if (res != 4) return NULL;
+
+  cb = cidr_block_get (block, AF_INET);
+  if (cb->invalid)
+    return NULL;
+
+  cidr_ipv4_key (key, a0, a1, a2, a3);
+  i = radix_tree_match (&cb->tree, key, 32, &bits);
+  return i < 0 ? NULL : cb->entries[i]->value;
+}
+
+/*
+ *  Looks up an IPv6 address `val' against `block' and returns a pointer
+ *  if an entry is found, otherwise NULL.  If `val' has a prefix length,
+ *  only networks which contain the whole prefix are considered.
+ */
 #ifdef HAVE_INET_PTON_IPV6
 static char *
 find_cidr6 (whois_query_t wq, const char *block)
 {
-  struct in6_addr query_ip;
-  struct in6_addr entry_ip;
-  struct jconfig *j;
-  unsigned int max_bits, bits, match_bits;
-  int res;
-  char *p, *addr, *host = NULL;
+  struct cidr_block *cb;
+  unsigned char key[16];
+  unsigned int max_bits, bits;
+  int res, i;
+  char *p, *addr;
 
   p = strchr(wq->query, '/');
   if (p == NULL)
@@ -157,233 +258,709 @@ find_cidr6 (whois_query_t wq, const char *block)
 
       if (sscanf(p + 1, "%u", &max_bits) != 1)
 	return NULL;
+      if (max_bits > 128)
+	max_bits = 128;
       len = p - wq->query;
       addr = xmalloc (len + 1);
       memcpy(addr, wq->query, len);
       addr[len] = '\0';
     }
-  res = inet_pton(AF_INET6, addr, &query_ip);
+  res = inet_pton(AF_INET6, addr, key);
   free(addr);
   if (res != 1)
     return NULL;
 
-  match_bits = 0;
+  cb = cidr_block_get (block, AF_INET6);
+  i = radix_tree_match (&cb->tree, key, max_bits, &bits);
+  return i < 0 ? NULL : cb->entries[i]->value;
+}
+#endif
+
+/* A rule of a regex block, compiled once and reused for every query.  */
+struct regex_rule
+{
+  /* Configuration entry this rule was built from.  */
+  const struct jconfig *j;
+
+  /* Host to query when this rule wins.  */
+  const char *host;
+
+  /* Domain of the sub-block defining this rule, or NULL if the rule is a
+     plain key/value pair.  */
+  const char *domain;
+
+  /* Regular expression of the rule.  */
+  const char *pattern;
+
+  /* Set for 'default' rules, which don't have a pattern.  */
+  bool is_default;
 
-  jconfig_set();
-  while ((j = jconfig_next(block)) != NULL)
+  /* Set for rules matching a literal suffix, which are looked up in the
+     suffix trie of the block instead of being compiled.  */
+  bool is_suffix;
+
+  /* Compiled pattern, unless the rule is a 'default' or suffix one.  */
+  struct re_pattern_buffer rpb;
+};
+
+/* The rules of a regex block, in configuration file order.  */
+struct regex_block
+{
+  char *name;
+  size_t count;
+  struct regex_rule *rules;
+
+  /* Literal suffix rules, mapping each suffix to the index of its rule.  */
+  struct suffix_trie suffixes;
+
+  /* Indexes of the rules which need a regular expression search.  */
+  size_t npatterns;
+  int *patterns;
+
+  /* Index of the last 'default' rule, or -1.  */
+  int last_default;
+
+  /* Set once the patterns have been compiled, which is only done when the
+     block is first searched.  */
+  bool compiled;
+
+  /* Set if one of the patterns failed to compile.  */
+  bool invalid;
+
+  struct regex_block *next;
+};
+
+static struct regex_block *regex_blocks = NULL;
+
+/* Translation table used to make the patterns case insensitive.  It must
+   live as long as the compiled patterns.  */
+static unsigned char case_fold[256];
+
+/*
+ *  Compiles PATTERN into RPB, wrapped in a group so that the length of
+ *  the match can be found in the first register.  A leading ".*" is
+ *  stripped.  Returns 0 on success, -1 if the pattern is invalid.
+ */
+static int
+regex_rule_compile (struct re_pattern_buffer *rpb, const char *pattern)
+{
+  const char *error;
+  char *tmp;
+
+  if (STRNCASEEQ (pattern, ".*", 2))
+    pattern += 2;
+
+  tmp = xmalloc (strlen (pattern) + 5);
+  strcpy (tmp, "\\(");
+  strcat (tmp, pattern);
+  strcat (tmp, "\\)");
+
+  memset (rpb, 0, sizeof (*rpb));
+  rpb->translate = case_fold;
+  rpb->fastmap = xmalloc (256);
+  error = re_compile_pattern (tmp, strlen (tmp), rpb);
+  free (tmp);
+  if (error != NULL)
     {
-      if (STRCASEEQ (j->key, "type"))
+      free (rpb->fastmap);
+      rpb->fastmap = NULL;
+      return -1;
+    }
+
+  /* Compile the fastmap now and let searches fill registers provided by
+     the caller, so that matching never modifies RPB.  */
+  re_compile_fastmap (rpb);
+  rpb->regs_allocated = REGS_FIXED;
+  return 0;
+}
+
+/*
+ *  Checks whether PATTERN only matches a literal suffix of the query, as
+ *  "\\.com$" does.  If so, stores the suffix in a newly allocated
+ *  *SUFFIX and returns its length, otherwise returns 0.
+ */
+static size_t
+regex_suffix_literal (const char *pattern, char **suffix)
+{
+  size_t len = 0;
+  char *s;
+
+  if (STRNCASEEQ (pattern, ".*", 2))
+    pattern += 2;
+
+  s = xmalloc (strlen (pattern) + 1);
+  for (; *pattern && !STREQ (pattern, "$"); pattern++)
+    {
+      if (pattern[0] == '\\' && pattern[1] == '.')
+	s[len++] = *++pattern;
+      else if (isalnum ((unsigned char) *pattern)
+	       || *pattern == '-' || *pattern == '_')
+	s[len++] = *pattern;
+      else
+	break;
+    }
+  if (!STREQ (pattern, "$") || !len)
+    {
+      free (s);
+      return 0;
+    }
+  *suffix = s;
+  return len;
+}
+
+/*
+ *  Reads all entries of `block' into a new regex block.  Sub-blocks
+ *  become one rule each, using the sub-block name as pattern and its
+ *  whois-server option as host.
+ */
+static struct regex_block *
+regex_block_build (const char *block)
+{
+  struct regex_block *rb;
+  struct regex_rule *r;
+  struct jconfig_cursor cur;
+  struct jconfig *j, *j2;
+  const char *sub, *prev_domain = NULL;
+  char *suffix;
+  size_t len, alloc = 16, blocklen = strlen (block);
+
+  rb = xmalloc (sizeof (struct regex_block));
+  rb->name = xstrdup (block);
+  rb->count = 0;
+  rb->rules = xmalloc (alloc * sizeof (struct regex_rule));
+  rb->compiled = rb->invalid = false;
+  suffix_trie_init (&rb->suffixes);
+  rb->npatterns = 0;
+  rb->last_default = -1;
+
+  jconfig_set (&cur);
+  while ((j = jconfig_next_all (&cur, block)) != NULL)
+    {
+      sub = strlen (j->domain) > blocklen ? j->domain + blocklen + 1 : NULL;
+
+      if (!sub && STRCASEEQ (j->key, "type"))
 	continue;
-      if (!STRCASEEQ (j->key, "default"))
+
+      /* A sub-block makes a single rule, whatever its number of options.  */
+      if (sub)
 	{
-	  memset(entry_ip.s6_addr, 0, sizeof(entry_ip.s6_addr));
-	  bits = 0;
+	  if (prev_domain && STRCASEEQ (prev_domain, j->domain))
+	    continue;
+	  prev_domain = j->domain;
+	  j2 = jconfig_getone (j->domain, "whois-server");
+	  if (!j2)
+	    continue;
 	}
-      else
-	{
-	  size_t len;
 
-	  p = strchr(j->key, '/');
-	  if (p == NULL)
-	    {
-              printf (_("[%s: Missing prefix length on line %d]\n"),
-                      arguments->config, j->line);
-	      continue;
-	    }
-	  if (sscanf(p + 1, "%u", &bits) != 1 || bits > 128)
-	    {
-              printf (_("[%s: Invalid prefix length on line %d]\n"),
-                      arguments->config, j->line);
-	      continue;
-	    }
-	  len = p - j->key;
-	  addr = xmalloc (len + 1);
-	  memcpy(addr, j->key, len);
-	  addr[len] = '\0';
-	  res = inet_pton(AF_INET6, addr, &entry_ip);
-	  free(addr);
-          if (res != 1)
-            {
-              printf (_("[%s: Invalid network address on line %d]\n"),
-                      arguments->config, j->line);
-              continue;
-            }
+      if (rb->count == alloc)
+	{
+	  alloc *= 2;
+	  rb->rules = xrealloc (rb->rules, alloc * sizeof (struct regex_rule));
 	}
-      if (ipv6_address_is_in_network(&query_ip, &entry_ip, bits)
-	  && bits <= max_bits && bits >= match_bits)
+      r = &rb->rules[rb->count];
+      r->j = j;
+      r->host = sub ? j2->value : j->value;
+      r->domain = sub ? j->domain : NULL;
+      r->pattern = sub ? sub : j->key;
+      r->is_default = (STRCASEEQ (j->key, "default")
+		       || (sub && (STRCASEEQ (sub, ".*")
+				   || STRCASEEQ (sub, "default"))));
+
+      r->is_suffix = false;
+
+      if (r->is_default)
+	rb->last_default = rb->count;
+      else if ((len = regex_suffix_literal (r->pattern, &suffix)))
 	{
-	  host = j->value;
-	  match_bits = bits;
+	  r->is_suffix = true;
+	  suffix_trie_insert (&rb->suffixes, suffix, len, rb->count);
+	  free (suffix);
 	}
+      rb->count++;
     }
-  jconfig_end();
 
-  return host;
+  rb->patterns = xmalloc ((rb->count + 1) * sizeof (int));
+  for (size_t i = 0; i < rb->count; i++)
+    if (!rb->rules[i].is_default && !rb->rules[i].is_suffix)
+      rb->patterns[rb->npatterns++] = i;
+
+  rb->next = regex_blocks;
+  regex_blocks = rb;
+  return rb;
+}
+
+/*
+ *  Compiles the patterns of `rb'.
+ */
+static void
+regex_block_compile (struct regex_block *rb)
+{
+  struct regex_rule *r;
+
+  if (!case_fold['a'])
+    for (int i = 0; i < 256; i++)
+      case_fold[i] = toupper (i);
+
+  for (size_t i = 0; i < rb->npatterns; i++)
+    {
+      r = &rb->rules[rb->patterns[i]];
+      if (regex_rule_compile (&r->rpb, r->pattern) < 0)
+	{
+	  rb->invalid = true;
+	  break;
+	}
+    }
+  rb->compiled = true;
+}
+
+/*
+ *  Returns the rules of `block', reading them on first use.
+ */
+static struct regex_block *
+regex_block_get (const char *block)
+{
+  struct regex_block *rb;
+
+  for (rb = regex_blocks; rb; rb = rb->next)
+    if (STRCASEEQ (rb->name, block))
+      return rb;
+
+  return regex_block_build (block);
 }
-#endif
 
 /*
  *  Looks up a string `val' against `block'. Returns a pointer to
  *  a hostname if found, or else NULL. It doesn't necessarily have to
  *  be a hostname though, but can be any general string.
+ *
+ *  The result is the one of trying every rule in order, keeping the
+ *  longest match and the last one among equally long matches, and using
+ *  'default' rules only while nothing longer than the empty string has
+ *  matched.  Literal suffixes are all looked up in a single walk of the
+ *  suffix trie; only the remaining patterns are searched one by one.
  */
 char *
 find_regex (whois_query_t wq, const char *block)
 {
-  struct jconfig *j, *j2;
-  struct re_pattern_buffer rpb;
-  struct re_registers regs;
-  char *error, *match = NULL, *pattern;
-  int ind, i, best_match;
-  unsigned char case_fold[256];
-
-  rpb.allocated = 0;
-
-  for (i = 0; i < 256; i++)
-    case_fold[i] = toupper(i);
+  struct regex_block *rb;
+  struct regex_rule *r;
+  regoff_t starts[2], ends[2];
+  struct re_registers regs = { 2, starts, ends };
+  int ind, best;
+  size_t i, len, best_match = 0;
+  size_t qlen = strlen (wq->query);
+
+  rb = regex_block_get (block);
+  if (!rb->compiled)
+    regex_block_compile (rb);
+  if (rb->invalid)
+    return NULL;
 
-  best_match = 0;
+  best = suffix_trie_match (&rb->suffixes, wq->query, qlen, &best_match);
 
-  jconfig_set();
-  while ((j = jconfig_next_all(block)) != NULL)
+  for (i = 0; i < rb->npatterns; i++)
     {
-      if ((STRCASEEQ (j->key, "default")
-           || ((strlen (j->domain) > strlen (block) + 1)
-               && (STRCASEEQ (j->domain + strlen (block) + 1, ".*")
-                   || STRCASEEQ (j->domain + strlen (block) + 1, "default") == 0)))
-          && !best_match)
-        {
-          if (strlen(j->domain) > strlen(block))
-            {
-              j2 = jconfig_getone(j->domain, "whois-server");
-              if (j2)
-                {
-                  wq->domain = j->domain;
-                  match = j2->value;
-                }
-            }
-          else
-            {
-              match = j->value;
-            }
-        }
-      else if (!STRCASEEQ (j->key, "type"))
+      r = &rb->rules[rb->patterns[i]];
+      ind = re_search (&r->rpb, wq->query, qlen, 0, qlen, &regs);
+      if (ind >= 0)
 	{
-	  if (rpb.allocated) {
-	    free(rpb.buffer);
-	    free(rpb.fastmap);
-	    if (rpb.regs_allocated != REGS_UNALLOCATED)
-	      {
-		free(regs.start);
-		free(regs.end);
-		rpb.regs_allocated = REGS_UNALLOCATED;
-	      }
-	  }
-	  rpb.allocated = 0;
-	  rpb.buffer = NULL;
-	  rpb.translate = case_fold;
-	  rpb.fastmap = (char *)NULL;
-
-	  if (strlen(j->domain) > strlen(block))
+	  len = regs.end[1] - regs.start[1];
+	  if (len > best_match || (len == best_match && rb->patterns[i] > best))
 	    {
-              pattern = xmalloc (strlen (j->domain + strlen (block)) + 6);
-              strncpy(pattern, "\\(", 3);
-
-              if (STRNCASEEQ (j->domain + strlen (block) + 1, ".*", 2))
-                strncat(pattern, j->domain+strlen(block)+3,
-                        strlen(j->domain+strlen(block)+3)+1);
-              else
-                strncat(pattern, j->domain+strlen(block)+1,
-                        strlen(j->domain+strlen(block)+1)+1);
-              strncat(pattern, "\\)", 3);
-
-	      error = (char *)re_compile_pattern(pattern, strlen(pattern), &rpb);
-	      free(pattern);
-	      if (error != NULL)
-		{
-		  return NULL;
-		}
-	      ind = re_search(&rpb, wq->query, strlen(wq->query), 0,
-                              strlen(wq->query), &regs);
-	      if (ind >= 0 && regs.num_regs >= 1)
-		{
-		  j2 = jconfig_getone(j->domain, "whois-server");
-		  if (j2 && (regs.end[1] - regs.start[1]) >= best_match)
-                    {
-		      wq->domain = j->domain;
-                      best_match = regs.end[1] - regs.start[1];
-                      match = j2->value;
-                    }
-		}
-	      else if (ind == -2 || ind == 0)
-		{
-		  return NULL;
-		}
-	    }
-	  else
-	    {
-              pattern = xmalloc (strlen (j->key) + 6);
-              strncpy(pattern, "\\(", 3);
-              if (STRNCASEEQ (j->key, ".*", 2))
-                strncat(pattern, j->key + 2, strlen(j->key+2)+1);
-              else
-                strncat(pattern, j->key, strlen(j->key)+1);
-
-              strncat(pattern, "\\)", 3);
-              error = (char *)re_compile_pattern(pattern, strlen(pattern),&rpb);
-	      free(pattern);
-	      if (error != NULL)
-		{
-		  return NULL;
-		}
-	      ind = re_search(&rpb, wq->query, strlen(wq->query), 0,
-                              strlen(wq->query), &regs);
-
-	      if (ind >= 0 && regs.num_regs >= 1)
-		{
-                  if ((regs.end[1]-regs.start[1]) >= best_match)
-                    {
-                      best_match = regs.end[1]-regs.start[1];
-                      match = j->value;
-                    }
-		}
-	      else if (ind == -2 || ind == 0)
-		{
-		  return NULL;
-		}
+	      best_match = len;
+	      best = rb->patterns[i];
 	    }
-        }
+	}
+      else if (ind == -2)
+	return NULL;
     }
 
-  if (rpb.allocated)
+  if (!best_match && rb->last_default > best)
+    best = rb->last_default;
+  if (best < 0)
+    return NULL;
+
+  r = &rb->rules[best];
+  if (r->domain)
+    wq->domain = (char *) r->domain;
+  return (char *) r->host;
+}
+
+/*
+ *  Reads the regex blocks reachable from `block', so that queries only
+ *  have to run the searches.  The radix trees of the cidr blocks, whose
+ *  errors are printed as they are built, are left to the first IP
+ *  address looked up, unless the configuration is compiled.
+ */
+static void
+lookup_init_block (const char *block)
+{
+  struct regex_block *rb;
+  struct jconfig *j;
+  char *sub;
+
+  for (rb = regex_blocks; rb; rb = rb->next)
+    if (STRCASEEQ (rb->name, block))
+      return;
+
+  j = jconfig_getone (block, "type");
+  if (j && STRNCASEEQ (j->value, "cidr6", 5))
+    {
+#ifdef HAVE_INET_PTON_IPV6
+      if (arguments->compile_config)
+	cidr_block_get (block, AF_INET6);
+#endif
+      return;
+    }
+  if (j && !STRNCASEEQ (j->value, "regex", 5))
+    {
+      if (arguments->compile_config)
+	cidr_block_get (block, AF_INET);
+      return;
+    }
+
+  rb = regex_block_build (block);
+  for (size_t i = 0; i < rb->count; i++)
+    if (STRNCASEEQ (rb->rules[i].host, "struct", 6))
+      {
+	sub = xmalloc (strlen (rb->rules[i].host + 7) + 8);
+	sprintf (sub, "jwhois|%s", rb->rules[i].host + 7);
+	lookup_init_block (sub);
+	free (sub);
+      }
+}
+
+void
+lookup_init (void)
+{
+  lookup_init_block ("jwhois|whois-servers");
+}
+
+/* Layout of the routing tables in an image.  Entries of the configuration
+   are referred to by index, and the radix trees and suffix tries are
+   stored as they are.  */
+struct lookup_image
+{
+  uint64_t cidr;
+  uint64_t regex;
+  uint32_t ncidr;
+  uint32_t nregex;
+};
+
+struct lookup_image_cidr
+{
+  uint64_t name;
+  uint64_t nodes;
+  uint64_t entries;
+  uint32_t nnodes;
+  uint32_t count;
+
+  /* Length of the addresses, 32 for cidr blocks and 128 for cidr6.  */
+  uint32_t bits;
+  uint32_t invalid;
+};
+
+/* Flags of a rule in an image.  */
+#define LOOKUP_RULE_DEFAULT 1
+#define LOOKUP_RULE_SUFFIX 2
+#define LOOKUP_RULE_SUB 4
+
+struct lookup_image_rule
+{
+  int32_t entry;
+  uint32_t flags;
+};
+
+struct lookup_image_regex
+{
+  uint64_t name;
+  uint64_t rules;
+  uint64_t nodes;
+  uint32_t count;
+  uint32_t nnodes;
+};
+
+uint64_t
+lookup_image_save (struct image_writer *w)
+{
+  struct lookup_image li;
+  struct lookup_image_cidr *ic;
+  struct lookup_image_regex *ir;
+  struct lookup_image_rule *rules;
+  struct cidr_block *cb;
+  struct regex_block *rb;
+  struct regex_rule *r;
+  int32_t *entries;
+  size_t i, n;
+
+  memset (&li, 0, sizeof li);
+  for (cb = cidr_blocks; cb; cb = cb->next)
+    li.ncidr++;
+  for (rb = regex_blocks; rb; rb = rb->next)
+    li.nregex++;
+
+  ic = xcalloc (li.ncidr + 1, sizeof *ic);
+  for (n = 0, cb = cidr_blocks; cb; cb = cb->next, n++)
+    {
+      ic[n].name = image_put (w, cb->name, strlen (cb->name) + 1);
+      ic[n].nodes = image_put (w, cb->tree.nodes,
+			       cb->tree.count * sizeof (struct radix_node));
+      ic[n].nnodes = cb->tree.count;
+      entries = xmalloc ((cb->count + 1) * sizeof (int32_t));
+      for (i = 0; i < cb->count; i++)
+	entries[i] = jconfig_index (cb->entries[i]);
+      ic[n].entries = image_put (w, entries, cb->count * sizeof (int32_t));
+      ic[n].count = cb->count;
+      ic[n].bits = cb->family == AF_INET ? 32 : 128;
+      ic[n].invalid = cb->invalid;
+      free (entries);
+    }
+  li.cidr = image_put (w, ic, li.ncidr * sizeof *ic);
+  free (ic);
+
+  ir = xcalloc (li.nregex + 1, sizeof *ir);
+  for (n = 0, rb = regex_blocks; rb; rb = rb->next, n++)
+    {
+      ir[n].name = image_put (w, rb->name, strlen (rb->name) + 1);
+      ir[n].nodes = image_put (w, rb->suffixes.nodes,
+			       rb->suffixes.count * sizeof (struct suffix_node));
+      ir[n].nnodes = rb->suffixes.count;
+      rules = xcalloc (rb->count + 1, sizeof *rules);
+      for (i = 0; i < rb->count; i++)
+	{
+	  r = &rb->rules[i];
+	  rules[i].entry = jconfig_index (r->j);
+	  rules[i].flags = ((r->is_default ? LOOKUP_RULE_DEFAULT : 0)
+			    | (r->is_suffix ? LOOKUP_RULE_SUFFIX : 0)
+			    | (r->domain ? LOOKUP_RULE_SUB : 0));
+	}
+      ir[n].rules = image_put (w, rules, rb->count * sizeof *rules);
+      ir[n].count = rb->count;
+      free (rules);
+    }
+  li.regex = image_put (w, ir, li.nregex * sizeof *ir);
+  free (ir);
+
+  return image_put (w, &li, sizeof li);
+}
+
+static void
+cidr_block_free (struct cidr_block *cb)
+{
+  free (cb->name);
+  radix_tree_free (&cb->tree);
+  free (cb->entries);
+  free (cb);
+}
+
+/*
+ *  Returns the cidr block stored as `ic' in `img', or NULL if it is
+ *  invalid.
+ */
+static struct cidr_block *
+cidr_block_load (const struct image *img, const struct lookup_image_cidr *ic)
+{
+  const struct radix_node *nodes;
+  const int32_t *entries;
+  const char *name;
+  struct cidr_block *cb;
+  size_t i;
+
+  name = image_get_string (img, ic->name);
+  nodes = image_get (img, ic->nodes, ic->nnodes, sizeof *nodes);
+  entries = image_get (img, ic->entries, ic->count, sizeof *entries);
+  if (!name || !nodes || !ic->nnodes || !entries
+      || (ic->bits != 32 && ic->bits != 128))
+    return NULL;
+
+  /* Nodes are created after their parent, which rules out cycles.  */
+  for (i = 0; i < ic->nnodes; i++)
+    if ((nodes[i].child[0] && (nodes[i].child[0] <= i
+			       || nodes[i].child[0] >= ic->nnodes))
+	|| (nodes[i].child[1] && (nodes[i].child[1] <= i
+				  || nodes[i].child[1] >= ic->nnodes))
+	|| nodes[i].value < -1 || nodes[i].value >= (int64_t) ic->count)
+      return NULL;
+
+  cb = xmalloc (sizeof (struct cidr_block));
+  cb->name = xstrdup (name);
+  cb->family = ic->bits == 32 ? AF_INET : AF_INET6;
+  cb->tree.nodes = (struct radix_node *) nodes;
+  cb->tree.count = ic->nnodes;
+  cb->tree.alloc = 0;
+  cb->count = ic->count;
+  cb->entries = xmalloc ((cb->count + 1) * sizeof (struct jconfig *));
+  cb->invalid = ic->invalid;
+  for (i = 0; i < cb->count; i++)
+    if (!(cb->entries[i] = jconfig_entry (entries[i])))
+      {
+	cidr_block_free (cb);
+	return NULL;
+      }
+  return cb;
+}
+
+static void
+regex_block_free (struct regex_block *rb)
+{
+  free (rb->name);
+  free (rb->rules);
+  suffix_trie_free (&rb->suffixes);
+  free (rb->patterns);
+  free (rb);
+}
+
+/*
+ *  Returns the regex block stored as `ir' in `img', or NULL if it is
+ *  invalid.  Its patterns are compiled when it is first searched.
+ */
+static struct regex_block *
+regex_block_load (const struct image *img,
+		  const struct lookup_image_regex *ir)
+{
+  const struct lookup_image_rule *rules;
+  const struct suffix_node *nodes;
+  const struct jconfig *j, *j2;
+  const char *name;
+  struct regex_block *rb;
+  struct regex_rule *r;
+  size_t i, blocklen;
+
+  name = image_get_string (img, ir->name);
+  nodes = image_get (img, ir->nodes, ir->nnodes, sizeof *nodes);
+  rules = image_get (img, ir->rules, ir->count, sizeof *rules);
+  if (!name || !nodes || !ir->nnodes || !rules)
+    return NULL;
+
+  /* Nodes are created after their parent and after their next sibling,
+     so that walking the trie always ends.  */
+  for (i = 0; i < ir->nnodes; i++)
+    if ((nodes[i].child && (nodes[i].child <= i
+			    || nodes[i].child >= ir->nnodes))
+	|| (nodes[i].sibling && nodes[i].sibling >= i)
+	|| nodes[i].value < -1 || nodes[i].value >= (int64_t) ir->count)
+      return NULL;
+
+  rb = xmalloc (sizeof (struct regex_block));
+  rb->name = xstrdup (name);
+  rb->count = ir->count;
+  rb->rules = xcalloc (rb->count + 1, sizeof (struct regex_rule));
+  rb->suffixes.nodes = (struct suffix_node *) nodes;
+  rb->suffixes.count = ir->nnodes;
+  rb->suffixes.alloc = 0;
+  rb->npatterns = 0;
+  rb->patterns = xmalloc ((rb->count + 1) * sizeof (int));
+  rb->last_default = -1;
+  rb->compiled = rb->invalid = false;
+
+  blocklen = strlen (name);
+  for (i = 0; i < rb->count; i++)
     {
-      free(rpb.buffer);
-      free(rpb.fastmap);
-      if (rpb.regs_allocated != REGS_UNALLOCATED)
+      r = &rb->rules[i];
+      j = jconfig_entry (rules[i].entry);
+      if (!j)
+	goto fail;
+      r->j = j;
+      if (rules[i].flags & LOOKUP_RULE_SUB)
 	{
-	  free(regs.start);
-	  free(regs.end);
+	  j2 = jconfig_getone (j->domain, "whois-server");
+	  if (!j2 || strlen (j->domain) <= blocklen)
+	    goto fail;
+	  r->host = j2->value;
+	  r->domain = j->domain;
+	  r->pattern = j->domain + blocklen + 1;
 	}
+      else
+	{
+	  r->host = j->value;
+	  r->domain = NULL;
+	  r->pattern = j->key;
+	}
+      r->is_default = rules[i].flags & LOOKUP_RULE_DEFAULT;
+      r->is_suffix = rules[i].flags & LOOKUP_RULE_SUFFIX;
+      if (r->is_default)
+	rb->last_default = i;
+      else if (!r->is_suffix)
+	rb->patterns[rb->npatterns++] = i;
     }
+  return rb;
+
+ fail:
+  regex_block_free (rb);
+  return NULL;
+}
+
+int
+lookup_image_load (const struct image *img, uint64_t offset)
+{
+  const struct lookup_image *li;
+  const struct lookup_image_cidr *ic;
+  const struct lookup_image_regex *ir;
+  struct cidr_block *cb, *cidr = NULL;
+  struct regex_block *rb, *regex = NULL;
+  size_t i;
 
-  jconfig_end();
+  li = image_get (img, offset, 1, sizeof *li);
+  if (!li)
+    return -1;
+  ic = image_get (img, li->cidr, li->ncidr, sizeof *ic);
+  ir = image_get (img, li->regex, li->nregex, sizeof *ir);
+  if (!ic || !ir)
+    return -1;
 
-  return match;
+  /* Blocks are loaded backwards to keep the order of the lists.  */
+  for (i = li->ncidr; i-- > 0; )
+    {
+      if (!(cb = cidr_block_load (img, &ic[i])))
+	goto fail;
+      cb->next = cidr;
+      cidr = cb;
+    }
+  for (i = li->nregex; i-- > 0; )
+    {
+      if (!(rb = regex_block_load (img, &ir[i])))
+	goto fail;
+      rb->next = regex;
+      regex = rb;
+    }
+
+  cidr_blocks = cidr;
+  regex_blocks = regex;
+  return 0;
+
+ fail:
+  while ((cb = cidr) != NULL)
+    {
+      cidr = cb->next;
+      cidr_block_free (cb);
+    }
+  while ((rb = regex) != NULL)
+    {
+      regex = rb->next;
+      regex_block_free (rb);
+    }
+  return -1;
 }
 
+/* Copy of the default whois-servers domain.  */
+static char *default_whoisservers;
+
 /*
  *  Looks up a host and port number from the material supplied in `val'
  *  using `block' as starting point.  If `block' is NULL, use
- *  "jwhois.whois-servers" as base.
+ *  "jwhois.whois-servers" as base.  A host in the whois-servers domain
+ *  takes a DNS lookup, which is only made if `resolve' is set.
  *  
  *  Returns: -1   Error
  *           0    Success.
+ *           1    The host is in the whois-servers domain
  */
 int
-lookup_host (whois_query_t wq, const char *block)
+lookup_host (whois_query_t wq, const char *block, bool resolve)
 {
   char deepfreeze[512];
   char *tmpdeep, *tmphost;
+  const char *host = NULL;
   struct jconfig *j;
   char *ret;
 
@@ -393,38 +970,43 @@ lookup_host (whois_query_t wq, const char *block)
   else
     sprintf(deepfreeze, "jwhois|%s", block);
 
-  jconfig_set();
+  /* The default is copied once for all the queries of the run.  */
   j = jconfig_getone("jwhois", "whois-servers-domain");
   if (!j)
-    arguments->whoisservers = xstrdup (WHOIS_SERVERS);
+    {
+      if (!default_whoisservers)
+        default_whoisservers = xstrdup (WHOIS_SERVERS);
+      arguments->whoisservers = default_whoisservers;
+    }
   else
     arguments->whoisservers = j->value;
 
-  jconfig_set();
   j = jconfig_getone(deepfreeze, "type");
   if (!j || STRNCASEEQ (j->value, "regex", 5))
-    wq->host = find_regex(wq, deepfreeze);
+    host = find_regex(wq, deepfreeze);
   else if (STRNCASEEQ (j->value, "cidr6", 5)) {
 #ifdef HAVE_INET_PTON_IPV6
-    wq->host = find_cidr6(wq, deepfreeze);
+    host = find_cidr6(wq, deepfreeze);
 #else
     printf("[%s]\n", _("Warning: Configuration file contains references to IPv6,"));
     printf("[%s]\n", _("         but jwhois was compiled without IPv6 support."));
 #endif
   } else
-    wq->host = find_cidr(wq, deepfreeze);
+    host = find_cidr(wq, deepfreeze);
 
-  if (!wq->host)
-    wq->host = xstrdup (DEFAULT_HOST);
+  /* The host is copied since the port is cut off from it below.  */
+  wq_set_host (wq, host ? host : DEFAULT_HOST);
 
   if (STRNCASEEQ (wq->host, "struct", 6)) {
     tmpdeep = wq->host+7;
-    return lookup_host(wq, tmpdeep);
+    return lookup_host(wq, tmpdeep, resolve);
   }
 
   if (arguments->enable_whoisservers
       && STRNCASEEQ (wq->host, "whois-servers", 13))
     {
+      if (!resolve)
+        return 1;
       printf ("[%s %s]\n", _("Querying"), arguments->whoisservers);
       return lookup_whois_servers (wq->query, wq);
     }
@@ -443,98 +1025,338 @@ lookup_host (whois_query_t wq, const char *block)
   return 0;
 }
 
+/* The patterns of the options of a server-options block with a given
+   key, compiled once and reused for every answer of its servers.  */
+struct pattern_block
+{
+  const char *domain;
+  const char *key;
+  size_t count;
+
+  /* The patterns, of which those which failed to compile are left
+     empty, and the index of the first of those, or COUNT if none.  */
+  struct re_pattern_buffer *patterns;
+  size_t invalid;
+
+  struct pattern_block *next;
+};
+
+/* The blocks compiled so far, for the generation of the configuration
+   they were compiled from.  */
+static struct pattern_block *pattern_blocks = NULL;
+static unsigned int pattern_generation;
+
 /*
- *  This looks through `block' looking for matching hostnames and
- *  then performs a regexp search on the contents of `text'. If found,
- *  returns 1 and sets `host' and `port' accordingly. If `port' is not
- *  found in the match context, sets `port' to 0.
- *  If `block' is NULL, use "jwhois.content-redirect" as base.
+ *  Returns the patterns of the options of the server-options block
+ *  `domain' whose key is `key', or only starts with it if `prefix' is
+ *  set, compiling them on first use.
+ */
+static struct pattern_block *
+pattern_block_get (const char *domain, const char *key, bool prefix)
+{
+  struct pattern_block *pb;
+  struct re_pattern_buffer *rpb;
+  struct jconfig_cursor cur;
+  struct jconfig *j;
+  size_t keylen = strlen (key), i;
+
+  /* The domains and keys are those of the configuration, which only
+     live as long as it does.  */
+  if (pattern_generation != jconfig_generation ())
+    {
+      while ((pb = pattern_blocks))
+	{
+	  pattern_blocks = pb->next;
+	  for (i = 0; i < pb->count; i++)
+	    regfree (&pb->patterns[i]);
+	  free (pb->patterns);
+	  free (pb);
+	}
+      pattern_generation = jconfig_generation ();
+    }
+
+  for (pb = pattern_blocks; pb; pb = pb->next)
+    if (pb->domain == domain && STREQ (pb->key, key))
+      return pb;
+
+  pb = xcalloc (1, sizeof *pb);
+  pb->domain = domain;
+  pb->key = key;
+
+#define PATTERN_KEY(j) (prefix ? STRNCASEEQ ((j)->key, key, keylen) \
+			: STRCASEEQ ((j)->key, key))
+  jconfig_set (&cur);
+  while ((j = jconfig_next (&cur, domain)) != NULL)
+    if (PATTERN_KEY (j))
+      pb->count++;
+  pb->patterns = xcalloc (pb->count ? pb->count : 1, sizeof *pb->patterns);
+
+  pb->invalid = pb->count;
+  rpb = pb->patterns;
+  jconfig_set (&cur);
+  while ((j = jconfig_next (&cur, domain)) != NULL)
+    {
+      if (!PATTERN_KEY (j))
+	continue;
+      rpb->fastmap = xmalloc (256);
+      if (re_compile_pattern (j->value, strlen (j->value), rpb))
+	{
+	  regfree (rpb);
+	  memset (rpb, 0, sizeof *rpb);
+	  if (pb->invalid == pb->count)
+	    pb->invalid = rpb - pb->patterns;
+	}
+      else
+	{
+	  /* Searches fill the registers of the caller.  */
+	  re_compile_fastmap (rpb);
+	  rpb->regs_allocated = REGS_FIXED;
+	}
+      rpb++;
+    }
+#undef PATTERN_KEY
+
+  pb->next = pattern_blocks;
+  pattern_blocks = pb;
+  return pb;
+}
+
+/*
+ *  This redirects `wq' as told by `line', which starts with a match of
+ *  the pattern number `i' of `rb': its first group gives the host to
+ *  query next, and the second one its port, or 0 if there is none. The
+ *  redirection is told in `log', or on the standard output if `log' is
+ *  NULL.
+ *
+ *  Returns: -1   Error
+ *           0    The pattern has no host
+ *           1    Redirected
+ */
+static int
+redirect_follow (whois_query_t wq, struct pattern_block *rb, size_t i,
+		 const char *line, size_t len, struct buffer *log)
+{
+  regoff_t starts[3], ends[3];
+  struct re_registers regs = { 3, starts, ends };
+  char *host, *end;
+  long port;
+
+  re_search (&rb->patterns[i], line, len, 0, 0, &regs);
+  if (starts[1] < 0)
+    return 0;
+
+  len = ends[1] - starts[1];
+  host = xmalloc (len + 1);
+  memcpy (host, line + starts[1], len);
+  host[len] = '\0';
+  free (wq->host);
+  wq->host = host;
+
+  port = 0;
+  if (starts[2] >= 0 && ends[2] > starts[2])
+    {
+      port = strtol (line + starts[2], &end, 10);
+      if (end != line + ends[2] || port < 0 || port > 65535)
+	return -1;
+    }
+  wq->port = port;
+
+  if (log && wq->port)
+    buffer_printf (log, "[%s %s:%d]\n", _("Redirected to"),
+		   wq->host, wq->port);
+  else if (log)
+    buffer_printf (log, "[%s %s]\n", _("Redirected to"), wq->host);
+  else if (wq->port)
+    printf("[%s %s:%d]\n", _("Redirected to"), wq->host, wq->port);
+  else
+    printf("[%s %s]\n", _("Redirected to"), wq->host);
+  wq->domain = NULL;
+  return 1;
+}
+
+/*
+ *  Returns the whois-redirect patterns of the server-options of the host
+ *  of `wq', or NULL if it has none.
+ */
+static struct pattern_block *
+redirect_block_find (whois_query_t wq)
+{
+  const char *domain = get_whois_server_domain_path (wq->host);
+
+  return domain ? pattern_block_get (domain, "whois-redirect", true) : NULL;
+}
+
+/*
+ *  This looks for a line of `text' starting with a match of one of the
+ *  whois-redirect patterns of the server-options of the host of `wq'.
+ *  The first pattern of the configuration which matches a line wins,
+ *  and its first group gives the host to query next, and the second one
+ *  its port, or 0 if there is none.  The lines are read once, trying on
+ *  each the patterns which could still win.  If found, sets the host and
+ *  port of `wq' accordingly, which is told in `log', or on the standard
+ *  output if `log' is NULL.  A pattern which doesn't compile is an error
+ *  once it is tried, when none of the patterns before it matches.
  *
  *  Returns: -1   Error
  *           0    None found
  *           1    Match found
  */
 int
-lookup_redirect (whois_query_t wq, const char *text)
+lookup_redirect (whois_query_t wq, const char *text, struct buffer *log)
 {
+  struct pattern_block *rb;
+  const char *line, *best_line = NULL;
+  size_t len, best = 0, i;
   int ind;
-  char *bptr = NULL, *strptr, *ascport, *ret, *tmphost;
-  struct re_pattern_buffer rpb;
-  struct re_registers regs;
-  struct jconfig *j;
-  char *domain;
 
-  bptr = malloc(strlen(text)+1);
-  if (!bptr)
-    return -1;
-
-  domain = (char *)get_whois_server_domain_path(wq->host);
-  if (!domain)
+  rb = redirect_block_find (wq);
+  if (!rb)
     return 0;
+  best = rb->invalid;
 
-  jconfig_set();
-
-  while ((j = jconfig_next(domain)) != NULL)
+  for (line = text; *line && best > 0; line += len)
     {
-      if (STRNCASEEQ (j->key, "whois-redirect", 14))
+      len = strcspn (line, "\r\n");
+      if (len == 0)
 	{
-	  memcpy(bptr, text, strlen(text)+1);
-
-	  strptr = (char *)strtok(bptr, "\r\n");
-	  while (strptr)
+	  len = 1;
+	  continue;
+	}
+      for (i = 0; i < best; i++)
+	{
+	  ind = re_search (&rb->patterns[i], line, len, 0, 0, NULL);
+	  if (ind == -2)
+	    return -1;
+	  if (ind == 0)
 	    {
-	      rpb.allocated = 0;
-	      rpb.buffer = NULL;
-	      rpb.translate = NULL;
-	      rpb.fastmap = NULL;
-	      if (re_compile_pattern(j->value, strlen(j->value), &rpb))
-		return -1;
-	      ind = re_search(&rpb, strptr, strlen(strptr), 0, 0, &regs);
-	      if (ind == 0)
-		{
-		  wq->host = malloc(regs.end[1]-regs.start[1]+2);
-		  if (!wq->host)
-		    return -1;
-		  
-		  strncpy(wq->host, strptr+regs.start[1],
-			  regs.end[1]-regs.start[1]);
-		  tmphost = wq->host + regs.end[1]-regs.start[1];
-		  *tmphost = '\0';
-
-		  if (regs.num_regs >= 2)
-		    {
-		      ascport = malloc(regs.end[2]-regs.start[2]+2);
-		      if (!ascport)
-			return -1;
-		      strncpy(ascport, strptr+regs.start[2],
-			      regs.end[2]-regs.start[2]);
-		      ascport[regs.end[2]-regs.start[2]]='\0';
-
-		      wq->port = strtol(ascport, &ret, 10);
-		      if (*ret != '\0')
-			{
-			  return -1;
-			}
-		    } /* regs.num_regs == 2 */
-		  if (wq->port)
-		    {
-		      printf("[%s %s:%d]\n", _("Redirected to"), wq->host, wq->port);
-		    }
-		  else
-		    {
-		      printf("[%s %s]\n", _("Redirected to"), wq->host);
-		    }
-                  wq->domain = NULL;
-		  return 1;
-		}
-	      else if (ind == -2)
-		return -1;
-	      strptr = (char *)strtok(NULL, "\r\n");
+	      best = i;
+	      best_line = line;
+	      break;
 	    }
 	}
     }
+  if (!best_line)
+    return rb->invalid < rb->count && text[strspn (text, "\r\n")] ? -1 : 0;
+
+  /* Later lines may have been searched since, so the registers of the
+     match are filled by searching the line again.  */
+  return redirect_follow (wq, rb, best, best_line,
+			  strcspn (best_line, "\r\n"), log);
+}
+
+/*
+ *  This looks among the `len' bytes of complete lines at `text', the
+ *  part of an answer read so far, for a line starting with a match of
+ *  the first whois-redirect pattern of the host of `wq'.  The first such
+ *  line is the one lookup_redirect() follows, whatever the rest of the
+ *  answer.  `wq' is left as it is: if found, the line is stored in
+ *  `*line' and its length in `*n', for lookup_redirect_follow().
+ *
+ *  Returns: -1   Error
+ *           0    None found
+ *           1    Match found
+ */
+int
+lookup_redirect_lines (whois_query_t wq, const char *text, size_t len,
+		       const char **line, size_t *n)
+{
+  struct pattern_block *rb;
+  const char *end = text + len;
+  size_t k;
+  int ind;
+
+  rb = redirect_block_find (wq);
+  if (!rb || rb->count == 0)
+    return 0;
+
+  for (; text < end; text += k ? k : 1)
+    {
+      for (k = 0; text + k < end && text[k] != '\r' && text[k] != '\n'; k++)
+	;
+      if (k == 0)
+	continue;
+      if (rb->invalid == 0)
+	return -1;
+      ind = re_search (&rb->patterns[0], text, k, 0, 0, NULL);
+      if (ind == -2)
+	return -1;
+      if (ind == 0)
+	{
+	  *line = text;
+	  *n = k;
+	  return 1;
+	}
+    }
   return 0;
 }
+
+/*
+ *  This redirects `wq', whose host is the one which answered `line', as
+ *  lookup_redirect() would, where `line' of `n' bytes was found by
+ *  lookup_redirect_lines().  The redirection is told in `log'.
+ *
+ *  Returns: -1   Error
+ *           0    The line has no host
+ *           1    Redirected
+ */
+int
+lookup_redirect_follow (whois_query_t wq, const char *line, size_t n,
+			struct buffer *log)
+{
+  struct pattern_block *rb = redirect_block_find (wq);
+
+  if (!rb || rb->count == 0)
+    return 0;
+  return redirect_follow (wq, rb, 0, line, n, log);
+}
+
+/* Number of times a query is tried again when the host answers that its
+   rate limit was exceeded, unless set by the rate-limit-retries option.  */
+#define LOOKUP_RATE_LIMIT_RETRIES 5
+
+/*
+ *  This matches `text', the answer of the host of `wq' to try number
+ *  `tries' of a query, counted from 0, against the rate-limit patterns
+ *  of the host. The delay before the next try doubles with each try.
+ *
+ *  Returns: -1   The rate limit was exceeded and no try is left
+ *           0    The answer is not about the rate limit
+ *           >0   Number of seconds to wait before trying again
+ */
+int
+lookup_rate_limit (whois_query_t wq, const char *text, int tries)
+{
+  struct pattern_block *pb;
+  const char *domain, *value;
+  int matched = 0, retries = LOOKUP_RATE_LIMIT_RETRIES, len;
+  char *end;
+  long n;
+  size_t i;
+
+  domain = get_whois_server_domain_path (wq->host);
+  if (!domain)
+    return 0;
+
+  /* Patterns which don't compile are skipped.  */
+  pb = pattern_block_get (domain, "rate-limit", false);
+  len = strlen (text);
+  for (i = 0; !matched && i < pb->count; i++)
+    if (pb->patterns[i].buffer)
+      matched = re_search (&pb->patterns[i], text, len, 0, len, NULL) >= 0;
+  if (!matched)
+    return 0;
+
+  value = get_whois_server_option (wq->host, "rate-limit-retries");
+  if (value)
+    {
+      n = strtol (value, &end, 10);
+      if (end != value && *end == '\0' && n >= 0 && n <= INT_MAX)
+	retries = n;
+    }
+  if (tries >= retries)
+    return -1;
+  return 1 << (tries < 8 ? tries : 8);
+}
  
 
 /*
@@ -549,12 +1371,8 @@ lookup_redirect (whois_query_t wq, const char *text)
 int
 lookup_whois_servers (const char *val, whois_query_t wq)
 {
-  char *hostname;
-  struct hostent *hostent;
+  char *hostname, *canonname;
   char *tmpptr;
-#ifdef HAVE_GETIPNODEBYNAME
-  int error_num;
-#endif
 
   if (!val) return -1;
   if (*val == '\0') return -1;
@@ -565,12 +1383,9 @@ lookup_whois_servers (const char *val, whois_query_t wq)
   strncat (hostname, arguments->whoisservers,
            strlen (arguments->whoisservers));
 
-#ifdef HAVE_GETIPNODEBYNAME
-  hostent = (struct hostent *)getipnodebyname(hostname, AF_INET, 0, &error_num);
-#else
-  hostent = gethostbyname(hostname);
-#endif
-  if (!hostent)
+  canonname = resolve_canonical (hostname);
+  free (hostname);
+  if (!canonname)
     {
       tmpptr = (char *)strchr(val, '.');
       if (tmpptr)
@@ -581,7 +1396,8 @@ lookup_whois_servers (const char *val, whois_query_t wq)
   else
     {
       wq->port = 0;
-      wq->host = hostent->h_name;
+      wq_set_host (wq, canonname);
+      free (canonname);
       return 0;
     }
 }
@@ -19,10 +19,30 @@
 #ifndef LOOKUP_H
 #define LOOKUP_H
 
+#include <stdbool.h>
+#include "image.h"
 #include "whois.h"
 
-int lookup_host (whois_query_t, const char *);
-int lookup_redirect (whois_query_t, const char *);
+/* Build the routing tables of the configuration, unless they were loaded
+   from an image.  Those of IP addresses are only built when the
+   configuration is compiled, or else on first use.  */
+void lookup_init (void);
+
+/* Store the routing tables in an image, and return their offset.  */
+uint64_t lookup_image_save (struct image_writer *);
+
+/* Load the routing tables at the offset of an image, once the
+   configuration they were built from has been loaded.  Return 0 on
+   success, or -1 if the image is invalid.  */
+int lookup_image_load (const struct image *, uint64_t);
+
+int lookup_host (whois_query_t, const char *, bool);
+int lookup_redirect (whois_query_t, const char *, struct buffer *);
+int lookup_redirect_lines (whois_query_t, const char *, size_t,
+                           const char **, size_t *);
+int lookup_redirect_follow (whois_query_t, const char *, size_t,
+                            struct buffer *);
+int lookup_rate_limit (whois_query_t, const char *, int);
 char *lookup_query_format (whois_query_t);
 
 #endif
@@ -0,0 +1,744 @@
+/* mapcache.c - memory mapped cache
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Specification.  */
+#include "mapcache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H
+
+#define MAPCACHE_MAGIC "JWHOISMC"
+#define MAPCACHE_VERSION 2
+
+/* Written in native byte order, to recognize files of other machines.  */
+#define MAPCACHE_BYTE_ORDER 0x01020304u
+
+#define MAPCACHE_MODE (S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP)
+
+/* Number of slots and room for records of a new file.  */
+#define MAPCACHE_SLOTS 1024
+#define MAPCACHE_LOG_SIZE 65536
+
+/* Start of a map cache file.  The hash table follows at offset
+   MAPCACHE_TABLE, then the records from offset LOG.  LIVE is the size
+   of the latest records of the keys, the others being garbage.  CLOCK
+   is increased by every store and fetch.  Only USED, END, LIVE and
+   CLOCK change during the life of a file.  */
+struct mapcache_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t slots;
+  uint64_t used;
+  uint64_t log;
+  uint64_t end;
+  uint64_t live;
+  uint64_t clock;
+};
+
+#define MAPCACHE_TABLE 64
+
+/* A slot of the hash table, which is empty while OFFSET is 0.  */
+struct mapcache_slot {
+  uint64_t hash;
+  uint64_t offset;
+};
+
+/* A record, followed by its key, its text and a null byte, and padded
+   to a multiple of 8 bytes.  TICK is the clock of the file when it was
+   last stored or fetched, which readers update without lock.  */
+struct mapcache_record {
+  uint64_t hash;
+  int64_t time;
+  uint64_t tick;
+  uint32_t key_len;
+  uint32_t text_len;
+};
+
+/* A record kept by mapcache_rebuild().  */
+struct mapcache_entry {
+  uint64_t offset;
+  uint64_t size;
+  uint64_t tick;
+};
+
+#define HEADER(mc) ((struct mapcache_header *) (mc)->map)
+#define SLOTS(mc) ((struct mapcache_slot *) ((mc)->map + MAPCACHE_TABLE))
+
+/*
+ *  FNV-1a hash of the `len' bytes of `key'.
+ */
+static uint64_t
+mapcache_hash (const char *key, size_t len)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+
+  while (len--)
+    {
+      hash ^= (unsigned char) *key++;
+      hash *= 0x100000001b3ull;
+    }
+  return hash;
+}
+
+static uint64_t
+mapcache_record_size (uint64_t key_len, uint64_t text_len)
+{
+  return (sizeof (struct mapcache_record) + key_len + text_len + 1 + 7)
+    & ~(uint64_t) 7;
+}
+
+/*
+ *  Checks that the `len' bytes at `map' start with a header this
+ *  version can use.
+ */
+static bool
+mapcache_valid (const char *map, size_t len)
+{
+  const struct mapcache_header *h = (const struct mapcache_header *) map;
+
+  if (len < MAPCACHE_TABLE
+      || memcmp (h->magic, MAPCACHE_MAGIC, sizeof h->magic)
+      || h->version != MAPCACHE_VERSION
+      || h->byte_order != MAPCACHE_BYTE_ORDER)
+    return false;
+  if (h->slots == 0 || (h->slots & (h->slots - 1))
+      || h->slots > (len - MAPCACHE_TABLE) / sizeof (struct mapcache_slot)
+      || h->log != MAPCACHE_TABLE + h->slots * sizeof (struct mapcache_slot))
+    return false;
+  return h->log <= h->end && h->end <= len && h->used < h->slots
+    && h->live <= h->end - h->log;
+}
+
+/*
+ *  Maps the whole file of `mc', replacing any previous mapping.
+ *  Returns -1 on error, 0 on success.
+ */
+static int
+mapcache_map (struct mapcache *mc)
+{
+  struct stat st;
+  char *map;
+
+  if (fstat (mc->fd, &st) < 0)
+    return -1;
+  map = mmap (NULL, st.st_size,
+              mc->writable ? PROT_READ | PROT_WRITE : PROT_READ,
+              MAP_SHARED, mc->fd, 0);
+  if (map == MAP_FAILED)
+    return -1;
+  if (!mapcache_valid (map, st.st_size))
+    {
+      munmap (map, st.st_size);
+      errno = EINVAL;
+      return -1;
+    }
+
+  if (mc->map)
+    munmap (mc->map, mc->len);
+  mc->map = map;
+  mc->len = st.st_size;
+  mc->dev = st.st_dev;
+  mc->ino = st.st_ino;
+  return 0;
+}
+
+/*
+ *  Creates a temporary file next to `name', with an empty hash table of
+ *  `slots' slots and room for `room' bytes of records. Returns its
+ *  descriptor and stores its name in `*tmp', or returns -1 on error.
+ */
+static int
+mapcache_create (const char *name, uint64_t slots, uint64_t room, char **tmp)
+{
+  struct mapcache_header h;
+  int fd, saved_errno;
+
+  *tmp = xmalloc (strlen (name) + 8);
+  sprintf (*tmp, "%s.XXXXXX", name);
+  fd = mkstemp (*tmp);
+  if (fd < 0)
+    {
+      free (*tmp);
+      return -1;
+    }
+
+  memset (&h, 0, sizeof h);
+  memcpy (h.magic, MAPCACHE_MAGIC, sizeof h.magic);
+  h.version = MAPCACHE_VERSION;
+  h.byte_order = MAPCACHE_BYTE_ORDER;
+  h.slots = slots;
+  h.log = MAPCACHE_TABLE + slots * sizeof (struct mapcache_slot);
+  h.end = h.log;
+
+  if (fchmod (fd, MAPCACHE_MODE) < 0 || ftruncate (fd, h.log + room) < 0
+      || pwrite (fd, &h, sizeof h, 0) != sizeof h)
+    {
+      saved_errno = errno;
+      close (fd);
+      unlink (*tmp);
+      free (*tmp);
+      errno = saved_errno;
+      return -1;
+    }
+  return fd;
+}
+
+/*
+ *  Opens and maps the file named after `mc', creating it if it doesn't
+ *  exist. Returns -1 on error, 0 on success.
+ */
+static int
+mapcache_attach (struct mapcache *mc)
+{
+  char *tmp;
+  int fd, saved_errno;
+
+  mc->writable = true;
+  mc->fd = open (mc->name, O_RDWR);
+  if (mc->fd < 0 && (errno == EACCES || errno == EROFS))
+    {
+      mc->writable = false;
+      mc->fd = open (mc->name, O_RDONLY);
+    }
+  else if (mc->fd < 0 && errno == ENOENT)
+    {
+      fd = mapcache_create (mc->name, MAPCACHE_SLOTS, MAPCACHE_LOG_SIZE, &tmp);
+      if (fd < 0)
+        return -1;
+
+      /* Unlike rename, link leaves alone a file created meanwhile by
+         another process.  */
+      if (link (tmp, mc->name) < 0 && errno != EEXIST)
+        {
+          saved_errno = errno;
+          close (fd);
+          unlink (tmp);
+          free (tmp);
+          errno = saved_errno;
+          return -1;
+        }
+      close (fd);
+      unlink (tmp);
+      free (tmp);
+      mc->fd = open (mc->name, O_RDWR);
+    }
+  if (mc->fd < 0)
+    return -1;
+
+  if (mapcache_map (mc) < 0)
+    {
+      saved_errno = errno;
+      close (mc->fd);
+      mc->fd = -1;
+      errno = saved_errno;
+      return -1;
+    }
+  return 0;
+}
+
+static void
+mapcache_detach (struct mapcache *mc)
+{
+  if (mc->map)
+    munmap (mc->map, mc->len);
+  mc->map = NULL;
+  mc->len = 0;
+  if (mc->fd >= 0)
+    close (mc->fd);
+  mc->fd = -1;
+}
+
+/*
+ *  Follows the changes made to the file by other processes: maps the
+ *  records they appended, or switches to the file that replaced it.
+ *  Returns -1 on error, 0 on success.
+ */
+static int
+mapcache_refresh (struct mapcache *mc)
+{
+  struct stat st;
+
+  if (mc->map && stat (mc->name, &st) == 0
+      && st.st_dev == mc->dev && st.st_ino == mc->ino)
+    return (size_t) st.st_size > mc->len ? mapcache_map (mc) : 0;
+
+  mapcache_detach (mc);
+  return mapcache_attach (mc);
+}
+
+/*
+ *  Waits for the lock of the current file of `mc', which is released
+ *  by mapcache_unlock(). Returns -1 on error, 0 on success.
+ */
+static int
+mapcache_lock (struct mapcache *mc)
+{
+  struct flock fl;
+  dev_t dev;
+  ino_t ino;
+
+  memset (&fl, 0, sizeof fl);
+  fl.l_type = F_WRLCK;
+  fl.l_whence = SEEK_SET;
+  while (1)
+    {
+      if (mapcache_refresh (mc) < 0)
+        return -1;
+      if (!mc->writable)
+        {
+          errno = EACCES;
+          return -1;
+        }
+
+      dev = mc->dev;
+      ino = mc->ino;
+      while (fcntl (mc->fd, F_SETLKW, &fl) < 0)
+        if (errno != EINTR)
+          return -1;
+
+      /* The file may have been replaced while waiting, in which case
+         closing it released the lock.  */
+      if (mapcache_refresh (mc) < 0)
+        return -1;
+      if (mc->dev == dev && mc->ino == ino)
+        return 0;
+    }
+}
+
+static void
+mapcache_unlock (struct mapcache *mc)
+{
+  struct flock fl;
+
+  memset (&fl, 0, sizeof fl);
+  fl.l_type = F_UNLCK;
+  fl.l_whence = SEEK_SET;
+  fcntl (mc->fd, F_SETLK, &fl);
+}
+
+/*
+ *  Returns the record at `offset' in the mapping of `mc', or NULL if it
+ *  doesn't lie entirely inside.
+ */
+static const struct mapcache_record *
+mapcache_record (const struct mapcache *mc, uint64_t offset)
+{
+  const struct mapcache_record *r;
+
+  if (offset < HEADER (mc)->log || offset % 8
+      || offset > mc->len - sizeof *r)
+    return NULL;
+  r = (const struct mapcache_record *) (mc->map + offset);
+  if (mapcache_record_size (r->key_len, r->text_len) > mc->len - offset)
+    return NULL;
+  return r;
+}
+
+/*
+ *  Returns the index of the slot of `key' in the hash table of `mc', or
+ *  of the empty slot where it belongs, or -1 if neither was found.
+ */
+static int64_t
+mapcache_find (const struct mapcache *mc, const char *key, size_t key_len,
+               uint64_t hash)
+{
+  const struct mapcache_slot *slots = SLOTS (mc);
+  const struct mapcache_record *r;
+  uint64_t mask = HEADER (mc)->slots - 1;
+  uint64_t i, n, offset;
+
+  for (i = hash & mask, n = 0; n <= mask; i = (i + 1) & mask, n++)
+    {
+      /* Pairs with the release in mapcache_store(), so that the record
+         is seen complete.  */
+      offset = __atomic_load_n (&slots[i].offset, __ATOMIC_ACQUIRE);
+      if (offset == 0)
+        return i;
+      if (slots[i].hash != hash)
+        continue;
+      r = mapcache_record (mc, offset);
+      if (r && r->key_len == key_len
+          && memcmp ((const char *) (r + 1), key, key_len) == 0)
+        return i;
+    }
+  return -1;
+}
+
+/*
+ *  Maps at least `end' bytes of the file of `mc', extending it if
+ *  needed. Called with the lock. Returns -1 on error, 0 on success.
+ */
+static int
+mapcache_grow (struct mapcache *mc, uint64_t end)
+{
+  uint64_t len = mc->len;
+
+  if (end <= len)
+    return 0;
+  while (len < end)
+    len *= 2;
+  if (mc->max_size && len > HEADER (mc)->log + mc->max_size)
+    len = end > HEADER (mc)->log + mc->max_size
+      ? end : HEADER (mc)->log + mc->max_size;
+  if (ftruncate (mc->fd, len) < 0)
+    return -1;
+  return mapcache_map (mc);
+}
+
+/*
+ *  Orders entries from the most recently fetched.
+ */
+static int
+mapcache_entry_compare (const void *a, const void *b)
+{
+  const struct mapcache_entry *x = a, *y = b;
+
+  return (x->tick < y->tick) - (x->tick > y->tick);
+}
+
+/*
+ *  Copies the latest record of every key to a new file, leaving room for
+ *  `room' more bytes of records, and replaces the file of `mc' with it.
+ *  Expired records are dropped, and so are the least recently fetched
+ *  ones while the limits of `mc' are exceeded, down to three quarters
+ *  of them so that the next rebuild is some time away. Called with the
+ *  lock, which is held on the new file on return. Returns -1 on error,
+ *  0 on success.
+ */
+static int
+mapcache_rebuild (struct mapcache *mc, uint64_t room)
+{
+  const struct mapcache_header *h = HEADER (mc);
+  const struct mapcache_record *r;
+  struct mapcache_header *nh;
+  struct mapcache_slot *ns;
+  struct mapcache_entry *entries;
+  struct flock fl;
+  struct stat st;
+  uint64_t i, j, n, offset, slots, size, live = 0;
+  time_t now = time (NULL);
+  char *tmp, *map;
+  int fd, saved_errno;
+
+  entries = xcalloc (h->used + 1, sizeof *entries);
+  for (i = n = 0; i < h->slots && n < h->used; i++)
+    {
+      if (!(offset = SLOTS (mc)[i].offset)
+          || !(r = mapcache_record (mc, offset)))
+        continue;
+      if (mc->max_age && r->time + mc->max_age < now)
+        continue;
+      entries[n].offset = offset;
+      entries[n].size = mapcache_record_size (r->key_len, r->text_len);
+      entries[n].tick = r->tick;
+      live += entries[n++].size;
+    }
+
+  if ((mc->max_entries && n + 1 > mc->max_entries)
+      || (mc->max_size && live + room > mc->max_size))
+    {
+      qsort (entries, n, sizeof *entries, mapcache_entry_compare);
+      if (mc->max_entries && n + 1 > mc->max_entries)
+        n = mc->max_entries - mc->max_entries / 4 - 1;
+      for (i = 0, live = 0; i < n; i++)
+        {
+          if (mc->max_size
+              && live + entries[i].size + room > mc->max_size / 4 * 3)
+            break;
+          live += entries[i].size;
+        }
+      n = i;
+    }
+
+  for (slots = MAPCACHE_SLOTS; slots < 2 * (n + 1); slots *= 2)
+    ;
+  size = 2 * (live + room);
+  if (mc->max_size && size > mc->max_size)
+    size = live + room > mc->max_size ? live + room : mc->max_size;
+  if (size < MAPCACHE_LOG_SIZE)
+    size = MAPCACHE_LOG_SIZE;
+  fd = mapcache_create (mc->name, slots, size, &tmp);
+  if (fd < 0)
+    {
+      free (entries);
+      return -1;
+    }
+
+  /* Processes opening the new file wait until it is complete.  */
+  memset (&fl, 0, sizeof fl);
+  fl.l_type = F_WRLCK;
+  fl.l_whence = SEEK_SET;
+  if (fcntl (fd, F_SETLK, &fl) < 0 || fstat (fd, &st) < 0)
+    goto fail;
+  map = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    goto fail;
+
+  nh = (struct mapcache_header *) map;
+  ns = (struct mapcache_slot *) (map + MAPCACHE_TABLE);
+  for (i = 0; i < n; i++)
+    {
+      r = (const struct mapcache_record *) (mc->map + entries[i].offset);
+      memcpy (map + nh->end, r, entries[i].size);
+      for (j = r->hash & (slots - 1); ns[j].offset; j = (j + 1) & (slots - 1))
+        ;
+      ns[j].hash = r->hash;
+      ns[j].offset = nh->end;
+      nh->end += entries[i].size;
+      nh->used++;
+    }
+  nh->live = live;
+  nh->clock = h->clock;
+
+  if (rename (tmp, mc->name) < 0)
+    {
+      saved_errno = errno;
+      munmap (map, st.st_size);
+      errno = saved_errno;
+      goto fail;
+    }
+  free (tmp);
+  free (entries);
+
+  /* Closing the old file releases its lock, and the processes waiting
+     for it move on to the new one.  */
+  mapcache_detach (mc);
+  mc->fd = fd;
+  mc->map = map;
+  mc->len = st.st_size;
+  mc->dev = st.st_dev;
+  mc->ino = st.st_ino;
+  return 0;
+
+ fail:
+  saved_errno = errno;
+  close (fd);
+  unlink (tmp);
+  free (tmp);
+  free (entries);
+  errno = saved_errno;
+  return -1;
+}
+
+int
+mapcache_open (struct mapcache *mc, const char *name)
+{
+  mc->name = xstrdup (name);
+  mc->fd = -1;
+  mc->map = NULL;
+  mc->len = 0;
+  mc->max_size = 0;
+  mc->max_entries = 0;
+  mc->max_age = 0;
+  if (mapcache_attach (mc) < 0)
+    {
+      int saved_errno = errno;
+
+      free (mc->name);
+      mc->name = NULL;
+      errno = saved_errno;
+      return -1;
+    }
+  return 0;
+}
+
+void
+mapcache_close (struct mapcache *mc)
+{
+  mapcache_detach (mc);
+  free (mc->name);
+  mc->name = NULL;
+}
+
+int
+mapcache_store (struct mapcache *mc, const char *key, const char *text,
+                size_t len, time_t time)
+{
+  struct mapcache_header *h;
+  struct mapcache_slot *s;
+  struct mapcache_record *r;
+  const struct mapcache_record *old;
+  size_t key_len = strlen (key);
+  uint64_t hash = mapcache_hash (key, key_len);
+  uint64_t size, offset;
+  int64_t i;
+  bool fresh;
+
+  if (key_len > UINT32_MAX || len > UINT32_MAX)
+    {
+      errno = EFBIG;
+      return -1;
+    }
+  size = mapcache_record_size (key_len, len);
+
+  if (mapcache_lock (mc) < 0)
+    return -1;
+
+  h = HEADER (mc);
+  i = mapcache_find (mc, key, key_len, hash);
+  fresh = i < 0 || SLOTS (mc)[i].offset == 0;
+
+  /* Rebuild the file when the hash table is half full, when the limits
+     would be exceeded, or when more than half of the file is garbage,
+     instead of extending it.  */
+  if (i < 0 || (fresh && (h->used + 1) * 2 > h->slots)
+      || (fresh && mc->max_entries && h->used + 1 > mc->max_entries)
+      || (mc->max_size && h->end - h->log + size > mc->max_size)
+      || (h->end + size > mc->len
+          && h->end - h->log > 2 * h->live + MAPCACHE_LOG_SIZE))
+    {
+      if (mapcache_rebuild (mc, size) < 0)
+        goto fail;
+      i = mapcache_find (mc, key, key_len, hash);
+    }
+  if (mapcache_grow (mc, HEADER (mc)->end + size) < 0)
+    goto fail;
+
+  h = HEADER (mc);
+  offset = h->end;
+  r = (struct mapcache_record *) (mc->map + offset);
+  r->hash = hash;
+  r->time = time;
+  r->tick = __atomic_add_fetch (&h->clock, 1, __ATOMIC_RELAXED);
+  r->key_len = key_len;
+  r->text_len = len;
+  memcpy ((char *) (r + 1), key, key_len);
+  memcpy ((char *) (r + 1) + key_len, text, len);
+  ((char *) (r + 1))[key_len + len] = '\0';
+
+  /* Publish the record once it is complete.  */
+  s = SLOTS (mc) + i;
+  if (s->offset == 0)
+    {
+      s->hash = hash;
+      h->used++;
+    }
+  else if ((old = mapcache_record (mc, s->offset)))
+    h->live -= mapcache_record_size (old->key_len, old->text_len);
+  __atomic_store_n (&s->offset, offset, __ATOMIC_RELEASE);
+  h->end = offset + size;
+  h->live += size;
+
+  mapcache_unlock (mc);
+  return 0;
+
+ fail:
+  {
+    int saved_errno = errno;
+
+    mapcache_unlock (mc);
+    errno = saved_errno;
+  }
+  return -1;
+}
+
+const char *
+mapcache_fetch (struct mapcache *mc, const char *key, size_t *len,
+                time_t *stored)
+{
+  const struct mapcache_record *r;
+  size_t key_len = strlen (key);
+  uint64_t offset;
+  int64_t i;
+
+  if (mapcache_refresh (mc) < 0)
+    return NULL;
+
+  i = mapcache_find (mc, key, key_len, mapcache_hash (key, key_len));
+  if (i < 0)
+    return NULL;
+  offset = __atomic_load_n (&SLOTS (mc)[i].offset, __ATOMIC_ACQUIRE);
+  if (offset == 0 || !(r = mapcache_record (mc, offset)))
+    return NULL;
+
+  /* The order of the last fetches gives the records to evict.  */
+  if (mc->writable)
+    __atomic_store_n (&((struct mapcache_record *) r)->tick,
+                      __atomic_add_fetch (&HEADER (mc)->clock, 1,
+                                          __ATOMIC_RELAXED),
+                      __ATOMIC_RELAXED);
+
+  *len = r->text_len;
+  *stored = r->time;
+  return (const char *) (r + 1) + key_len;
+}
+
+int
+mapcache_sync (struct mapcache *mc)
+{
+  if (mc->map && msync (mc->map, mc->len, MS_SYNC) < 0)
+    return -1;
+  return 0;
+}
+
+#else /* !(HAVE_MMAP && HAVE_SYS_MMAN_H) */
+
+int
+mapcache_open (struct mapcache *mc, const char *name)
+{
+  (void) name;
+  mc->name = NULL;
+  mc->fd = -1;
+  mc->map = NULL;
+  errno = ENOSYS;
+  return -1;
+}
+
+void
+mapcache_close (struct mapcache *mc)
+{
+  (void) mc;
+}
+
+int
+mapcache_store (struct mapcache *mc, const char *key, const char *text,
+                size_t len, time_t time)
+{
+  (void) mc, (void) key, (void) text, (void) len, (void) time;
+  errno = ENOSYS;
+  return -1;
+}
+
+const char *
+mapcache_fetch (struct mapcache *mc, const char *key, size_t *len,
+                time_t *stored)
+{
+  (void) mc, (void) key, (void) len, (void) stored;
+  return NULL;
+}
+
+int
+mapcache_sync (struct mapcache *mc)
+{
+  (void) mc;
+  return 0;
+}
+
+#endif /* !(HAVE_MMAP && HAVE_SYS_MMAN_H) */
@@ -0,0 +1,78 @@
+/* mapcache.h - declarations for the memory mapped cache
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef MAPCACHE_H
+#define MAPCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+
+/* A map cache is a file holding a log of records, each made of a key,
+   a text and the time it was stored, and a hash table of the latest
+   record of every key.  The file is mapped in memory and shared by all
+   the processes using it.  Records are only appended, and published in
+   the hash table once complete, so that reading needs no lock.  Writers
+   take turns with a lock of the whole file.  When the hash table gets
+   full, or when the limits below would be exceeded, the records still
+   alive are copied to a new file which replaces the old one.  */
+struct mapcache {
+  char *name;
+  int fd;
+  bool writable;
+
+  /* Limits set by the caller, which are not enforced when 0: the size
+     of the records, their number, and the number of seconds after which
+     they expire.  When the size or the number of records would exceed
+     its limit, the least recently fetched records are evicted.  */
+  size_t max_size;
+  size_t max_entries;
+  time_t max_age;
+
+  /* Mapping of the file, and the identity of the file it maps.  */
+  char *map;
+  size_t len;
+  dev_t dev;
+  ino_t ino;
+};
+
+/* Open the map cache NAME in MC, creating it if needed.  Return 0 on
+   success, or -1 with errno set.  */
+extern int mapcache_open (struct mapcache *mc, const char *name);
+
+/* Close MC.  */
+extern void mapcache_close (struct mapcache *mc);
+
+/* Store the LEN bytes of TEXT in MC as the record of KEY, stored at
+   TIME.  Return 0 on success, or -1 with errno set.  */
+extern int mapcache_store (struct mapcache *mc, const char *key,
+                           const char *text, size_t len, time_t time);
+
+/* Return the text of the latest record of KEY in MC, and store its
+   length in *LEN and the time it was stored in *STORED, or return NULL
+   if there is none.  The text is followed by a null byte.  It lies in
+   the mapping of MC, and is only valid until the next call on MC.  */
+extern const char *mapcache_fetch (struct mapcache *mc, const char *key,
+                                   size_t *len, time_t *stored);
+
+/* Write the changes made to MC to disk.  Return 0 on success, or -1
+   with errno set.  */
+extern int mapcache_sync (struct mapcache *mc);
+
+#endif /* MAPCACHE_H */
@@ -0,0 +1,99 @@
+/* radix.c - binary radix trees
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Specification.  */
+#include "radix.h"
+
+/* Bit number I of KEY, counting from the most significant bit.  */
+#define KEY_BIT(key, i) (((key)[(i) / 8] >> (7 - (i) % 8)) & 1)
+
+void
+radix_tree_init (struct radix_tree *tree)
+{
+  tree->alloc = 64;
+  tree->nodes = xmalloc (tree->alloc * sizeof (struct radix_node));
+  tree->count = 1;
+  tree->nodes[0].child[0] = tree->nodes[0].child[1] = 0;
+  tree->nodes[0].value = -1;
+}
+
+void
+radix_tree_free (struct radix_tree *tree)
+{
+  if (tree->alloc)
+    free (tree->nodes);
+  tree->nodes = NULL;
+  tree->count = tree->alloc = 0;
+}
+
+void
+radix_tree_insert (struct radix_tree *tree, const unsigned char *key,
+                   unsigned int bits, int value)
+{
+  uint32_t n = 0, next;
+  unsigned int i, bit;
+
+  for (i = 0; i < bits; i++)
+    {
+      bit = KEY_BIT (key, i);
+      next = tree->nodes[n].child[bit];
+      if (!next)
+        {
+          if (tree->count == tree->alloc)
+            {
+              tree->alloc *= 2;
+              tree->nodes = xrealloc (tree->nodes, tree->alloc
+                                      * sizeof (struct radix_node));
+            }
+          next = tree->count++;
+          tree->nodes[next].child[0] = tree->nodes[next].child[1] = 0;
+          tree->nodes[next].value = -1;
+          tree->nodes[n].child[bit] = next;
+        }
+      n = next;
+    }
+  tree->nodes[n].value = value;
+}
+
+int
+radix_tree_match (const struct radix_tree *tree, const unsigned char *key,
+                  unsigned int bits, unsigned int *matchbits)
+{
+  uint32_t n = 0;
+  unsigned int i = 0;
+  int value = -1;
+
+  while (1)
+    {
+      if (tree->nodes[n].value >= 0)
+        {
+          value = tree->nodes[n].value;
+          *matchbits = i;
+        }
+      if (i == bits)
+        break;
+      n = tree->nodes[n].child[KEY_BIT (key, i)];
+      if (!n)
+        break;
+      i++;
+    }
+  return value;
+}
@@ -0,0 +1,63 @@
+/* radix.h - declarations for binary radix trees
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef RADIX_H
+#define RADIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A node of a binary radix tree of network prefixes.  Keys are addresses
+   in network byte order, of any length, so that the same tree type holds
+   IPv4 and IPv6 prefixes.  Nodes refer to each other by index, 0 meaning
+   none since node 0 is the root.  */
+struct radix_node {
+  uint32_t child[2];
+
+  /* Value of the prefix ending at this node, or -1.  */
+  int32_t value;
+};
+
+/* ALLOC is 0 when NODES is borrowed, for instance from a configuration
+   image mapped in memory; such a tree must not be modified.  */
+struct radix_tree {
+  struct radix_node *nodes;
+  size_t count;
+  size_t alloc;
+};
+
+/* Initialize the empty tree TREE.  */
+extern void radix_tree_init (struct radix_tree *tree);
+
+/* Release the memory used by TREE.  */
+extern void radix_tree_free (struct radix_tree *tree);
+
+/* Associate VALUE to the prefix made of the first BITS bits of KEY in
+   TREE, replacing any previous value.  */
+extern void radix_tree_insert (struct radix_tree *tree,
+                               const unsigned char *key, unsigned int bits,
+                               int value);
+
+/* Return the value of the longest prefix of KEY in TREE which is at most
+   BITS bits long, and store its length in *MATCHBITS.  Return -1 if no
+   prefix of KEY is in TREE.  */
+extern int radix_tree_match (const struct radix_tree *tree,
+                             const unsigned char *key, unsigned int bits,
+                             unsigned int *matchbits);
+
+#endif /* RADIX_H */
@@ -0,0 +1,862 @@
+/* resolve.c - cache of host name lookups
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Specification.  */
+#include "resolve.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <strings.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+#include "buffer.h"
+#include "cache.h"
+#include "init.h"
+#include "jconfig.h"
+#include "utils.h"
+
+/* Number of seconds the addresses of a host are kept, unless set by the
+   dns-cache-ttl option.  */
+#define RESOLVE_TTL 300
+
+/* Prefix of the keys of the query cache holding addresses.  */
+#define RESOLVE_KEY_PREFIX "@dns:"
+
+/* Number of hosts and ports whose addresses are kept at most.  */
+#define RESOLVE_ENTRIES 1024
+
+/* Number of threads of the pool looking up hosts at most.  */
+#define RESOLVE_THREADS 8
+
+/* The lookup of a host and port.  */
+struct resolve_entry {
+  char *host;
+  int port;
+  unsigned int hash;
+
+  /* Time after which the entry must be looked up again.  */
+  time_t expires;
+
+  /* Error code of the lookup, or 0 if it found the addresses.  */
+  int error;
+  char *canonname;
+  struct addrinfo *addrs;
+
+  /* Set while the pool looks the host up, for the requests waiting.  */
+  bool pending;
+  struct resolve_request *waiting, *last;
+
+  struct resolve_entry *next;
+};
+
+/* Hash table of the entries, and the number of seconds they are kept,
+   or -1 until it is read from the configuration.  */
+static struct {
+  struct resolve_entry **table;
+  size_t size;
+  size_t count;
+  long ttl;
+} resolver = {
+  .ttl = -1,
+};
+
+/* Function looking up hosts.  */
+static int (*resolve_function) (const char *, const char *,
+                                const struct addrinfo *,
+                                struct addrinfo **) = getaddrinfo;
+
+#ifdef HAVE_PTHREAD_H
+/* A lookup made by a thread of the pool for an entry.  */
+struct resolve_job {
+  struct resolve_entry *entry;
+  char *host;
+  int port;
+
+  /* Result of the lookup.  */
+  int error;
+  char *canonname;
+  struct addrinfo *addrs;
+
+  struct resolve_job *next;
+};
+
+/* The threads looking up hosts for resolve_start().  They are started
+   when lookups are waiting for a thread, and wait for more afterwards.
+   Only they and resolve_finish() use the jobs, under the lock.  The
+   entries are used by the main thread only.  */
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  /* Jobs waiting for a thread, and jobs done.  */
+  struct resolve_job *queue, *last, *done;
+  unsigned int queued;
+
+  /* Number of threads, and of those waiting for a job.  */
+  unsigned int threads, idle;
+
+  /* Pipe written to by a thread when it is done with a job.  */
+  int fds[2];
+} pool = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER,
+  .fds = { -1, -1 },
+};
+#endif /* HAVE_PTHREAD_H */
+
+/*
+ *  Returns the number of seconds the addresses of a host are kept.
+ */
+static long
+resolve_ttl (void)
+{
+  struct jconfig *j;
+  char *end;
+  long n;
+
+  if (resolver.ttl >= 0)
+    return resolver.ttl;
+
+  resolver.ttl = RESOLVE_TTL;
+  j = jconfig_getone ("jwhois", "dns-cache-ttl");
+  if (j)
+    {
+      errno = 0;
+      n = strtol (j->value, &end, 10);
+      if (errno || end == j->value || *end != '\0' || n < 0)
+        {
+          if (arguments->verbose)
+            printf ("[%s dns-cache-ttl: %s]\n", _("Invalid value of"),
+                    j->value);
+        }
+      else
+        resolver.ttl = n;
+    }
+  return resolver.ttl;
+}
+
+/*
+ *  FNV-1a hash of `host', regardless of case, and `port'.
+ */
+static unsigned int
+resolve_hash (const char *host, int port)
+{
+  unsigned int hash = 2166136261u;
+
+  for (; *host; host++)
+    hash = (hash ^ (unsigned char) tolower ((unsigned char) *host))
+      * 16777619u;
+  return (hash ^ (unsigned int) port) * 16777619u;
+}
+
+/*
+ *  Returns a copy of the address `sa' of `len' bytes, in a single block.
+ */
+static struct addrinfo *
+resolve_addr_new (const struct sockaddr *sa, socklen_t len, int protocol)
+{
+  struct addrinfo *ai = xcalloc (1, sizeof *ai + len);
+
+  ai->ai_family = sa->sa_family;
+  ai->ai_socktype = SOCK_STREAM;
+  ai->ai_protocol = protocol;
+  ai->ai_addrlen = len;
+  ai->ai_addr = (struct sockaddr *) (ai + 1);
+  memcpy (ai->ai_addr, sa, len);
+  return ai;
+}
+
+/*
+ *  Returns a copy of the list of addresses `res'.
+ */
+static struct addrinfo *
+resolve_copy (const struct addrinfo *res)
+{
+  struct addrinfo *head = NULL, **tail = &head;
+
+  for (; res; res = res->ai_next)
+    {
+      *tail = resolve_addr_new (res->ai_addr, res->ai_addrlen,
+                                res->ai_protocol);
+      tail = &(*tail)->ai_next;
+    }
+  return head;
+}
+
+void
+resolve_free (struct addrinfo *res)
+{
+  struct addrinfo *next;
+
+  for (; res; res = next)
+    {
+      next = res->ai_next;
+      free (res);
+    }
+}
+
+/*
+ *  Returns the key of the query cache holding the addresses of `e'.
+ */
+static char *
+resolve_key (const struct resolve_entry *e)
+{
+  return create_string ("%s%s:%d", RESOLVE_KEY_PREFIX, e->host, e->port);
+}
+
+/*
+ *  Stores the addresses of `e' in the query cache, as a line for each
+ *  address followed by a line holding the time at which they expire,
+ *  their port and the canonical name of the host.
+ */
+static void
+resolve_save (const struct resolve_entry *e)
+{
+  const struct addrinfo *ai;
+  struct buffer text;
+  char address[INET6_ADDRSTRLEN], *key;
+  const void *in;
+  int port = 0;
+
+  if (!arguments->cache || !e->addrs)
+    return;
+
+  buffer_init (&text);
+  for (ai = e->addrs; ai; ai = ai->ai_next)
+    {
+      if (ai->ai_family == AF_INET)
+        {
+          in = &((const struct sockaddr_in *) ai->ai_addr)->sin_addr;
+          port =
+            ntohs (((const struct sockaddr_in *) ai->ai_addr)->sin_port);
+        }
+      else if (ai->ai_family == AF_INET6)
+        {
+          in = &((const struct sockaddr_in6 *) ai->ai_addr)->sin6_addr;
+          port =
+            ntohs (((const struct sockaddr_in6 *) ai->ai_addr)->sin6_port);
+        }
+      else
+        continue;
+      if (inet_ntop (ai->ai_family, in, address, sizeof address))
+        buffer_printf (&text, "%s\n", address);
+    }
+
+  if (text.len > 0)
+    {
+      key = resolve_key (e);
+      buffer_printf (&text, "%lld %d %s\n", (long long) e->expires, port,
+                     e->canonname ? e->canonname : e->host);
+      cache_store (key, text.data);
+      free (key);
+    }
+  buffer_free (&text);
+}
+
+/*
+ *  Parses the address `line' of the query cache, and returns it without
+ *  its port, or NULL if it is invalid.
+ */
+static struct addrinfo *
+resolve_parse_addr (const char *line)
+{
+  struct sockaddr_in sin;
+  struct sockaddr_in6 sin6;
+
+  memset (&sin, 0, sizeof sin);
+  if (inet_pton (AF_INET, line, &sin.sin_addr) == 1)
+    {
+      sin.sin_family = AF_INET;
+      return resolve_addr_new ((struct sockaddr *) &sin, sizeof sin,
+                               IPPROTO_TCP);
+    }
+  memset (&sin6, 0, sizeof sin6);
+  if (inet_pton (AF_INET6, line, &sin6.sin6_addr) == 1)
+    {
+      sin6.sin6_family = AF_INET6;
+      return resolve_addr_new ((struct sockaddr *) &sin6, sizeof sin6,
+                               IPPROTO_TCP);
+    }
+  return NULL;
+}
+
+/*
+ *  Loads the addresses of `e' from the query cache, as written by
+ *  resolve_save(). Returns true if they were found and have not expired
+ *  at `now'.
+ */
+static bool
+resolve_load (struct resolve_entry *e, time_t now)
+{
+  struct cache_view view;
+  struct addrinfo *head = NULL, **tail = &head;
+  char *text, *line, *next, *end, *key;
+  long long expires;
+  long port = -1;
+  bool valid = false;
+
+  if (!arguments->cache)
+    return false;
+
+  key = resolve_key (e);
+  if (cache_read (key, &view) != 1)
+    {
+      free (key);
+      return false;
+    }
+  free (key);
+  text = xstrdup (view.text);
+  cache_release (&view);
+
+  /* The line of the host comes last, so that a truncated text is not
+     taken for a shorter list of addresses.  */
+  for (line = text; *line; line = next)
+    {
+      next = strchr (line, '\n');
+      if (!next)
+        break;
+      *next++ = '\0';
+      if (*next != '\0')
+        {
+          *tail = resolve_parse_addr (line);
+          if (!*tail)
+            break;
+          tail = &(*tail)->ai_next;
+          continue;
+        }
+
+      errno = 0;
+      expires = strtoll (line, &end, 10);
+      if (errno || *end != ' ')
+        break;
+      port = strtol (end + 1, &end, 10);
+      if (port < 0 || port > 65535 || *end != ' ' || end[1] == '\0')
+        break;
+      if (expires > now && head)
+        {
+          e->expires = expires;
+          e->canonname = xstrdup (end + 1);
+          valid = true;
+        }
+    }
+
+  if (valid)
+    {
+      for (e->addrs = head; head; head = head->ai_next)
+        if (head->ai_family == AF_INET)
+          ((struct sockaddr_in *) head->ai_addr)->sin_port = htons (port);
+        else
+          ((struct sockaddr_in6 *) head->ai_addr)->sin6_port = htons (port);
+    }
+  else
+    resolve_free (head);
+  free (text);
+  return valid;
+}
+
+/*
+ *  Reorders `res' so that its address families alternate, starting with
+ *  the family of its first address, as RFC 8305 recommends, so that a
+ *  family which can't be reached doesn't hold up the connections to the
+ *  other one.  Returns the new head of the list.
+ */
+static struct addrinfo *
+resolve_interleave (struct addrinfo *res)
+{
+  struct addrinfo *first = NULL, *other = NULL, *head = NULL, *next;
+  struct addrinfo **ftail = &first, **otail = &other, **tail = &head;
+
+  for (; res; res = next)
+    {
+      next = res->ai_next;
+      if (!first || res->ai_family == first->ai_family)
+        {
+          *ftail = res;
+          ftail = &res->ai_next;
+        }
+      else
+        {
+          *otail = res;
+          otail = &res->ai_next;
+        }
+    }
+  *ftail = *otail = NULL;
+
+  while (first || other)
+    {
+      if (first)
+        {
+          *tail = first;
+          tail = &first->ai_next;
+          first = first->ai_next;
+        }
+      if (other)
+        {
+          *tail = other;
+          tail = &other->ai_next;
+          other = other->ai_next;
+        }
+    }
+  return head;
+}
+
+/*
+ *  Looks up `host' and `port' with the resolver function, and returns
+ *  a copy of the addresses found, setting `*error' to 0 and `*canonname'
+ *  to the canonical name of the host, or returns NULL and sets `*error'.
+ *  This is called by the threads of the pool as well.
+ */
+static struct addrinfo *
+resolve_getaddrinfo (const char *host, int port, int *error, char **canonname)
+{
+  struct addrinfo hints, *res, *addrs;
+  char ascport[10] = "whois";
+
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family = PF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_CANONNAME;
+  if (port)
+    sprintf (ascport, "%9.9d", port);
+
+  *canonname = NULL;
+  *error = resolve_function (host, ascport, &hints, &res);
+  if (*error)
+    return NULL;
+
+  if (res->ai_canonname)
+    *canonname = xstrdup (res->ai_canonname);
+  addrs = resolve_interleave (resolve_copy (res));
+  freeaddrinfo (res);
+  return addrs;
+}
+
+/*
+ *  Forgets the addresses of `e'.
+ */
+static void
+resolve_reset (struct resolve_entry *e)
+{
+  free (e->canonname);
+  resolve_free (e->addrs);
+  e->canonname = NULL;
+  e->addrs = NULL;
+  e->error = 0;
+}
+
+/*
+ *  Sets the result of the lookup of `e' made at `now', and stores it in
+ *  the query cache. The entry takes `canonname' and `addrs' over.
+ */
+static void
+resolve_set (struct resolve_entry *e, time_t now, int error,
+             char *canonname, struct addrinfo *addrs)
+{
+  resolve_reset (e);
+  e->error = error;
+  e->canonname = canonname;
+  e->addrs = addrs;
+  e->expires = now + resolve_ttl ();
+
+  /* Only a host which doesn't exist is remembered, since other errors
+     may not last.  */
+  if (error && error != EAI_NONAME)
+    e->expires = now;
+  if (!error && resolve_ttl () > 0)
+    resolve_save (e);
+}
+
+/*
+ *  Looks up the host of `e' at `now' with the resolver function.
+ */
+static void
+resolve_query (struct resolve_entry *e, time_t now)
+{
+  struct addrinfo *addrs;
+  char *canonname;
+  int error;
+
+  addrs = resolve_getaddrinfo (e->host, e->port, &error, &canonname);
+  resolve_set (e, now, error, canonname, addrs);
+}
+
+/*
+ *  Doubles the size of the hash table, or gives it its first buckets.
+ */
+static void
+resolve_grow (void)
+{
+  struct resolve_entry **table, *e, *next;
+  size_t size = resolver.size ? resolver.size * 2 : 64, i;
+
+  table = xcalloc (size, sizeof *table);
+  for (i = 0; i < resolver.size; i++)
+    for (e = resolver.table[i]; e; e = next)
+      {
+        next = e->next;
+        e->next = table[e->hash % size];
+        table[e->hash % size] = e;
+      }
+  free (resolver.table);
+  resolver.table = table;
+  resolver.size = size;
+}
+
+/*
+ *  Removes the entries which have expired at `now', or all of them if
+ *  `all' is true, but those the pool is looking up.
+ */
+static void
+resolve_evict (time_t now, bool all)
+{
+  struct resolve_entry **p, *e;
+  size_t i;
+
+  for (i = 0; i < resolver.size; i++)
+    for (p = &resolver.table[i]; (e = *p);)
+      if (!e->pending && (all || e->expires <= now))
+        {
+          *p = e->next;
+          free (e->host);
+          free (e->canonname);
+          resolve_free (e->addrs);
+          free (e);
+          resolver.count--;
+        }
+      else
+        p = &e->next;
+}
+
+/*
+ *  Returns the entry of `host' and `port', which is created empty if it
+ *  doesn't exist. There are RESOLVE_ENTRIES entries at most, besides
+ *  those the pool is looking up, since the hosts may come from anyone.
+ */
+static struct resolve_entry *
+resolve_find (const char *host, int port)
+{
+  unsigned int hash = resolve_hash (host, port);
+  struct resolve_entry *e;
+
+  if (resolver.size)
+    for (e = resolver.table[hash % resolver.size]; e; e = e->next)
+      if (e->hash == hash && e->port == port
+          && strcasecmp (e->host, host) == 0)
+        return e;
+
+  if (resolver.count >= RESOLVE_ENTRIES)
+    resolve_evict (time (NULL), false);
+  if (resolver.count >= RESOLVE_ENTRIES)
+    resolve_evict (0, true);
+  if (resolver.count >= resolver.size)
+    resolve_grow ();
+  e = xcalloc (1, sizeof *e);
+  e->host = xstrdup (host);
+  e->port = port;
+  e->hash = hash;
+  e->next = resolver.table[hash % resolver.size];
+  resolver.table[hash % resolver.size] = e;
+  resolver.count++;
+  return e;
+}
+
+/*
+ *  Loads the addresses of `e' from the query cache if it has expired at
+ *  `now'. Returns true if it is then current.
+ */
+static bool
+resolve_current (struct resolve_entry *e, time_t now)
+{
+  if (e->expires > now)
+    return true;
+  resolve_reset (e);
+  return resolve_ttl () > 0 && resolve_load (e, now);
+}
+
+/*
+ *  Returns the entry of `host' and `port', looked up again if it has
+ *  expired. A lookup of the entry in progress in the pool is not waited
+ *  for, so that this can be called in a child process.
+ */
+static struct resolve_entry *
+resolve_lookup (const char *host, int port)
+{
+  struct resolve_entry *e = resolve_find (host, port);
+  time_t now = time (NULL);
+
+  if (!resolve_current (e, now))
+    resolve_query (e, now);
+  return e;
+}
+
+int
+resolve_host (struct addrinfo **res, const char *host, int port)
+{
+  struct resolve_entry *e = resolve_lookup (host, port);
+
+  if (e->error)
+    return e->error;
+  *res = resolve_copy (e->addrs);
+  return 0;
+}
+
+char *
+resolve_canonical (const char *host)
+{
+  struct resolve_entry *e = resolve_lookup (host, 0);
+
+  if (e->error)
+    return NULL;
+  return xstrdup (e->canonname ? e->canonname : host);
+}
+
+void
+resolve_clear (void)
+{
+  struct resolve_entry *e, *next;
+  size_t i;
+
+  for (i = 0; i < resolver.size; i++)
+    for (e = resolver.table[i]; e; e = next)
+      {
+        next = e->next;
+        free (e->host);
+        free (e->canonname);
+        resolve_free (e->addrs);
+        free (e);
+      }
+  free (resolver.table);
+  resolver.table = NULL;
+  resolver.size = resolver.count = 0;
+  resolver.ttl = -1;
+}
+
+void
+resolve_set_function (int (*function) (const char *, const char *,
+                                       const struct addrinfo *,
+                                       struct addrinfo **))
+{
+  resolve_function = function ? function : getaddrinfo;
+}
+
+/*
+ *  Completes the request `r' with the addresses of `e'.
+ */
+static void
+resolve_answer (struct resolve_request *r, const struct resolve_entry *e)
+{
+  r->error = e->error;
+  r->addrs = e->error ? NULL : resolve_copy (e->addrs);
+}
+
+#ifdef HAVE_PTHREAD_H
+/*
+ *  Makes the jobs of the pool, until the end of the process.
+ */
+static void *
+resolve_thread (void *arg)
+{
+  struct resolve_job *job;
+
+  (void) arg;
+  pthread_mutex_lock (&pool.lock);
+  for (;;)
+    {
+      while (!pool.queue)
+        {
+          pool.idle++;
+          pthread_cond_wait (&pool.cond, &pool.lock);
+          pool.idle--;
+        }
+      job = pool.queue;
+      pool.queue = job->next;
+      if (!pool.queue)
+        pool.last = NULL;
+      pool.queued--;
+      pthread_mutex_unlock (&pool.lock);
+
+      job->addrs = resolve_getaddrinfo (job->host, job->port, &job->error,
+                                        &job->canonname);
+
+      pthread_mutex_lock (&pool.lock);
+      job->next = pool.done;
+      pool.done = job;
+      /* If the pipe is full, the main thread has enough to wake up.  */
+      if (write (pool.fds[1], "", 1) < 0)
+        continue;
+    }
+  return NULL;
+}
+
+/*
+ *  Gives the lookup of `e' to the pool, starting a thread if none is
+ *  free. Returns -1 if there is no thread to do it, 0 otherwise.
+ */
+static int
+resolve_submit (struct resolve_entry *e)
+{
+  struct resolve_job *job;
+  sigset_t all, old;
+  pthread_t thread;
+
+  if (resolve_fd () < 0)
+    return -1;
+
+  pthread_mutex_lock (&pool.lock);
+  if (pool.queued >= pool.idle && pool.threads < RESOLVE_THREADS)
+    {
+      /* Signals are left to the main thread.  */
+      sigfillset (&all);
+      pthread_sigmask (SIG_SETMASK, &all, &old);
+      if (pthread_create (&thread, NULL, resolve_thread, NULL) == 0)
+        {
+          pthread_detach (thread);
+          pool.threads++;
+        }
+      pthread_sigmask (SIG_SETMASK, &old, NULL);
+    }
+  if (pool.threads == 0)
+    {
+      pthread_mutex_unlock (&pool.lock);
+      return -1;
+    }
+
+  job = xcalloc (1, sizeof *job);
+  job->entry = e;
+  job->host = xstrdup (e->host);
+  job->port = e->port;
+  if (pool.last)
+    pool.last->next = job;
+  else
+    pool.queue = job;
+  pool.last = job;
+  pool.queued++;
+  pthread_cond_signal (&pool.cond);
+  pthread_mutex_unlock (&pool.lock);
+
+  e->pending = true;
+  return 0;
+}
+#endif /* HAVE_PTHREAD_H */
+
+int
+resolve_start (struct resolve_request *r, const char *host, int port)
+{
+  struct resolve_entry *e = resolve_find (host, port);
+  time_t now = time (NULL);
+
+  if (!e->pending && !resolve_current (e, now))
+    {
+#ifdef HAVE_PTHREAD_H
+      if (resolve_submit (e) < 0)
+#endif
+        resolve_query (e, now);
+    }
+
+  if (!e->pending)
+    {
+      resolve_answer (r, e);
+      return 0;
+    }
+
+  r->next = NULL;
+  if (e->last)
+    e->last->next = r;
+  else
+    e->waiting = r;
+  e->last = r;
+  return 1;
+}
+
+int
+resolve_fd (void)
+{
+#ifdef HAVE_PTHREAD_H
+  int i, flags;
+
+  if (pool.fds[0] >= 0)
+    return pool.fds[0];
+  if (pipe (pool.fds) < 0)
+    return pool.fds[0] = pool.fds[1] = -1;
+  for (i = 0; i < 2; i++)
+    {
+      flags = fcntl (pool.fds[i], F_GETFL, 0);
+      fcntl (pool.fds[i], F_SETFL, flags | O_NONBLOCK);
+      fcntl (pool.fds[i], F_SETFD, FD_CLOEXEC);
+    }
+  return pool.fds[0];
+#else
+  return -1;
+#endif
+}
+
+void
+resolve_finish (void)
+{
+#ifdef HAVE_PTHREAD_H
+  struct resolve_job *job, *next;
+  struct resolve_request *r, *waiting;
+  struct resolve_entry *e;
+  time_t now = time (NULL);
+  char drain[64];
+
+  if (pool.fds[0] < 0)
+    return;
+  while (read (pool.fds[0], drain, sizeof drain) > 0)
+    ;
+
+  pthread_mutex_lock (&pool.lock);
+  job = pool.done;
+  pool.done = NULL;
+  pthread_mutex_unlock (&pool.lock);
+
+  for (; job; job = next)
+    {
+      next = job->next;
+      e = job->entry;
+      resolve_set (e, now, job->error, job->canonname, job->addrs);
+      e->pending = false;
+      waiting = e->waiting;
+      e->waiting = e->last = NULL;
+      free (job->host);
+      free (job);
+
+      /* A request may be started again from its DONE function, which
+         may remove the entry.  */
+      for (r = waiting; r; r = r->next)
+        resolve_answer (r, e);
+      for (; waiting; waiting = r)
+        {
+          r = waiting->next;
+          waiting->done (waiting);
+        }
+    }
+#endif
+}
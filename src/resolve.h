@@ -0,0 +1,96 @@
+/* resolve.h - cache of host name lookups
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef RESOLVE_H
+#define RESOLVE_H
+
+/* The addresses of the hosts looked up are kept for the number of
+   seconds set by the dns-cache-ttl option, 300 by default, or 0 to
+   look up hosts every time.  They are also stored in the query cache
+   under the key "@dns:HOST:PORT", which a host name cannot start with,
+   so that later runs find them there until they expire.  A host which
+   doesn't exist is remembered by this process only.  IPv6 and IPv4
+   addresses alternate in the lists returned, starting with the family
+   of the first address found, as RFC 8305 recommends.
+
+   Lookups started by resolve_start() are made by a pool of threads, so
+   that a slow resolver doesn't hold up the caller, which waits for the
+   file descriptor returned by resolve_fd() to be readable among the
+   others it watches.  Requests for a host being looked up wait for the
+   same lookup.  */
+
+struct addrinfo;
+
+/* A request for the addresses of a host.  */
+struct resolve_request {
+  /* Set once the request is complete to 0, and ADDRS to a list of
+     addresses to release with resolve_free(), or to an error code which
+     can be interpreted by 'gai_strerror'.  */
+  int error;
+  struct addrinfo *addrs;
+
+  /* Function called by resolve_finish() once the request is complete,
+     and its data.  */
+  void (*done) (struct resolve_request *r);
+  void *data;
+
+  /* Private.  */
+  struct resolve_request *next;
+};
+
+/* Look up the stream addresses of HOST, with the port PORT or the whois
+   port if PORT is 0.  Set *RES to a list of addresses to release with
+   resolve_free() and return 0, or return an error code which can be
+   interpreted by 'gai_strerror'.  */
+extern int resolve_host (struct addrinfo **res, const char *host, int port);
+
+/* Return the canonical name of HOST, which is HOST itself unless it is
+   an alias, or NULL if HOST doesn't exist.  The name is to be freed by
+   the caller.  */
+extern char *resolve_canonical (const char *host);
+
+/* Start looking up HOST and PORT as resolve_host() does, for R.  Return
+   0 if R is complete already, without calling its DONE function, or 1 if
+   it will be completed by resolve_finish().  */
+extern int resolve_start (struct resolve_request *r, const char *host,
+                          int port);
+
+/* Return the file descriptor which is readable once lookups started by
+   resolve_start() are done, or -1 if they are always complete at once
+   because threads are not available.  */
+extern int resolve_fd (void);
+
+/* Complete the requests whose lookups are done.  */
+extern void resolve_finish (void);
+
+/* Release a list of addresses returned by resolve_host().  */
+extern void resolve_free (struct addrinfo *res);
+
+/* Forget the hosts looked up by this process, of which none may be
+   looked up by the threads.  */
+extern void resolve_clear (void);
+
+/* Look up hosts with FUNCTION, which works as 'getaddrinfo' and returns
+   lists to be released with 'freeaddrinfo', instead of 'getaddrinfo'
+   itself if FUNCTION is NULL.  This is meant for tests.  */
+extern void resolve_set_function (int (*function) (const char *,
+                                                   const char *,
+                                                   const struct addrinfo *,
+                                                   struct addrinfo **));
+
+#endif /* RESOLVE_H */
@@ -93,9 +93,9 @@ static struct
   {NULL, 0}
 };
 
-int rwhois_read_line(FILE *, char *, char **);
+int rwhois_read_line(FILE *, char *, struct buffer *);
 int rwhois_insert_referral(const char *, struct s_referrals **);
-int rwhois_parse_line(const char *, char **);
+int rwhois_parse_line(const char *, struct buffer *);
 
 
 /*
@@ -107,7 +107,7 @@ int rwhois_parse_line(const char *, char **);
  *              0 Success
  */
 int
-rwhois_query_internal (whois_query_t wq, char **text, struct s_referrals **referrals)
+rwhois_query_internal (whois_query_t wq, struct buffer *text, struct s_referrals **referrals)
 {
   int sockfd, ret, limit;
   FILE *f;
@@ -119,14 +119,14 @@ rwhois_query_internal (whois_query_t wq, char **text, struct s_referrals **refer
   rwhois_capab = 0;
   info_on = 0;
 
-  sockfd = make_connect(wq->host, wq->port);
+  sockfd = make_connect(wq->host, wq->port, whois_deadline(wq));
   if (sockfd < 0)
     {
       printf(_("[Unable to connect to remote host]\n"));
       return -1;
     }
 
-  add_text_to_buffer(text, create_string("[%s]\n", wq->host));
+  buffer_printf(text, "[%s]\n", wq->host);
 
   f = fdopen(sockfd, "r+");
   if (!f)
@@ -325,7 +325,7 @@ rwhois_insert_referral(const char *reply, struct s_referrals **referrals)
  *              0 Success
  */
 int
-rwhois_query (whois_query_t wq, char **text)
+rwhois_query (whois_query_t wq, struct buffer *text)
 {
   struct s_referrals *referrals, *s;
   struct s_referrals *authareas, *a;
@@ -354,7 +354,7 @@ rwhois_query (whois_query_t wq, char **text)
 	    }
 	  if (!followed)
 	    {
-	      wq->host = referrals->host;
+	      wq_set_host (wq, referrals->host);
 	      wq->port = referrals->port;
               if (arguments->verbose)
 		printf("[RWHOIS: %s %s:%d (autharea=%s)]\n",
@@ -383,12 +383,12 @@ rwhois_query (whois_query_t wq, char **text)
  *  in the indicated pointer.
  */
 int
-rwhois_read_line(FILE *f, char *ptr, char **text)
+rwhois_read_line(FILE *f, char *ptr, struct buffer *text)
 {
   if (feof(f))
     {
       printf(_("[Host terminated connection prematurely]\n"));
-      exit (EXIT_FAILURE);
+      return REP_ERROR;
     }
   
   if (!fgets(ptr, MAXBUFSIZE-1, f))
@@ -405,7 +405,7 @@ rwhois_read_line(FILE *f, char *ptr, char **text)
  *  This parses the reply sent by the server.
  */
 int
-rwhois_parse_line(const char *reply, char **text)
+rwhois_parse_line(const char *reply, struct buffer *text)
 {
   char *tmpptr;
 
@@ -415,7 +415,7 @@ rwhois_parse_line(const char *reply, char **text)
   
   if (info_on && !STRNCASEEQ (reply, "%info", 5))
     {
-      add_text_to_buffer(text, create_string("%s\n", reply));
+      buffer_printf(text, "%s\n", reply);
       return REP_CONT;
     }
 
@@ -441,7 +441,7 @@ rwhois_parse_line(const char *reply, char **text)
       tmpptr = (char *)strchr(reply, ' ');
       if (!tmpptr)
 	return REP_ERROR;
-      add_text_to_buffer(text, create_string("%s\n", tmpptr+1));
+      buffer_printf(text, "%s\n", tmpptr+1);
       return REP_ERROR;
     }
 
@@ -475,6 +475,6 @@ rwhois_parse_line(const char *reply, char **text)
       return REP_CONT;
     }
 
-  add_text_to_buffer(text, create_string("%s\n", reply));
+  buffer_printf(text, "%s\n", reply);
   return REP_CONT;
 }
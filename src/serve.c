@@ -0,0 +1,744 @@
+/* serve.c - answering queries from local clients
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Specification.  */
+#include "serve.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+/* A client closing the connection early must not kill the process.  */
+#ifdef MSG_NOSIGNAL
+# define SERVE_SEND_FLAGS MSG_NOSIGNAL
+#else
+# define SERVE_SEND_FLAGS 0
+#endif
+
+/* Longest query line read from a client.  */
+#define SERVE_QUERY_MAX 1024
+
+/* Milliseconds a client may take to send its query, and to take each
+   part of the answer.  */
+#define SERVE_TIMEOUT 30000
+
+/* Number of connections for each job which may wait for their query to
+   be made.  New connections are left to the listening sockets beyond.  */
+#define SERVE_BACKLOG 16
+
+/* States of a client.  */
+enum serve_state {
+  SERVE_READ,
+  SERVE_QUEUED,
+  SERVE_QUERY,
+  SERVE_ANSWERED,
+  SERVE_WRITE
+};
+
+struct serve;
+
+/* A listening socket, whether it is waited for, and whether it failed
+   to accept a connection for want of resources.  */
+struct serve_listener {
+  struct serve *serve;
+  int fd;
+  struct engine_query q;
+  bool waiting, failed;
+};
+
+/* A connection of a client.  */
+struct serve_client {
+  struct serve *serve;
+  int fd;
+  enum serve_state state;
+
+  /* The wait for the socket to be readable or writable.  */
+  struct engine_query q;
+  bool waiting;
+
+  /* What the client sent, in which QUERY is, and the output of the query,
+     of which SENT bytes were sent.  */
+  struct buffer in;
+  char *query;
+  struct buffer out;
+  size_t sent;
+
+  /* Child process making the query, and the read of its output.  */
+  pid_t pid;
+  struct engine_query pipe;
+
+  struct serve_client *prev, *next;
+
+  /* Next client waiting for a job, or answered.  */
+  struct serve_client *queued;
+};
+
+/* A server.  */
+struct serve {
+  const struct batch_ops *ops;
+  struct engine engine;
+  unsigned int jobs, running;
+
+  struct serve_listener *listeners;
+  size_t count;
+
+  /* All the clients and their number, those waiting for a job, and those
+     whose answer is to be sent.  */
+  struct serve_client *clients;
+  unsigned int connected;
+  struct serve_client *queue, *last, *answered;
+
+  /* The wait for a signal to stop, and whether it came.  */
+  struct engine_query signal;
+  bool stopping;
+};
+
+/* Pipe written by the handler of the signals stopping the server.  */
+static int serve_pipe[2] = { -1, -1 };
+
+/* Signals stopping the server, and their actions before it ran.  */
+static const int serve_signals[] = { SIGINT, SIGTERM };
+static struct sigaction serve_actions[2];
+
+/*
+ *  Makes `fd' non-blocking. Returns -1 on error, 0 on success.
+ */
+static int
+serve_nonblock (int fd)
+{
+  int flags = fcntl (fd, F_GETFL, 0);
+
+  if (flags < 0)
+    return -1;
+  return fcntl (fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/*
+ *  Removes the socket `sun' if nothing listens on it anymore. Returns
+ *  true if it was removed.
+ */
+static bool
+serve_stale (const struct sockaddr_un *sun)
+{
+  int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  bool stale;
+
+  if (fd < 0)
+    return false;
+  stale = connect (fd, (const struct sockaddr *) sun, sizeof *sun) < 0
+    && errno == ECONNREFUSED && unlink (sun->sun_path) == 0;
+  close (fd);
+  return stale;
+}
+
+/*
+ *  Returns a non-blocking socket of the family `family' listening on the
+ *  address `addr' of `len' bytes, or -1 with errno set.
+ */
+static int
+serve_socket (int family, const struct sockaddr *addr, socklen_t len)
+{
+  int fd, saved, one = 1;
+
+  fd = socket (family, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+
+  if (family != AF_UNIX)
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+#ifdef IPV6_V6ONLY
+  if (family == AF_INET6)
+    setsockopt (fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof one);
+#endif
+
+  if ((bind (fd, addr, len) == 0
+       || (family == AF_UNIX && errno == EADDRINUSE
+           && serve_stale ((const struct sockaddr_un *) addr)
+           && bind (fd, addr, len) == 0))
+      && listen (fd, SOMAXCONN) == 0 && serve_nonblock (fd) == 0)
+    return fd;
+
+  saved = errno;
+  close (fd);
+  errno = saved;
+  return -1;
+}
+
+int
+serve_listen_unix (const char *path)
+{
+  struct sockaddr_un sun;
+
+  if (strlen (path) >= sizeof sun.sun_path)
+    {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+  memset (&sun, 0, sizeof sun);
+  sun.sun_family = AF_UNIX;
+  strcpy (sun.sun_path, path);
+  return serve_socket (AF_UNIX, (struct sockaddr *) &sun, sizeof sun);
+}
+
+/*
+ *  Returns true if a socket failed with `error' because the address
+ *  family, or the loopback address of the family, doesn't exist.
+ */
+static bool
+serve_missing (int error)
+{
+  return error == EAFNOSUPPORT || error == EADDRNOTAVAIL;
+}
+
+int
+serve_listen_tcp (int port, int *fds)
+{
+  struct sockaddr_in sin;
+  struct sockaddr_in6 sin6;
+  socklen_t len = sizeof sin;
+  int count = 0, fd, saved;
+
+  memset (&sin, 0, sizeof sin);
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons (port);
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  fd = serve_socket (AF_INET, (struct sockaddr *) &sin, sizeof sin);
+  if (fd < 0 && !serve_missing (errno))
+    return -1;
+  if (fd >= 0)
+    {
+      /* A port chosen by the system is used for both addresses.  */
+      if (port == 0
+          && getsockname (fd, (struct sockaddr *) &sin, &len) == 0)
+        port = ntohs (sin.sin_port);
+      fds[count++] = fd;
+    }
+
+  memset (&sin6, 0, sizeof sin6);
+  sin6.sin6_family = AF_INET6;
+  sin6.sin6_port = htons (port);
+  sin6.sin6_addr = in6addr_loopback;
+  fd = serve_socket (AF_INET6, (struct sockaddr *) &sin6, sizeof sin6);
+  if (fd < 0 && (count == 0 || !serve_missing (errno)))
+    {
+      if (count > 0)
+        {
+          saved = errno;
+          close (fds[0]);
+          errno = saved;
+        }
+      return -1;
+    }
+  if (fd >= 0)
+    fds[count++] = fd;
+  return count;
+}
+
+/*
+ *  Tells the server to stop. The handler of SIGINT and SIGTERM.
+ */
+static void
+serve_signal_handler (int sig)
+{
+  int saved = errno;
+  ssize_t ret;
+
+  (void) sig;
+  ret = write (serve_pipe[1], "", 1);
+  (void) ret;
+  errno = saved;
+}
+
+/*
+ *  Restores the actions of the signals stopping the server.
+ */
+static void
+serve_restore (void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof serve_signals / sizeof *serve_signals; i++)
+    sigaction (serve_signals[i], &serve_actions[i], NULL);
+}
+
+static void serve_ready (struct engine_query *q);
+
+/*
+ *  Waits for the socket of `c' to be writable if `write' is true, or
+ *  readable otherwise.
+ */
+static void
+serve_wait (struct serve_client *c, bool write)
+{
+  c->q.done = serve_ready;
+  c->q.data = c;
+  c->q.text = NULL;
+  engine_notify (&c->serve->engine, &c->q, c->fd, write, SERVE_TIMEOUT);
+  c->waiting = true;
+}
+
+/*
+ *  Closes the connection of `c', which is released.
+ */
+static void
+serve_close (struct serve_client *c)
+{
+  struct serve *s = c->serve;
+
+  if (c->waiting)
+    engine_cancel (&s->engine, &c->q);
+  close (c->fd);
+  buffer_free (&c->in);
+  buffer_free (&c->out);
+
+  if (c->prev)
+    c->prev->next = c->next;
+  else
+    s->clients = c->next;
+  if (c->next)
+    c->next->prev = c->prev;
+  s->connected--;
+  free (c);
+}
+
+/*
+ *  Marks the query of the client `data' as complete. Its output is sent
+ *  once the engine is done with it.
+ */
+static void
+serve_done (void *data, int status)
+{
+  struct serve_client *c = data;
+  struct serve *s = c->serve;
+
+  (void) status;
+  c->state = SERVE_ANSWERED;
+  c->queued = s->answered;
+  s->answered = c;
+  s->running--;
+}
+
+/*
+ *  Waits for the child process of a client once its output is read.
+ */
+static void
+serve_child_done (struct engine_query *q)
+{
+  struct serve_client *c = q->data;
+  int status;
+
+  while (waitpid (c->pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  serve_done (c, q->status);
+}
+
+/*
+ *  Starts a child process making the query of `c' by calling `fn' with
+ *  `arg', which prints the answer to a pipe read by the engine. The child
+ *  closes the sockets of the server, so that the clients see the end of
+ *  their connections once it is closed by the server. Returns -1 on
+ *  error, 0 on success.
+ */
+static int
+serve_fork (struct serve *s, struct serve_client *c, int (*fn) (void *),
+            void *arg)
+{
+  struct serve_client *other;
+  int fds[2], ret;
+  size_t i;
+
+  if (pipe (fds) < 0)
+    return -1;
+
+  fflush (stdout);
+  c->pid = fork ();
+  if (c->pid < 0)
+    {
+      close (fds[0]);
+      close (fds[1]);
+      return -1;
+    }
+  if (c->pid == 0)
+    {
+      serve_restore ();
+      close (serve_pipe[0]);
+      close (serve_pipe[1]);
+      for (i = 0; i < s->count; i++)
+        close (s->listeners[i].fd);
+      for (other = s->clients; other; other = other->next)
+        close (other->fd);
+      if (s->ops->child)
+        s->ops->child ();
+      close (fds[0]);
+      if (dup2 (fds[1], STDOUT_FILENO) < 0)
+        _exit (EXIT_FAILURE);
+      close (fds[1]);
+      ret = fn (arg);
+      fflush (stdout);
+      _exit (ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+  close (fds[1]);
+  c->pipe.text = &c->out;
+  c->pipe.done = serve_child_done;
+  c->pipe.data = c;
+  engine_read (&s->engine, &c->pipe, fds[0]);
+  return 0;
+}
+
+/*
+ *  Makes the query of the client `data' with the lookup function of the
+ *  server.
+ */
+static int
+serve_lookup (void *data)
+{
+  struct serve_client *c = data;
+
+  return c->serve->ops->lookup (c->query);
+}
+
+/*
+ *  Makes the rest of the query of the client `data', started with the
+ *  engine, in a child process calling `fn' with `arg'.
+ */
+static int
+serve_spawn (void *data, int (*fn) (void *), void *arg)
+{
+  struct serve_client *c = data;
+
+  return serve_fork (c->serve, c, fn, arg);
+}
+
+/*
+ *  Starts making the query of `c', with the engine if the server can, or
+ *  else in a child process.
+ */
+static void
+serve_start (struct serve *s, struct serve_client *c)
+{
+  c->state = SERVE_QUERY;
+  s->running++;
+  if (s->ops->start
+      && s->ops->start (&s->engine, c->query, &c->out, serve_done,
+                        serve_spawn, c) == 0)
+    return;
+
+  buffer_reset (&c->out);
+  if (serve_fork (s, c, serve_lookup, c) < 0)
+    {
+      buffer_printf (&c->out, "[%s: %s]\n", _("Unable to start query"),
+                     strerror (errno));
+      serve_done (c, -1);
+    }
+}
+
+/*
+ *  Sends what is left of the answer to `c', and closes the connection
+ *  once it is sent.
+ */
+static void
+serve_write (struct serve_client *c)
+{
+  ssize_t ret;
+
+  ret = send (c->fd, c->out.data + c->sent, c->out.len - c->sent,
+              SERVE_SEND_FLAGS);
+  if (ret > 0)
+    c->sent += ret;
+  if ((ret < 0 && errno != EAGAIN && errno != EINTR)
+      || c->sent == c->out.len)
+    serve_close (c);
+  else
+    serve_wait (c, true);
+}
+
+/*
+ *  Reads the query line of `c', and makes the query once the line is
+ *  complete. A client whose line is too long, or empty, is disconnected.
+ */
+static void
+serve_read (struct serve_client *c)
+{
+  struct serve *s = c->serve;
+  ssize_t ret;
+  char *query, *end;
+
+  ret = buffer_read (&c->in, c->fd);
+  if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+      serve_wait (c, false);
+      return;
+    }
+  if (ret < 0)
+    {
+      serve_close (c);
+      return;
+    }
+
+  /* A client may also end its query with the end of its connection.  */
+  end = memchr (c->in.data, '\n', c->in.len);
+  if (!end && ret > 0)
+    {
+      if (c->in.len > SERVE_QUERY_MAX)
+        serve_close (c);
+      else
+        serve_wait (c, false);
+      return;
+    }
+  if (!end)
+    end = c->in.data + c->in.len;
+
+  while (end > c->in.data && isspace ((unsigned char) end[-1]))
+    end--;
+  *end = '\0';
+  query = c->in.data;
+  while (isspace ((unsigned char) *query))
+    query++;
+  if (*query == '\0' || end - c->in.data > SERVE_QUERY_MAX)
+    {
+      serve_close (c);
+      return;
+    }
+
+  c->query = query;
+  c->state = SERVE_QUEUED;
+  c->queued = NULL;
+  if (s->last)
+    s->last->queued = c;
+  else
+    s->queue = c;
+  s->last = c;
+}
+
+/*
+ *  Moves the client of `q' on now that its socket is ready, or closes
+ *  its connection if it took too long.
+ */
+static void
+serve_ready (struct engine_query *q)
+{
+  struct serve_client *c = q->data;
+
+  c->waiting = false;
+  if (q->status < 0)
+    serve_close (c);
+  else if (c->state == SERVE_READ)
+    serve_read (c);
+  else
+    serve_write (c);
+}
+
+/*
+ *  Accepts the connections waiting on the listening socket of `q', as
+ *  long as the server takes new clients.
+ */
+static void
+serve_accept (struct engine_query *q)
+{
+  struct serve_listener *l = q->data;
+  struct serve *s = l->serve;
+  struct serve_client *c;
+  int fd;
+
+  l->waiting = false;
+  while (!s->stopping && s->connected < s->jobs * SERVE_BACKLOG)
+    {
+      fd = accept (l->fd, NULL, NULL);
+      if (fd < 0 && (errno == EINTR || errno == ECONNABORTED))
+        continue;
+      l->failed = fd < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+      if (fd < 0)
+        return;
+      if (serve_nonblock (fd) < 0)
+        {
+          close (fd);
+          continue;
+        }
+
+      c = xcalloc (1, sizeof *c);
+      c->serve = s;
+      c->fd = fd;
+      c->state = SERVE_READ;
+      buffer_init (&c->in);
+      buffer_init (&c->out);
+      c->next = s->clients;
+      if (s->clients)
+        s->clients->prev = c;
+      s->clients = c;
+      s->connected++;
+      serve_wait (c, false);
+    }
+}
+
+/*
+ *  Waits for the listening sockets which aren't waited for, as long as
+ *  the server takes new clients. A socket failing to accept is waited
+ *  for again once a client is gone, or at once if there is none.
+ */
+static void
+serve_listen (struct serve *s)
+{
+  struct serve_listener *l;
+  size_t i;
+
+  if (s->stopping || s->connected >= s->jobs * SERVE_BACKLOG)
+    return;
+  for (i = 0; i < s->count; i++)
+    {
+      l = &s->listeners[i];
+      if (l->waiting || (l->failed && s->connected > 0))
+        continue;
+      engine_notify (&s->engine, &l->q, l->fd, false, 0);
+      l->waiting = true;
+    }
+}
+
+/*
+ *  Stops the server once it is sent a signal: the listening sockets are
+ *  closed, and so are the connections whose query is not started.
+ */
+static void
+serve_stop (struct engine_query *q)
+{
+  struct serve *s = q->data;
+  struct serve_client *c, *next;
+  size_t i;
+
+  serve_restore ();
+  s->stopping = true;
+  for (i = 0; i < s->count; i++)
+    {
+      if (s->listeners[i].waiting)
+        engine_cancel (&s->engine, &s->listeners[i].q);
+      s->listeners[i].waiting = false;
+      close (s->listeners[i].fd);
+    }
+
+  s->queue = s->last = NULL;
+  for (c = s->clients; c; c = next)
+    {
+      next = c->next;
+      if (c->state == SERVE_READ || c->state == SERVE_QUEUED)
+        serve_close (c);
+    }
+}
+
+int
+serve_run (const int *fds, size_t count, unsigned int jobs,
+           const struct batch_ops *ops)
+{
+  struct sigaction sa;
+  struct serve s;
+  struct serve_client *c;
+  size_t i;
+  int ret = 0;
+
+  memset (&s, 0, sizeof s);
+  s.ops = ops;
+  s.jobs = jobs > 0 ? jobs : 1;
+  if (engine_init (&s.engine) < 0)
+    return -1;
+  if (pipe (serve_pipe) < 0 || serve_nonblock (serve_pipe[0]) < 0
+      || serve_nonblock (serve_pipe[1]) < 0)
+    {
+      engine_free (&s.engine);
+      return -1;
+    }
+
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = serve_signal_handler;
+  sigemptyset (&sa.sa_mask);
+  for (i = 0; i < sizeof serve_signals / sizeof *serve_signals; i++)
+    sigaction (serve_signals[i], &sa, &serve_actions[i]);
+  s.signal.done = serve_stop;
+  s.signal.data = &s;
+  s.signal.text = NULL;
+  engine_notify (&s.engine, &s.signal, serve_pipe[0], false, 0);
+
+  s.count = count;
+  s.listeners = xcalloc (count, sizeof *s.listeners);
+  for (i = 0; i < count; i++)
+    {
+      s.listeners[i].serve = &s;
+      s.listeners[i].fd = fds[i];
+      s.listeners[i].q.done = serve_accept;
+      s.listeners[i].q.data = &s.listeners[i];
+      s.listeners[i].q.text = NULL;
+    }
+
+  for (;;)
+    {
+      while (s.queue && s.running < s.jobs)
+        {
+          c = s.queue;
+          s.queue = c->queued;
+          if (!s.queue)
+            s.last = NULL;
+          serve_start (&s, c);
+        }
+      while ((c = s.answered))
+        {
+          s.answered = c->queued;
+          c->state = SERVE_WRITE;
+          c->sent = 0;
+          serve_write (c);
+        }
+      if (s.stopping && !s.clients && !s.running)
+        break;
+      serve_listen (&s);
+
+      if (engine_wait (&s.engine, -1) < 0)
+        {
+          ret = errno;
+          break;
+        }
+    }
+
+  if (!s.stopping)
+    {
+      serve_restore ();
+      engine_cancel (&s.engine, &s.signal);
+      for (i = 0; i < count; i++)
+        {
+          if (s.listeners[i].waiting)
+            engine_cancel (&s.engine, &s.listeners[i].q);
+          close (fds[i]);
+        }
+    }
+  free (s.listeners);
+  engine_free (&s.engine);
+  close (serve_pipe[0]);
+  close (serve_pipe[1]);
+  serve_pipe[0] = serve_pipe[1] = -1;
+  if (ret)
+    {
+      errno = ret;
+      return -1;
+    }
+  return 0;
+}
@@ -0,0 +1,50 @@
+/* serve.h - declarations for answering queries from local clients
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stddef.h>
+#include "batch.h"
+
+/* A server speaks the whois protocol to its clients: each connection
+   sends a query on a line ending with CRLF, and is sent the output of
+   the query before being closed.  The queries are made by the functions
+   of a batch, so that the configuration, the cache and the addresses of
+   the whois servers stay loaded from one query to the next.  */
+
+/* Return a socket listening on the Unix domain socket PATH, which is
+   replaced if it is left by a server which is gone, or -1 with errno
+   set.  */
+extern int serve_listen_unix (const char *path);
+
+/* Store in FDS, which has room for 2 sockets, sockets listening on PORT
+   of the IPv4 and IPv6 loopback addresses, or on a port chosen by the
+   system if PORT is 0.  An address which doesn't exist is skipped.
+   Return the number of sockets stored, or -1 with errno set.  */
+extern int serve_listen_tcp (int port, int *fds);
+
+/* Answer the clients connecting to the COUNT listening sockets FDS with
+   OPS, making up to JOBS queries at once, until the process is sent
+   SIGTERM or SIGINT.  The sockets are closed then, and the queries being
+   made are answered before returning.  Return -1 with errno set if the
+   server couldn't run, 0 otherwise.  */
+extern int serve_run (const int *fds, size_t count, unsigned int jobs,
+                      const struct batch_ops *ops);
+
+#endif /* SERVE_H */
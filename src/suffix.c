@@ -0,0 +1,109 @@
+/* suffix.c - suffix tries
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Specification.  */
+#include "suffix.h"
+
+#include <ctype.h>
+
+void
+suffix_trie_init (struct suffix_trie *trie)
+{
+  trie->alloc = 64;
+  trie->nodes = xmalloc (trie->alloc * sizeof (struct suffix_node));
+  trie->count = 1;
+  trie->nodes[0].c = '\0';
+  trie->nodes[0].child = 0;
+  trie->nodes[0].sibling = 0;
+  trie->nodes[0].value = -1;
+}
+
+void
+suffix_trie_free (struct suffix_trie *trie)
+{
+  if (trie->alloc)
+    free (trie->nodes);
+  trie->nodes = NULL;
+  trie->count = trie->alloc = 0;
+}
+
+/* Return the index of the child of node N for character C, or 0.  */
+static uint32_t
+suffix_trie_child (const struct suffix_trie *trie, uint32_t n, unsigned char c)
+{
+  for (n = trie->nodes[n].child; n; n = trie->nodes[n].sibling)
+    if (trie->nodes[n].c == c)
+      return n;
+  return 0;
+}
+
+void
+suffix_trie_insert (struct suffix_trie *trie, const char *s, size_t len,
+                    int value)
+{
+  uint32_t n = 0, next;
+  unsigned char c;
+
+  while (len--)
+    {
+      c = tolower ((unsigned char) s[len]);
+      next = suffix_trie_child (trie, n, c);
+      if (!next)
+        {
+          if (trie->count == trie->alloc)
+            {
+              trie->alloc *= 2;
+              trie->nodes = xrealloc (trie->nodes, trie->alloc
+                                      * sizeof (struct suffix_node));
+            }
+          next = trie->count++;
+          trie->nodes[next].c = c;
+          trie->nodes[next].child = 0;
+          trie->nodes[next].sibling = trie->nodes[n].child;
+          trie->nodes[next].value = -1;
+          trie->nodes[n].child = next;
+        }
+      n = next;
+    }
+  trie->nodes[n].value = value;
+}
+
+int
+suffix_trie_match (const struct suffix_trie *trie, const char *s, size_t len,
+                   size_t *matchlen)
+{
+  uint32_t n = 0;
+  size_t i;
+  int value = -1;
+
+  for (i = 1; i <= len; i++)
+    {
+      n = suffix_trie_child (trie, n, tolower ((unsigned char) s[len - i]));
+      if (!n)
+        break;
+      if (trie->nodes[n].value >= 0)
+        {
+          value = trie->nodes[n].value;
+          *matchlen = i;
+        }
+    }
+  return value;
+}
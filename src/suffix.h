@@ -0,0 +1,63 @@
+/* suffix.h - declarations for suffix tries
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef SUFFIX_H
+#define SUFFIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A node of a suffix trie.  Characters are stored from the end of the
+   suffix to its beginning, so walking a string backwards from its last
+   character follows the trie.  Nodes refer to each other by index, 0
+   meaning none since node 0 is the root.  */
+struct suffix_node {
+  unsigned char c;
+  uint32_t child;
+  uint32_t sibling;
+
+  /* Value of the suffix ending at this node, or -1.  */
+  int32_t value;
+};
+
+/* ALLOC is 0 when NODES is borrowed, for instance from a configuration
+   image mapped in memory; such a trie must not be modified.  */
+struct suffix_trie {
+  struct suffix_node *nodes;
+  size_t count;
+  size_t alloc;
+};
+
+/* Initialize the empty trie TRIE.  */
+extern void suffix_trie_init (struct suffix_trie *trie);
+
+/* Release the memory used by TRIE.  */
+extern void suffix_trie_free (struct suffix_trie *trie);
+
+/* Associate VALUE to the suffix S of length LEN in TRIE, replacing any
+   previous value.  Suffixes are case insensitive.  */
+extern void suffix_trie_insert (struct suffix_trie *trie, const char *s,
+                                size_t len, int value);
+
+/* Return the value of the longest suffix of S, of length LEN, found in
+   TRIE and store its length in *MATCHLEN.  Return -1 if no suffix of S is
+   in TRIE.  */
+extern int suffix_trie_match (const struct suffix_trie *trie, const char *s,
+                              size_t len, size_t *matchlen);
+
+#endif /* SUFFIX_H */
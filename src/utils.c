@@ -25,13 +25,18 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <regex.h>
+#include <stdint.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include "init.h"
 #include "jconfig.h"
+#include "resolve.h"
 #include "whois.h"
 
 /*
@@ -95,64 +100,198 @@ strjoinv (const char *delim, int strc, const char *strv[])
   return buf;
 }
 
+/* Number of hosts whose block of server-options is kept at most.  */
+#define SERVER_OPTIONS_HOSTS 1024
+
+/* The block of server-options found for a host.  */
+struct server_options_host
+{
+  char *host;
+  unsigned int hash;
+  const char *domain;
+  struct server_options_host *next;
+};
+
+/* The host patterns of the server-options blocks, compiled once, up to
+   the first invalid one, and a hash table of the blocks found for the
+   hosts looked up since, up to SERVER_OPTIONS_HOSTS of them, which are
+   only valid for the generation of the configuration they were built
+   from.  */
+static struct
+{
+  bool built;
+  unsigned int generation;
+  size_t count;
+  const char **domains;
+  struct re_pattern_buffer *patterns;
+  struct server_options_host **table;
+  size_t size, hosts;
+} server_options;
+
 /*
- *  This adds text to a buffer.
+ *  Forgets the hosts looked up.
  */
-int
-add_text_to_buffer(char **buffer, const char *text)
+static void
+server_options_forget (void)
 {
-  if (!*buffer)
+  struct server_options_host *h, *next;
+  size_t i;
+
+  for (i = 0; i < server_options.size; i++)
     {
-      *buffer = xmalloc (strlen (text) + 1);
-      strncpy(*buffer, text, strlen(text)+1);
+      for (h = server_options.table[i]; h; h = next)
+	{
+	  next = h->next;
+	  free (h->host);
+	  free (h);
+	}
+      server_options.table[i] = NULL;
     }
-  else
+  server_options.hosts = 0;
+}
+
+/*
+ *  Forgets the server-options blocks and the hosts looked up.
+ */
+static void
+server_options_clear (void)
+{
+  size_t i;
+
+  /* The translation table is not to be freed by regfree().  */
+  for (i = 0; i < server_options.count; i++)
     {
-      *buffer = xrealloc (*buffer, strlen (*buffer) + strlen (text) + 1);
-      strncat(*buffer, text, strlen(text)+1);
+      server_options.patterns[i].translate = NULL;
+      regfree (&server_options.patterns[i]);
     }
-  return 0;
+  server_options_forget ();
+  free (server_options.domains);
+  free (server_options.patterns);
+  free (server_options.table);
+  memset (&server_options, 0, sizeof server_options);
 }
 
 /*
- *  This will search the jwhois.server-options base in the configuration
- *  file and return the base domain value for the given hostname.
+ *  Compiles the host patterns of the server-options blocks, which match
+ *  regardless of case, in the order of the configuration.
  */
-char *
-get_whois_server_domain_path(const char *hostname)
+static void
+server_options_build (void)
 {
-  struct jconfig *j;
-  struct re_pattern_buffer      rpb;
-  char *error;
-  int ind, i;
-  unsigned char case_fold[256];
-
+  static unsigned char case_fold[256];
+  struct jconfig_cursor cur;
+  struct re_pattern_buffer *rpb;
+  const char *domain;
+  size_t n = 0;
+  int i;
+
+  server_options_clear ();
   for (i = 0; i < 256; i++)
     case_fold[i] = toupper(i);
 
-  jconfig_set();
+  jconfig_set(&cur);
+  while (jconfig_next_child(&cur, "jwhois|server-options") != NULL)
+    n++;
+  server_options.domains = xcalloc (n ? n : 1, sizeof (const char *));
+  server_options.patterns = xcalloc (n ? n : 1, sizeof *rpb);
 
-  while ((j = jconfig_next_all("jwhois|server-options")) != NULL)
+  /* The blocks after an invalid pattern are never reached.  */
+  jconfig_set(&cur);
+  while ((domain = jconfig_next_child(&cur, "jwhois|server-options")) != NULL)
     {
-      rpb.allocated = 0;
-      rpb.buffer = NULL;
-      rpb.translate = case_fold;
-      rpb.fastmap = (char *)NULL;
-
-      error = (char *)re_compile_pattern(j->domain+22,
-					 strlen(j->domain+22), &rpb);
-      if (error != 0)
-	return NULL;
-	
-      ind = re_search(&rpb, hostname, strlen(hostname), 0, 0, NULL);
+      rpb = &server_options.patterns[server_options.count];
+      rpb->translate = case_fold;
+      rpb->fastmap = xmalloc (256);
+      if (re_compile_pattern(domain+22, strlen(domain+22), rpb) != 0)
+	{
+	  rpb->translate = NULL;
+	  regfree (rpb);
+	  break;
+	}
+      re_compile_fastmap (rpb);
+      server_options.domains[server_options.count++] = domain;
+    }
+
+  server_options.built = true;
+  server_options.generation = jconfig_generation();
+}
+
+/*
+ *  Returns the server-options block whose pattern is the first one to
+ *  match the start of `hostname', or NULL if there is none.
+ */
+static const char *
+server_options_match (const char *hostname)
+{
+  size_t i;
+  int ind;
+
+  for (i = 0; i < server_options.count; i++)
+    {
+      ind = re_search(&server_options.patterns[i], hostname,
+		      strlen(hostname), 0, 0, NULL);
       if (ind == 0)
-	return j->domain;
+	return server_options.domains[i];
       else if (ind == -2)
 	return NULL;
-      
     }
   return NULL;
-  jconfig_end();
+}
+
+/*
+ *  This will search the jwhois.server-options base in the configuration
+ *  file and return the base domain value for the given hostname.  The
+ *  patterns of the base are only matched the first time a hostname is
+ *  seen, and the result is kept until the configuration changes, or
+ *  until too many hosts were seen, since a server may send any of them.
+ */
+char *
+get_whois_server_domain_path(const char *hostname)
+{
+  struct server_options_host **table, *h, *next;
+  unsigned int hash = 2166136261u;
+  const char *p;
+  size_t size, i;
+
+  if (!server_options.built
+      || server_options.generation != jconfig_generation())
+    server_options_build ();
+
+  /* FNV-1a hash of the hostname.  */
+  for (p = hostname; *p; p++)
+    hash = (hash ^ (unsigned char) *p) * 16777619u;
+
+  if (server_options.size)
+    for (h = server_options.table[hash % server_options.size]; h; h = h->next)
+      if (h->hash == hash && strcmp (h->host, hostname) == 0)
+	return (char *)h->domain;
+
+  if (server_options.hosts >= SERVER_OPTIONS_HOSTS)
+    server_options_forget ();
+  if (server_options.hosts >= server_options.size)
+    {
+      size = server_options.size ? server_options.size * 2 : 64;
+      table = xcalloc (size, sizeof *table);
+      for (i = 0; i < server_options.size; i++)
+	for (h = server_options.table[i]; h; h = next)
+	  {
+	    next = h->next;
+	    h->next = table[h->hash % size];
+	    table[h->hash % size] = h;
+	  }
+      free (server_options.table);
+      server_options.table = table;
+      server_options.size = size;
+    }
+
+  h = xmalloc (sizeof *h);
+  h->host = xstrdup (hostname);
+  h->hash = hash;
+  h->domain = server_options_match (hostname);
+  h->next = server_options.table[hash % server_options.size];
+  server_options.table[hash % server_options.size] = h;
+  server_options.hosts++;
+  return (char *)h->domain;
 }
 
 /*
@@ -170,7 +309,6 @@ get_whois_server_option(const char *hostname, const char *key)
   if (!base)
     return NULL;
   
-  jconfig_set();
   j = jconfig_getone(base, key);
   if (!j)
     return NULL;
@@ -178,96 +316,162 @@ get_whois_server_option(const char *hostname, const char *key)
   return j->value;
 }
 
-/* Lookup HOST using PORT.  HOST can be either a hostname or an IP address.
-   Set *RES and return 0 if lookup have succeeded.  Otherwise return the
-   corresponding error code which can be interpreted by 'gai_strerror'.  */
-static int
+int
 lookup_host_addrinfo (struct addrinfo **res, const char *host, int port)
 {
-  struct addrinfo hints;
-  char ascport[10] = "whois";
   int error;
 
-  memset (&hints, 0, sizeof (hints));
-  hints.ai_family = PF_UNSPEC;
-  hints.ai_socktype = SOCK_STREAM;
-  if (port)
-    sprintf(ascport, "%9.9d", port);
-
-  error = getaddrinfo (host, ascport, &hints, res);
+  error = resolve_host (res, host, port);
   if (error)
     printf ("[%s: %s]\n", host, gai_strerror (error));
   return error;
 }
 
+uint64_t
+clock_ms (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 /*
- *  This function creates a connection to the indicated host/port and
- *  returns a file descriptor or -1 if error.
+ *  This function starts a non-blocking connection to `*res', or to the
+ *  next addresses if it fails at once, and moves `*res' past it.
+ *  Returns the socket, or -1 if no connection could be started.
  */
-int
-make_connect(const char *host, int port)
+static int
+connect_start(const struct addrinfo **res, bool *created)
 {
-  int sockfd, error, flags, retval;
-  unsigned int retlen;
-  fd_set fdset;
-  struct timeval timeout = { arguments->connect_timeout, 0 };
-  struct addrinfo *res;
-
-  error = lookup_host_addrinfo(&res, host, port);
-  if (error < 0)
-    {
-      return -1;
-    }
-  for (; res; res = res->ai_next)
+  const struct addrinfo *ai;
+  int sockfd, flags;
+
+  while ((ai = *res))
     {
-      sockfd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-      if (sockfd == -1 && res->ai_family == PF_INET6 && res->ai_next)
+      *res = ai->ai_next;
+      sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (sockfd == -1)
 	/* Operating system seems to lack IPv6 support, try next entry */
 	continue;
+      *created = true;
 
-      if (sockfd == -1)
-	{
-	  printf("[%s]\n", _("Error creating socket"));
-	  return -1;
-	}
-      
       flags = fcntl(sockfd, F_GETFL, 0);
-      if (fcntl(sockfd, F_SETFL, flags|O_NONBLOCK) == -1)
-	{
-	  close (sockfd);
-	  return -1;
-	}
-
-
-      error = connect(sockfd, res->ai_addr, res->ai_addrlen);
-      if (error == 0)
+      if (fcntl(sockfd, F_SETFL, flags|O_NONBLOCK) == 0
+	  && (connect(sockfd, ai->ai_addr, ai->ai_addrlen) == 0
+	      || errno == EINPROGRESS))
 	return sockfd;
-      
-      if (error < 0 && errno != EINPROGRESS)
+      close (sockfd);
+    }
+  return -1;
+}
+
+/*
+ *  This function creates a connection to the first address of `res'
+ *  which accepts it and returns a file descriptor or -1 if error.  The
+ *  addresses are tried in turn CONNECT_ATTEMPT_DELAY milliseconds apart,
+ *  or at once when an attempt fails, without giving up those still in
+ *  progress, so that an address which can't be reached doesn't
+ *  hold up the others (RFC 8305).  Each attempt is given up after the
+ *  connect timeout, and all of them at `deadline' unless it is 0.
+ */
+static int
+connect_addrinfo(const struct addrinfo *res, uint64_t deadline)
+{
+  struct pollfd *fds;
+  uint64_t *deadlines, now, next = 0, first;
+  unsigned int count = 0, n = 0, i;
+  const struct addrinfo *ai;
+  int sockfd = -1, fd, error;
+  socklen_t len;
+  bool created = false;
+
+  for (ai = res; ai; ai = ai->ai_next)
+    count++;
+  fds = xcalloc(count + 1, sizeof *fds);
+  deadlines = xcalloc(count + 1, sizeof *deadlines);
+
+  while (sockfd < 0)
+    {
+      now = clock_ms();
+      if (deadline && now >= deadline)
+	break;
+      if (res && (n == 0 || now >= next))
 	{
-	  close (sockfd);
-	  continue;
+	  fd = connect_start(&res, &created);
+	  if (fd >= 0)
+	    {
+	      fds[n].fd = fd;
+	      fds[n].events = POLLOUT;
+	      deadlines[n] = now
+		+ (uint64_t) arguments->connect_timeout * 1000;
+	      if (deadline && deadline < deadlines[n])
+		deadlines[n] = deadline;
+	      n++;
+	      next = now + CONNECT_ATTEMPT_DELAY;
+	    }
 	}
-
-      FD_ZERO(&fdset);
-      FD_SET(sockfd, &fdset);
-
-      error = select(FD_SETSIZE, NULL, &fdset, NULL, &timeout);
-      if (error == 0)
+      if (n == 0)
+	break;
+
+      first = res && (!deadline || next < deadline) ? next : deadlines[0];
+      for (i = 0; i < n; i++)
+	if (deadlines[i] < first)
+	  first = deadlines[i];
+      if (poll(fds, n, first > now ? (int) (first - now) : 0) < 0
+	  && errno != EINTR)
+	break;
+
+      now = clock_ms();
+      for (i = 0; i < n;)
 	{
-	  close (sockfd);
-	  continue;
+	  if (fds[i].revents && sockfd < 0)
+	    {
+	      len = sizeof error;
+	      if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &error, &len)
+		  == 0 && error == 0)
+		sockfd = fds[i].fd;
+	    }
+	  if (fds[i].fd != sockfd && !fds[i].revents && deadlines[i] > now)
+	    {
+	      i++;
+	      continue;
+	    }
+	  if (fds[i].fd != sockfd)
+	    {
+	      close (fds[i].fd);
+	      next = now;
+	    }
+	  fds[i] = fds[--n];
+	  deadlines[i] = deadlines[n];
 	}
-
-      retlen = sizeof(retval);
-      error = getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &retval, &retlen);
-      if (error == 0 && retval == 0)
-	return sockfd;
-      
-      close (sockfd);
     }
 
-  return -1;
+  for (i = 0; i < n; i++)
+    close (fds[i].fd);
+  free (fds);
+  free (deadlines);
+  if (!created)
+    printf("[%s]\n", _("Error creating socket"));
+  return sockfd;
+}
+
+/*
+ *  This function creates a connection to the indicated host/port, given
+ *  up at `deadline' unless it is 0, and returns a file descriptor or -1
+ *  if error.
+ */
+int
+make_connect(const char *host, int port, uint64_t deadline)
+{
+  int sockfd;
+  struct addrinfo *addrs;
+
+  if (lookup_host_addrinfo(&addrs, host, port) != 0)
+    return -1;
+  sockfd = connect_addrinfo(addrs, deadline);
+  resolve_free(addrs);
+  return sockfd;
 }
 
 /*
@@ -292,18 +496,55 @@ split_host_from_query (whois_query_t wq)
   tmpptr++;
   *tmpptr = '\0';
   tmpptr++;
-  wq->host = tmpptr;
+  wq_set_host (wq, tmpptr);
   return 1;
 }
 
+/*
+ *  Returns the number of seconds set by the option `key' of the block
+ *  `domain', or `fallback' if it is not set or invalid.
+ */
+static int
+timeout_option (const char *domain, const char *key, int fallback)
+{
+  struct jconfig *j = jconfig_getone (domain, key);
+  char *end;
+  long n;
+
+  if (!j)
+    return fallback;
+  errno = 0;
+  n = strtol (j->value, &end, 10);
+  if (errno || end == j->value || *end != '\0' || n < 0
+      || n > INT_MAX / 1000)
+    {
+      if (arguments->verbose)
+        printf ("[%s %s: %s]\n", _("Invalid value of"), key, j->value);
+      return fallback;
+    }
+  return n;
+}
+
+int
+get_whois_server_timeout (const char *hostname, const char *key,
+                          int fallback)
+{
+  const char *base = get_whois_server_domain_path (hostname);
+
+  return base ? timeout_option (base, key, fallback) : fallback;
+}
+
 /* This initialises the timeout value from options in the configuration
    file.  */
 void
 timeout_init (void)
 {
-  jconfig_set ();
   struct jconfig *j = jconfig_getone ("jwhois", "connect-timeout");
 
+  arguments->read_timeout = timeout_option ("jwhois", "read-timeout",
+                                            READ_TIMEOUT);
+  arguments->query_deadline = timeout_option ("jwhois", "query-deadline", 0);
+
   char *buf;
   const char *ret = j ? j->value : "75";
   arguments->connect_timeout = strtol (ret , &buf, 10);
@@ -334,6 +575,10 @@ dump_arguments (struct arguments *args)
                  "  Rwhois display = %s,\n"
                  "  Rwhois limit = %s,\n"
                  "  Force rwhois = %s,\n"
+                 "  Batch file = %s,\n"
+                 "  Jobs = %d,\n"
+                 "  Listen socket = %s,\n"
+                 "  Listen port = %s,\n"
                  "}]\n",
                  args->cache ? "On" : "Off",
                  args->forcelookup ? "Yes" : "No",
@@ -347,5 +592,10 @@ dump_arguments (struct arguments *args)
                  args->raw_query ? "Yes" : "No",
                  args->rwhois_display ? args->rwhois_display : "(None)",
                  args->rwhois_limit ? create_string ("%d", limit) : "(None)",
-                 args->rwhois ? "Yes" : "No");
+                 args->rwhois ? "Yes" : "No",
+                 args->batch ? args->batch : "(None)",
+                 args->jobs,
+                 args->listen ? args->listen : "(None)",
+                 args->listen_port ? create_string ("%d", args->listen_port)
+                 : "(None)");
 }
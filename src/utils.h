@@ -19,17 +19,45 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdint.h>
 #include "init.h"
 #include "whois.h"
 
+struct addrinfo;
+
+/* Milliseconds after which the next address of a host is tried while
+   the connections to the previous ones are still in progress, as
+   recommended by RFC 8305.  */
+#define CONNECT_ATTEMPT_DELAY 250
+
+/* Seconds a server may stay silent while answering, unless set by the
+   read-timeout option.  */
+#define READ_TIMEOUT 60
+
 char *get_whois_server_domain_path(const char *hostname);
 char *get_whois_server_option(const char *hostname, const char *key);
 char *create_string(const char *fmt, ...);
 int split_host_from_query (whois_query_t wq);
-int make_connect(const char *, int);
-int add_text_to_buffer(char **, const char *);
+int make_connect(const char *, int, uint64_t);
 void timeout_init (void);
 
+/* Return the number of seconds set by the option KEY of the
+   server-options of HOSTNAME, or FALLBACK if it is not set or invalid.  */
+extern int get_whois_server_timeout (const char *hostname, const char *key,
+                                     int fallback);
+
+/* Return the time in milliseconds of a clock which never goes back,
+   which the deadlines of queries are set on.  */
+extern uint64_t clock_ms (void);
+
+/* Lookup HOST using PORT.  HOST can be either a hostname or an IP address.
+   Set *RES, to be released with 'resolve_free', and return 0 if lookup
+   have succeeded.  Otherwise return the corresponding error code which
+   can be interpreted by 'gai_strerror'.  The addresses of HOST are cached
+   by 'resolve_host'.  */
+extern int lookup_host_addrinfo (struct addrinfo **res, const char *host,
+                                 int port);
+
 /* Join STC strings in STRV array with delimiter DELIM.  Return a
    pointer to the newly allocated result.*/
 extern char *strjoinv (const char *delim, int stc, const char *strv[]);
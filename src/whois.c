@@ -23,14 +23,17 @@
 #include "whois.h"
 
 #include <errno.h>
+#include <poll.h>
 #include <regex.h>
+#include "buffer.h"
 #include "init.h"
 #include "jconfig.h"
 #include "lookup.h"
 #include "utils.h"
 
 /* Forward declarations.  */
-static int whois_read (int fd, char **ptr, const char *host);
+static int whois_read (int fd, struct buffer *text, const char *host,
+                       int timeout, uint64_t deadline);
 
 whois_query_t
 wq_init (void)
@@ -40,6 +43,7 @@ wq_init (void)
   wq->port = 0;
   wq->query = NULL;
   wq->domain = NULL;
+  wq->deadline = 0;
 
   return wq;
 }
@@ -60,12 +64,33 @@ wq_get_query (whois_query_t wq)
 }
 
 void
-wq_set_query (whois_query_t wq, char *query)
+wq_set_query (whois_query_t wq, const char *query)
 {
   free (wq->query);
   wq->query = xstrdup (query);
 }
 
+void
+wq_set_host (whois_query_t wq, const char *host)
+{
+  char *old = wq->host;
+
+  wq->host = xstrdup (host);
+  free (old);
+}
+
+uint64_t
+whois_deadline (whois_query_t wq)
+{
+  int limit = get_whois_server_timeout (wq->host, "query-deadline", 0);
+  uint64_t deadline;
+
+  if (!limit)
+    return wq->deadline;
+  deadline = clock_ms () + (uint64_t) limit * 1000;
+  return wq->deadline && wq->deadline < deadline ? wq->deadline : deadline;
+}
+
 /*
  *  This function takes a filedescriptor as an argument, makes an whois
  *  query to that host:port. If successfull, it returns the result in the block
@@ -75,17 +100,28 @@ wq_set_query (whois_query_t wq, char *query)
  *              0 Success
  */
 int
-whois_query (whois_query_t wq, char **text)
+whois_query (whois_query_t wq, struct buffer *text)
 {
-  int ret, sockfd;
+  int ret, sockfd, tries = 0, timeout;
   char *tmpqstring;
+  size_t start;
+  uint64_t deadline;
 
   printf("[%s %s]\n", _("Querying"), wq->host);
 
+  timeout = get_whois_server_timeout(wq->host, "read-timeout",
+				     arguments->read_timeout);
+  deadline = whois_deadline(wq);
+
   while (1)
     {
-      sockfd = make_connect(wq->host, wq->port);
+      sockfd = make_connect(wq->host, wq->port, deadline);
 
+      if (sockfd < 0 && deadline && clock_ms() >= deadline)
+	{
+	  printf("[%s: %s]\n", wq->host, _("Query deadline exceeded"));
+	  return -1;
+	}
       if (sockfd < 0)
 	{
 	  printf(_("[Unable to connect to remote host]\n"));
@@ -97,18 +133,56 @@ whois_query (whois_query_t wq, char **text)
       strcat(tmpqstring, "\r\n");
 
       write(sockfd, tmpqstring, strlen(tmpqstring));
+      free(tmpqstring);
 
-      ret = whois_read(sockfd, text, wq->host);
+      start = text->len;
+      ret = whois_read(sockfd, text, wq->host, timeout, deadline);
+      close(sockfd);
 
+      if (ret == -3)
+	{
+	  printf("[%s: %s]\n", wq->host, _("Query deadline exceeded"));
+	  return -1;
+	}
+      if (ret == -2)
+	{
+	  printf("[%s %s:%d]\n", _("Timeout reading data from"),
+		 wq->host, wq->port);
+	  return -1;
+	}
       if (ret < 0)
 	{
 	  printf("[%s %s:%d]\n", _("Error reading data from"),
 		 wq->host, wq->port);
-	  exit (EXIT_FAILURE);
+	  return -1;
+	}
+
+      /* An answer telling that the rate limit was exceeded is no answer,
+	 and must not end up in the cache.  */
+      ret = lookup_rate_limit(wq, text->data + start, tries++);
+      if (ret != 0)
+	buffer_truncate(text, start);
+      if (ret < 0)
+	{
+	  printf("[%s: %s]\n", wq->host, _("Rate limit exceeded"));
+	  return -1;
+	}
+      if (ret > 0 && deadline && clock_ms() + ret * 1000 >= deadline)
+	{
+	  printf("[%s: %s]\n", wq->host, _("Query deadline exceeded"));
+	  return -1;
+	}
+      if (ret > 0)
+	{
+	  if (arguments->verbose)
+	    printf("[%s: %s, %s %d s]\n", wq->host, _("Rate limit exceeded"),
+		   _("retrying in"), ret);
+	  sleep(ret);
+	  continue;
 	}
       if (arguments->redirect)
         {
-          ret = lookup_redirect(wq, *text);
+          ret = lookup_redirect(wq, text->data, NULL);
           if ((ret < 0) || (ret == 0))
 	    break;
 
@@ -124,45 +198,55 @@ whois_query (whois_query_t wq, char **text)
 }
 
 /*
- *  This reads input from a file descriptor and stores the contents
- *  in the indicated pointer. Returns the number of bytes stored in
- *  memory or -1 upon error.
+ *  This reads input from a file descriptor and appends the contents
+ *  to the indicated buffer. Returns the number of bytes stored in
+ *  memory, -1 upon error, -2 if nothing came for `timeout' seconds or
+ *  -3 if `deadline' was reached, unless they are 0.
  */
 static int
-whois_read (int fd, char **ptr, const char *host)
+whois_read (int fd, struct buffer *text, const char *host, int timeout,
+	    uint64_t deadline)
 {
-  unsigned int count, start_count;
-  int ret;
-  char data[MAXBUFSIZE];
-  fd_set rfds;
+  unsigned int count;
+  ssize_t ret;
+  struct pollfd pfd;
+  uint64_t now;
+  int wait;
 
   count = 0;
 
-  add_text_to_buffer(ptr, create_string("[%s]\n", host));
-
-  start_count = strlen(*ptr);
+  buffer_printf(text, "[%s]\n", host);
 
+  pfd.fd = fd;
+  pfd.events = POLLIN;
   do
     {
-      FD_ZERO(&rfds);
-      FD_SET(fd, &rfds);
-      ret = select(fd + 1, &rfds, NULL, NULL, NULL);
-
-      if (ret <= 0)
+      wait = timeout ? timeout * 1000 : -1;
+      if (deadline)
+	{
+	  now = clock_ms();
+	  if (now >= deadline)
+	    return -3;
+	  if (wait < 0 || deadline - now < (uint64_t) wait)
+	    wait = deadline - now;
+	}
+      ret = poll(&pfd, 1, wait);
+
+      if (ret == 0 && deadline && clock_ms() >= deadline)
+	return -3;
+      if (ret == 0)
+	return -2;
+      if (ret < 0 && errno == EINTR)
+	continue;
+      if (ret < 0)
         return -1;
 
-      ret = read(fd, data, MAXBUFSIZE-1);
+      ret = buffer_read(text, fd);
 
-      if (ret >= 0)
-	{
-	  count += ret;
-	  *ptr = realloc(*ptr, start_count+count+1);
-	  if (!*ptr)
-	    return -1;
-	  strncat(*ptr, data, ret);
-	}
+      if (ret > 0)
+	count += ret;
     }
-  while (ret != 0);
+  while (ret > 0 || (ret < 0 && (errno == EINTR || errno == EAGAIN)));
 
-  return count;
+  return ret < 0 ? -1 : (int) count;
 }
@@ -19,11 +19,18 @@
 #ifndef WHOIS_H
 #define WHOIS_H
 
+#include <stdint.h>
+#include "buffer.h"
+
 struct s_whois_query {
   char *host;
   int port;
   char *query;
   char *domain;
+
+  /* Time, as returned by clock_ms(), by which the query must be answered
+     with its redirections, or 0 for no limit.  */
+  uint64_t deadline;
 };
 
 typedef struct s_whois_query *whois_query_t;
@@ -38,8 +45,17 @@ extern void wq_free (whois_query_t wq);
 extern char *wq_get_query (whois_query_t wq);
 
 /* Set query string in WQ to QUERY.  */
-extern void wq_set_query (whois_query_t wq, char *query);
+extern void wq_set_query (whois_query_t wq, const char *query);
+
+/* Set host in WQ to a copy of HOST.  */
+extern void wq_set_host (whois_query_t wq, const char *host);
+
+/* Return the time, as returned by clock_ms(), by which the host of WQ
+   must have answered if asked now: the deadline of WQ, or earlier if the
+   query-deadline server option of the host says so.  Return 0 for no
+   limit.  */
+extern uint64_t whois_deadline (whois_query_t wq);
 
-int whois_query (whois_query_t, char **);
+int whois_query (whois_query_t, struct buffer *);
 
 #endif /* WHOIS_H */
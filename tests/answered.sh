@@ -0,0 +1,95 @@
+#!/bin/sh
+
+# Check queries which are answered without asking a whois server.
+# Copyright (C) 2026 Free Software Foundation, Inc.
+#
+# This file is part of GNU JWhois.
+#
+# GNU JWhois is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# GNU JWhois is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.
+
+. "${srcdir=.}/tests/init.sh"
+
+timeout 10 true || skip_ timeout is missing
+test -x /bin/echo || skip_ /bin/echo is missing
+
+# The host to query can't be found.
+cat > error.conf <<EOF
+whois-servers {
+  type = regex;
+  default = "localhost x";
+}
+EOF
+
+timeout 10 jwhois -c error.conf example.com > out
+test $? = 1 || fail=1
+grep 'Fatal error searching for host to query' out || fail=1
+
+# An invalid cidr block is only reported when an address is looked up.
+cat > cidr.conf <<EOF
+browser-pathname = "/bin/echo";
+browser-stdarg = "answer to";
+whois-servers {
+  type = regex;
+  "^[0-9.]+$" = "struct cidr-blocks";
+  default = "web.test";
+}
+cidr-blocks {
+  type = cidr;
+  "1.2.3/8" = "web.test";
+}
+server-options {
+  "web\\\\.test" {
+    http = true;
+    http-method = "GET";
+    http-action = "/";
+    form-element = "q";
+  }
+}
+EOF
+
+timeout 10 jwhois -c cidr.conf example.com > out || fail=1
+grep 'answer to http://web.test/?q=example.com' out || fail=1
+grep 'Invalid netmask' out && fail=1
+timeout 10 jwhois -c cidr.conf 192.0.2.1 > out
+grep 'Invalid netmask on line 10' out || fail=1
+
+# The answer of an HTTP server, made up by echo, is found in the cache
+# the second time.
+cat > cache.conf <<EOF
+cachefile = "$PWD/cache";
+cacheexpire = 1;
+browser-pathname = "/bin/echo";
+browser-stdarg = "answer to";
+whois-servers {
+  type = regex;
+  default = "cache.test";
+}
+server-options {
+  "cache\\\\.test" {
+    http = true;
+    http-method = "GET";
+    http-action = "/";
+    form-element = "q";
+  }
+}
+EOF
+
+timeout 10 jwhois -c cache.conf example.com > out || fail=1
+grep 'answer to http://cache.test/?q=example.com' out || fail=1
+test -f cache || skip_ the cache is disabled
+timeout 10 jwhois -c cache.conf example.com > out || fail=1
+grep '^\[Cached\]$' out || fail=1
+grep 'answer to http://cache.test/?q=example.com' out || fail=1
+
+Exit $fail
@@ -0,0 +1,162 @@
+/* batch_run.c -- unit test for batch_run
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "batch.h"
+
+#include "macros.h"
+
+#define QUERIES 20
+
+/* Answer QUERY, a number, the later the smaller it is, so that the
+   answers come in the reverse order of the queries.  */
+static int
+lookup (const char *query)
+{
+  int n = atoi (query);
+
+  usleep ((QUERIES - n) * 5000);
+  printf ("answer to %d\n", n);
+  return n == 7 ? -1 : 0;
+}
+
+/* A query answered by the engine.  */
+struct fake {
+  struct engine_query q;
+  batch_done_t done;
+  void *data;
+};
+
+static void
+fake_done (struct engine_query *q)
+{
+  struct fake *f = q->data;
+
+  f->done (f->data, q->status);
+  free (f);
+}
+
+/* End the answer to the query ARG in a child process.  */
+static int
+child (void *arg)
+{
+  printf ("to %d\n", atoi (arg));
+  return 0;
+}
+
+/* Answer the even queries with the engine, from a pipe, but the
+   multiples of 4, whose answers are ended in a child process.  */
+static int
+start (struct engine *e, const char *query, struct buffer *out,
+       batch_done_t done, batch_spawn_t spawn, void *data)
+{
+  struct fake *f;
+  int n = atoi (query);
+  int fds[2];
+  char answer[32];
+
+  if (n % 2)
+    return -1;
+  if (n % 4 == 0)
+    {
+      buffer_printf (out, "answer ");
+      ASSERT (spawn (data, child, (void *) query) == 0);
+      return 0;
+    }
+
+  ASSERT (pipe (fds) == 0);
+  sprintf (answer, "answer to %d\n", n);
+  ASSERT (write (fds[1], answer, strlen (answer)) == (ssize_t) strlen (answer));
+  close (fds[1]);
+
+  f = xmalloc (sizeof *f);
+  f->done = done;
+  f->data = data;
+  f->q.text = out;
+  f->q.done = fake_done;
+  f->q.data = f;
+  engine_read (e, &f->q, fds[0]);
+  return 0;
+}
+
+/* Run the queries 1 to QUERIES with JOBS jobs, and return the output.  */
+static int
+run (unsigned int jobs, const struct batch_ops *ops, struct buffer *out)
+{
+  FILE *in = tmpfile ();
+  FILE *answers = tmpfile ();
+  int saved, fd, ret, i;
+
+  ASSERT (in && answers);
+  fputs ("# comment\n\n", in);
+  for (i = 1; i <= QUERIES; i++)
+    fprintf (in, "  %d \n", i);
+  rewind (in);
+
+  fd = fileno (answers);
+  fflush (stdout);
+  saved = dup (STDOUT_FILENO);
+  ASSERT (dup2 (fd, STDOUT_FILENO) == STDOUT_FILENO);
+  ret = batch_run (in, jobs, ops);
+  fflush (stdout);
+  ASSERT (dup2 (saved, STDOUT_FILENO) == STDOUT_FILENO);
+  close (saved);
+  fclose (in);
+
+  buffer_reset (out);
+  ASSERT (lseek (fd, 0, SEEK_SET) == 0);
+  while (buffer_read (out, fd) > 0)
+    ;
+  fclose (answers);
+  return ret;
+}
+
+int
+main (void)
+{
+  struct batch_ops forked = { .lookup = lookup };
+  struct batch_ops mixed = { .lookup = lookup, .start = start };
+  struct buffer expected, out;
+  int i;
+
+  buffer_init (&expected);
+  buffer_init (&out);
+  for (i = 1; i <= QUERIES; i++)
+    buffer_printf (&expected, "[Query %d: %d]\nanswer to %d\n"
+                   "[End of query %d]\n", i, i, i, i);
+
+  /* The answers are printed in the order of the queries, and a failed
+     query doesn't stop the others.  */
+  ASSERT (run (1, &forked, &out) == -1);
+  ASSERT (STREQ (out.data, expected.data));
+  ASSERT (run (4, &forked, &out) == -1);
+  ASSERT (STREQ (out.data, expected.data));
+  ASSERT (run (QUERIES * 2, &forked, &out) == -1);
+  ASSERT (STREQ (out.data, expected.data));
+
+  /* Answers of the engine come first, but are still printed in order.  */
+  ASSERT (run (4, &mixed, &out) == -1);
+  ASSERT (STREQ (out.data, expected.data));
+
+  buffer_free (&expected);
+  buffer_free (&out);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/* Test of buffer_append function.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "buffer.h"
+
+#include "macros.h"
+
+int
+main (void)
+{
+  struct buffer b;
+  char line[64];
+  size_t size;
+  int fds[2];
+  int i;
+
+  buffer_init (&b);
+  ASSERT (b.len == 0);
+  ASSERT (STREQ (b.data, ""));
+
+  buffer_append (&b, "foo", 3);
+  buffer_puts (&b, "bar");
+  buffer_printf (&b, "[%s:%d]\n", "baz", 43);
+  ASSERT (b.len == 15);
+  ASSERT (STREQ (b.data, "foobar[baz:43]\n"));
+
+  /* Appends go past the initial size, and the size only ever doubles.  */
+  buffer_reset (&b);
+  ASSERT (b.len == 0);
+  ASSERT (STREQ (b.data, ""));
+  for (i = 0; i < 10000; i++)
+    {
+      size = b.size;
+      sprintf (line, "line %d\n", i);
+      buffer_printf (&b, "line %d\n", i);
+      ASSERT (b.size == size || b.size == 2 * size);
+      ASSERT (STREQ (b.data + b.len - strlen (line), line));
+    }
+  ASSERT (b.data[b.len] == '\0');
+  ASSERT (strncmp (b.data, "line 0\nline 1\n", 14) == 0);
+
+  /* A string longer than the spare room is formatted in one go.  */
+  buffer_reset (&b);
+  buffer_printf (&b, "%0*d", 100000, 7);
+  ASSERT (b.len == 100000);
+  ASSERT (b.data[0] == '0' && b.data[99999] == '7' && b.data[100000] == '\0');
+
+  /* Truncating drops the end only.  */
+  buffer_truncate (&b, 200000);
+  ASSERT (b.len == 100000);
+  buffer_truncate (&b, 2);
+  ASSERT (b.len == 2);
+  ASSERT (STREQ (b.data, "00"));
+
+  /* Data is read from a file descriptor until its end.  */
+  buffer_reset (&b);
+  ASSERT (pipe (fds) == 0);
+  ASSERT (write (fds[1], "abc", 3) == 3);
+  close (fds[1]);
+  ASSERT (buffer_read (&b, fds[0]) == 3);
+  ASSERT (buffer_read (&b, fds[0]) == 0);
+  close (fds[0]);
+  ASSERT (b.len == 3);
+  ASSERT (STREQ (b.data, "abc"));
+
+  buffer_free (&b);
+  ASSERT (b.data == NULL && b.len == 0);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+/* engine_wait.c -- unit test for engine_wait
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "engine.h"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "init.h"
+#include "jconfig.h"
+#include "macros.h"
+
+#define QUERIES 10
+
+static int completed;
+
+static void
+done (struct engine_query *q)
+{
+  (void) q;
+  completed++;
+}
+
+static uint64_t
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Return a socket listening on a port of the loopback address, which is
+   stored in PORT.  */
+static int
+listen_loopback (int *port)
+{
+  struct sockaddr_in sin;
+  socklen_t len = sizeof sin;
+  int fd = socket (AF_INET, SOCK_STREAM, 0);
+
+  ASSERT (fd >= 0);
+  memset (&sin, 0, sizeof sin);
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  ASSERT (bind (fd, (struct sockaddr *) &sin, sizeof sin) == 0);
+  ASSERT (listen (fd, QUERIES) == 0);
+  ASSERT (getsockname (fd, (struct sockaddr *) &sin, &len) == 0);
+  *port = ntohs (sin.sin_port);
+  return fd;
+}
+
+/* Answer the connections to FD, taking all those which are made while
+   the first one waits, which must not be more than max-connections.  */
+static void
+serve (int fd)
+{
+  int clients[QUERIES];
+  char line[64];
+  ssize_t len;
+  int served = 0, n, i;
+
+  while (served < QUERIES)
+    {
+      fcntl (fd, F_SETFL, 0);
+      ASSERT ((clients[0] = accept (fd, NULL, NULL)) >= 0);
+      usleep (200000);
+      fcntl (fd, F_SETFL, O_NONBLOCK);
+      for (n = 1; n < QUERIES; n++)
+        if ((clients[n] = accept (fd, NULL, NULL)) < 0)
+          break;
+      ASSERT (n <= 2);
+
+      for (i = 0; i < n; i++)
+        {
+          len = read (clients[i], line, sizeof line - 1);
+          ASSERT (len > 0);
+          ASSERT (write (clients[i], line, len) == len);
+          close (clients[i]);
+        }
+      served += n;
+    }
+  _exit (EXIT_SUCCESS);
+}
+
+int
+main (void)
+{
+  struct engine e;
+  struct engine_query q[QUERIES];
+  struct buffer text[QUERIES];
+  char expected[64];
+  int fd, port, status, i;
+  uint64_t start;
+  pid_t pid;
+
+  signal (SIGPIPE, SIG_IGN);
+  arguments->connect_timeout = 10;
+  jconfig_add ("jwhois|server-options|127\\.0\\.0\\.1", "max-connections",
+               "2", 1);
+  jconfig_add ("jwhois|server-options|127\\.0\\.0\\.1", "max-qps", "20",
+               2);
+
+  fd = listen_loopback (&port);
+  pid = fork ();
+  ASSERT (pid >= 0);
+  if (pid == 0)
+    serve (fd);
+  close (fd);
+
+  start = now ();
+  ASSERT (engine_init (&e) == 0);
+  for (i = 0; i < QUERIES; i++)
+    {
+      buffer_init (&text[i]);
+      q[i].wq = wq_init ();
+      wq_set_host (q[i].wq, "127.0.0.1");
+      q[i].wq->port = port;
+      sprintf (expected, "query %d", i);
+      wq_set_query (q[i].wq, expected);
+      q[i].text = &text[i];
+      q[i].done = done;
+      q[i].lines = NULL;
+      engine_whois (&e, &q[i]);
+    }
+
+  /* All but the first wait for the limits.  */
+  for (i = 1; i < QUERIES; i++)
+    ASSERT (q[i].state == ENGINE_WAIT);
+
+  while (engine_wait (&e, -1) > 0)
+    ;
+  ASSERT (completed == QUERIES);
+
+  /* At most 20 queries a second were started, in order.  */
+  ASSERT (now () - start >= (QUERIES - 1) * 50);
+  for (i = 0; i < QUERIES; i++)
+    {
+      ASSERT (q[i].status == 0 && q[i].state == ENGINE_DONE);
+      sprintf (expected, "[127.0.0.1]\nquery %d\r\n", i);
+      ASSERT (STREQ (text[i].data, expected));
+      buffer_free (&text[i]);
+      wq_free (q[i].wq);
+    }
+
+  /* The limits of the server are forgotten once they let any query
+     start.  */
+  ASSERT (e.hosts);
+  usleep (100000);
+  ASSERT (engine_wait (&e, 0) == 0);
+  ASSERT (!e.hosts);
+
+  engine_free (&e);
+  ASSERT (waitpid (pid, &status, 0) == pid);
+  ASSERT (WIFEXITED (status) && WEXITSTATUS (status) == EXIT_SUCCESS);
+  jconfig_free ();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+/* engine_whois.c -- unit test for engine_whois
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "engine.h"
+
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "init.h"
+#include "macros.h"
+
+#define QUERIES 100
+
+static int completed;
+
+static void
+done (struct engine_query *q)
+{
+  (void) q;
+  completed++;
+}
+
+/* Lines handed so far to lines(), which returns STOP.  */
+static char seen[64];
+static bool stop;
+
+static bool
+lines (struct engine_query *q, const char *text, size_t len)
+{
+  (void) q;
+  ASSERT (strlen (seen) + len < sizeof seen);
+  strncat (seen, text, len);
+  return stop;
+}
+
+/* Return a socket listening on a port of the loopback address, which is
+   stored in PORT.  */
+static int
+listen_loopback (int *port)
+{
+  struct sockaddr_in sin;
+  socklen_t len = sizeof sin;
+  int fd = socket (AF_INET, SOCK_STREAM, 0);
+
+  ASSERT (fd >= 0);
+  memset (&sin, 0, sizeof sin);
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  ASSERT (bind (fd, (struct sockaddr *) &sin, sizeof sin) == 0);
+  ASSERT (listen (fd, QUERIES) == 0);
+  ASSERT (getsockname (fd, (struct sockaddr *) &sin, &len) == 0);
+  *port = ntohs (sin.sin_port);
+  return fd;
+}
+
+/* Answer each connection to FD with the line it sent, after reading all
+   of them, so that the queries are all in progress at once.  */
+static void
+serve (int fd)
+{
+  int clients[QUERIES];
+  char line[64];
+  ssize_t len;
+  int i;
+
+  for (i = 0; i < QUERIES; i++)
+    ASSERT ((clients[i] = accept (fd, NULL, NULL)) >= 0);
+  for (i = QUERIES - 1; i >= 0; i--)
+    {
+      len = read (clients[i], line, sizeof line - 1);
+      ASSERT (len > 0);
+      line[len] = '\0';
+      ASSERT (write (clients[i], "got ", 4) == 4);
+      ASSERT (write (clients[i], line, len) == len);
+      close (clients[i]);
+    }
+  _exit (EXIT_SUCCESS);
+}
+
+int
+main (void)
+{
+  struct engine e;
+  struct engine_query q[QUERIES], refused, streamed;
+  struct buffer text[QUERIES], none, answer;
+  char expected[64];
+  int fd, port, closed, client, status, i;
+  pid_t pid;
+
+  signal (SIGPIPE, SIG_IGN);
+  arguments->connect_timeout = 10;
+  fd = listen_loopback (&port);
+  pid = fork ();
+  ASSERT (pid >= 0);
+  if (pid == 0)
+    serve (fd);
+  close (fd);
+
+  /* A port nobody listens to.  */
+  close (listen_loopback (&closed));
+
+  ASSERT (engine_init (&e) == 0);
+  for (i = 0; i < QUERIES; i++)
+    {
+      buffer_init (&text[i]);
+      q[i].wq = wq_init ();
+      wq_set_host (q[i].wq, "127.0.0.1");
+      q[i].wq->port = port;
+      sprintf (expected, "query %d", i);
+      wq_set_query (q[i].wq, expected);
+      q[i].text = &text[i];
+      q[i].done = done;
+      q[i].lines = NULL;
+      engine_whois (&e, &q[i]);
+    }
+
+  buffer_init (&none);
+  refused.wq = wq_init ();
+  wq_set_host (refused.wq, "127.0.0.1");
+  refused.wq->port = closed;
+  wq_set_query (refused.wq, "refused");
+  refused.text = &none;
+  refused.done = done;
+  refused.lines = NULL;
+  engine_whois (&e, &refused);
+
+  while (engine_wait (&e, -1) > 0)
+    ;
+  ASSERT (completed == QUERIES + 1);
+
+  /* Each answer follows the line naming the host.  */
+  for (i = 0; i < QUERIES; i++)
+    {
+      ASSERT (q[i].status == 0 && q[i].state == ENGINE_DONE);
+      sprintf (expected, "[127.0.0.1]\ngot query %d\r\n", i);
+      ASSERT (STREQ (text[i].data, expected));
+      buffer_free (&text[i]);
+      wq_free (q[i].wq);
+    }
+
+  ASSERT (refused.status == -1 && refused.state == ENGINE_CONNECT);
+  ASSERT (none.len == 0);
+  buffer_free (&none);
+  wq_free (refused.wq);
+
+  /* The lines of an answer are handed as they arrive, until the
+     function has seen enough.  */
+  fd = listen_loopback (&port);
+  buffer_init (&answer);
+  streamed.wq = wq_init ();
+  wq_set_host (streamed.wq, "127.0.0.1");
+  streamed.wq->port = port;
+  wq_set_query (streamed.wq, "lines");
+  streamed.text = &answer;
+  streamed.done = done;
+  streamed.lines = lines;
+  engine_whois (&e, &streamed);
+  while (streamed.state != ENGINE_READ)
+    ASSERT (engine_wait (&e, 5000) == 1);
+  client = accept (fd, NULL, NULL);
+  ASSERT (client >= 0);
+  ASSERT (read (client, expected, sizeof expected) == 7);
+  ASSERT (write (client, "one\ntw", 6) == 6);
+  while (!*seen)
+    ASSERT (engine_wait (&e, 5000) == 1);
+  ASSERT (STREQ (seen, "one\n"));
+
+  stop = true;
+  ASSERT (write (client, "o\r\nthree\nfour", 13) == 13);
+  while (STREQ (seen, "one\n"))
+    ASSERT (engine_wait (&e, 5000) == 1);
+  ASSERT (strncmp (seen, "one\ntwo\r\n", 9) == 0);
+  strcpy (expected, seen);
+  ASSERT (write (client, "\nfive\n", 6) == 6);
+  close (client);
+  while (engine_wait (&e, -1) > 0)
+    ;
+  ASSERT (STREQ (seen, expected));
+  ASSERT (streamed.status == 0);
+  ASSERT (STREQ (answer.data,
+                 "[127.0.0.1]\none\ntwo\r\nthree\nfour\nfive\n"));
+  buffer_free (&answer);
+  wq_free (streamed.wq);
+  close (fd);
+
+  engine_free (&e);
+  ASSERT (waitpid (pid, &status, 0) == pid);
+  ASSERT (WIFEXITED (status) && WEXITSTATUS (status) == EXIT_SUCCESS);
+  return EXIT_SUCCESS;
+}
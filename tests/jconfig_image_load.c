@@ -0,0 +1,88 @@
+/* Test of jconfig_image_load function.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "jconfig.h"
+
+#include "macros.h"
+
+int
+main (void)
+{
+  struct image_writer w;
+  struct image img;
+  struct jconfig_cursor cur;
+  struct jconfig *j;
+  uint64_t offset;
+  const char *child;
+  char *copy;
+  int n = 0;
+
+  jconfig_add ("jwhois|a", "k1", "v1", 1);
+  jconfig_add ("jwhois|a|b", "k1", "v2", 2);
+  jconfig_add ("jwhois|a", "k1", "v3", 3);
+  jconfig_add ("jwhois|c", "k2", "v1", 4);
+
+  image_writer_init (&w);
+  offset = jconfig_image_save (&w);
+  jconfig_free ();
+  ASSERT (jconfig_getone ("jwhois|a", "k1") == NULL);
+
+  /* Work on a copy, since the writer may not be aligned like a map.  */
+  copy = xmalloc (w.len);
+  memcpy (copy, w.data, w.len);
+  img.data = copy;
+  img.len = w.len;
+  ASSERT (jconfig_image_load (&img, offset) == 0);
+
+  j = jconfig_getone ("JWHOIS|A", "K1");
+  ASSERT (j && STREQ (j->value, "v1") && j->line == 1);
+  ASSERT (STREQ (j->domain, "jwhois|a"));
+  j = jconfig_getone ("jwhois|a|b", "k1");
+  ASSERT (j && STREQ (j->value, "v2"));
+  ASSERT (jconfig_index (j) == 1 && jconfig_entry (1) == j);
+  ASSERT (jconfig_entry (4) == NULL);
+
+  jconfig_set (&cur);
+  while ((j = jconfig_next (&cur, "jwhois|a")) != NULL)
+    n++;
+  ASSERT (n == 2);
+
+  jconfig_set (&cur);
+  child = jconfig_next_child (&cur, "jwhois|a");
+  ASSERT (child && STREQ (child, "jwhois|a|b"));
+  ASSERT (jconfig_next_child (&cur, "jwhois|a") == NULL);
+
+  /* Entries can still be added.  */
+  jconfig_add ("jwhois|c", "k3", "v4", 5);
+  j = jconfig_getone ("jwhois|c", "k3");
+  ASSERT (j && STREQ (j->value, "v4"));
+  ASSERT (STREQ (jconfig_getone ("jwhois|c", "k2")->value, "v1"));
+
+  /* Truncated images are rejected.  */
+  img.len = offset;
+  ASSERT (jconfig_image_load (&img, offset) == -1);
+  img.len = w.len - 8;
+  ASSERT (jconfig_image_load (&img, offset) == -1);
+
+  jconfig_free ();
+  free (copy);
+  image_writer_free (&w);
+  return EXIT_SUCCESS;
+}
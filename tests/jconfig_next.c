@@ -0,0 +1,84 @@
+/* Test of jconfig_next function.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "jconfig.h"
+
+#include "macros.h"
+
+int
+main (void)
+{
+  struct jconfig_cursor outer, inner;
+  struct jconfig *j, *k;
+  const char *child;
+  int n = 0;
+
+  jconfig_add ("jwhois|a", "k1", "v1", 1);
+  jconfig_add ("jwhois|b", "k1", "w1", 2);
+  jconfig_add ("jwhois|a", "k2", "v2", 3);
+  jconfig_add ("jwhois|b", "k2", "w2", 4);
+
+  /* Interleaved iterations do not disturb each other.  */
+  jconfig_set (&outer);
+  while ((j = jconfig_next (&outer, "jwhois|a")) != NULL)
+    {
+      ASSERT (STREQ (j->domain, "jwhois|a"));
+      jconfig_set (&inner);
+      while ((k = jconfig_next (&inner, "jwhois|b")) != NULL)
+	{
+	  ASSERT (STREQ (k->domain, "jwhois|b"));
+	  ASSERT (jconfig_getone ("jwhois|a", "k2") != NULL);
+	  n++;
+	}
+    }
+  ASSERT (n == 4);
+
+  /* An exhausted cursor stays exhausted until reset.  */
+  ASSERT (jconfig_next (&outer, "jwhois|a") == NULL);
+  jconfig_set (&outer);
+  j = jconfig_next (&outer, "jwhois|a");
+  ASSERT (j && STREQ (j->value, "v1"));
+
+  n = 0;
+  jconfig_set (&outer);
+  while ((j = jconfig_next_all (&outer, "jwhois")) != NULL)
+    n++;
+  ASSERT (n == 4);
+
+  jconfig_set (&outer);
+  child = jconfig_next_child (&outer, "jwhois");
+  ASSERT (child && STREQ (child, "jwhois|a"));
+  child = jconfig_next_child (&outer, "jwhois");
+  ASSERT (child && STREQ (child, "jwhois|b"));
+  ASSERT (jconfig_next_child (&outer, "jwhois") == NULL);
+
+  jconfig_set (&outer);
+  ASSERT (jconfig_next (&outer, "jwhois|none") == NULL);
+
+  /* A '|' escaped by a backslash is part of the name of a block.  */
+  jconfig_add ("jwhois|c|x\\|y", "k1", "v1", 5);
+  jconfig_set (&outer);
+  child = jconfig_next_child (&outer, "jwhois|c");
+  ASSERT (child && STREQ (child, "jwhois|c|x\\|y"));
+  ASSERT (jconfig_next_child (&outer, "jwhois|c") == NULL);
+
+  jconfig_free ();
+  return EXIT_SUCCESS;
+}
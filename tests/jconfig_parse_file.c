@@ -0,0 +1,105 @@
+/* Test of jconfig_parse_file function.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "jconfig.h"
+
+#include "init.h"
+#include "macros.h"
+
+static const char config[] =
+  "# comment = \"ignored\";\n"
+  "whois-servers {\n"
+  "  \"\\\\.com$\" = \"whois.verisign-grs.com\";\n"
+  "  type = regex;\n"
+  "  \"\\\\.org$\" {\n"
+  "    whois-server = \"whois.pir.org\";\n"
+  "  };\n"
+  "}\n"
+  "server-options {\n"
+  "  \"whois\\\\.a\\\\|whois\\\\.b\" {\n"
+  "    http = true;\n"
+  "  }\n"
+  "  \"x|y\" {\n"
+  "    http = false;\n"
+  "  }\n"
+  "}\n"
+  "long\\ key = \"two\n"
+  "lines\";\n";
+
+static const char *
+value (const char *domain, const char *key)
+{
+  struct jconfig *j = jconfig_getone (domain, key);
+  return j ? j->value : NULL;
+}
+
+int
+main (void)
+{
+  char name[] = "test.conf";
+  struct arguments args = { .config = name };
+  struct jconfig_cursor cur;
+  struct jconfig *j, *k;
+  const char *child;
+  FILE *in;
+
+  arguments = &args;
+  in = tmpfile ();
+  ASSERT (in);
+  ASSERT (fwrite (config, 1, sizeof config - 1, in) == sizeof config - 1);
+  rewind (in);
+  jconfig_parse_file (in);
+  fclose (in);
+
+  ASSERT (STREQ (value ("jwhois|whois-servers", "\\.com$"),
+		 "whois.verisign-grs.com"));
+  ASSERT (STREQ (value ("jwhois|whois-servers", "type"), "regex"));
+  ASSERT (STREQ (value ("jwhois|whois-servers|\\.org$", "whois-server"),
+		 "whois.pir.org"));
+  ASSERT (STREQ (value ("jwhois", "long key"), "two\nlines"));
+  ASSERT (value ("jwhois", "comment") == NULL);
+
+  j = jconfig_getone ("jwhois|whois-servers", "type");
+  ASSERT (j->line == 4);
+  j = jconfig_getone ("jwhois", "long key");
+  ASSERT (j->line == 18);
+
+  /* The blocks are nested where they are opened, whatever the '|' in
+     their names.  */
+  ASSERT (STREQ (value ("jwhois|server-options|whois\\.a\\|whois\\.b",
+                        "http"), "true"));
+  ASSERT (STREQ (value ("jwhois|server-options|x|y", "http"), "false"));
+  jconfig_set (&cur);
+  child = jconfig_next_child (&cur, "jwhois|server-options");
+  ASSERT (child && STREQ (child,
+                          "jwhois|server-options|whois\\.a\\|whois\\.b"));
+  child = jconfig_next_child (&cur, "jwhois|server-options");
+  ASSERT (child && STREQ (child, "jwhois|server-options|x|y"));
+  ASSERT (jconfig_next_child (&cur, "jwhois|server-options") == NULL);
+
+  /* Identical strings are stored once.  */
+  jconfig_add ("jwhois|other", "type", "regex", 11);
+  k = jconfig_getone ("jwhois|other", "type");
+  j = jconfig_getone ("jwhois|whois-servers", "type");
+  ASSERT (k->key == j->key && k->value == j->value);
+
+  jconfig_free ();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/* lookup_rate_limit.c -- unit test for lookup_rate_limit
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "lookup.h"
+
+#include "jconfig.h"
+#include "macros.h"
+
+int
+main (void)
+{
+  whois_query_t wq = wq_init ();
+  int i;
+
+  jconfig_add ("jwhois|server-options|whois\\.example\\.net", "rate-limit",
+               "^Query rate exceeded", 1);
+  jconfig_add ("jwhois|server-options|whois\\.example\\.net", "rate-limit",
+               "connection limit", 2);
+  jconfig_add ("jwhois|server-options|whois\\.example\\.org", "rate-limit",
+               "Too many queries", 3);
+  jconfig_add ("jwhois|server-options|whois\\.example\\.org",
+               "rate-limit-retries", "1", 4);
+  jconfig_add ("jwhois|server-options|whois\\.example\\.org", "rate-limit",
+               "\\(", 5);
+
+  /* The delay doubles up to the default number of tries.  */
+  wq_set_host (wq, "whois.example.net");
+  ASSERT (lookup_rate_limit (wq, "Domain: example.net\n", 0) == 0);
+  for (i = 0; i < 5; i++)
+    ASSERT (lookup_rate_limit (wq, "[whois.example.net]\n"
+                               "Query rate exceeded\n", i) == 1 << i);
+  ASSERT (lookup_rate_limit (wq, "Query rate exceeded\n", 5) == -1);
+
+  /* Patterns match anywhere in the answer, anchors at any line.  */
+  ASSERT (lookup_rate_limit (wq, "Your connection limit exceeded.\n", 0)
+          == 1);
+  ASSERT (lookup_rate_limit (wq, "Note: Query rate exceeded\n", 0) == 0);
+
+  /* Each host has its own patterns and number of tries, and patterns
+     which don't compile are skipped.  */
+  wq_set_host (wq, "whois.example.org");
+  ASSERT (lookup_rate_limit (wq, "Query rate exceeded\n", 0) == 0);
+  ASSERT (lookup_rate_limit (wq, "Too many queries\n", 0) == 1);
+  ASSERT (lookup_rate_limit (wq, "Too many queries\n", 1) == -1);
+
+  wq_set_host (wq, "whois.example.com");
+  ASSERT (lookup_rate_limit (wq, "Too many queries\n", 0) == 0);
+
+  /* Patterns added to the configuration are used.  */
+  jconfig_add ("jwhois|server-options|whois\\.example\\.com", "rate-limit",
+               "Too many", 6);
+  ASSERT (lookup_rate_limit (wq, "Too many queries\n", 0) == 1);
+
+  wq_free (wq);
+  jconfig_free ();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/* lookup_redirect.c -- unit test for lookup_redirect
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "lookup.h"
+
+#include "jconfig.h"
+#include "macros.h"
+
+int
+main (void)
+{
+  whois_query_t wq = wq_init ();
+  struct buffer log;
+  const char *text, *line;
+  size_t n;
+
+  buffer_init (&log);
+
+  jconfig_add ("jwhois|server-options|whois\\.thin\\.example",
+               "whois-redirect", ".*Whois Server: \\(.*\\)", 1);
+  jconfig_add ("jwhois|server-options|whois\\.thin\\.example",
+               "whois-redirect",
+               "ReferralServer: whois://\\([^:]*\\):\\(.*\\)", 2);
+  jconfig_add ("jwhois|server-options|whois\\.bad\\.example",
+               "whois-redirect", "\\(", 3);
+  jconfig_add ("jwhois|server-options|whois\\.mixed\\.example",
+               "whois-redirect", "Whois Server: \\(.*\\)", 4);
+  jconfig_add ("jwhois|server-options|whois\\.mixed\\.example",
+               "whois-redirect", "\\(", 5);
+
+  /* Nothing to follow.  */
+  wq_set_host (wq, "whois.thin.example");
+  wq->port = 43;
+  ASSERT (lookup_redirect (wq, "Domain Name: EXAMPLE.COM\r\n", &log) == 0);
+  ASSERT (STREQ (wq->host, "whois.thin.example") && wq->port == 43);
+
+  /* A pattern must match from the start of a line.  */
+  ASSERT (lookup_redirect (wq, "Note: ReferralServer: whois://a:1\n", &log)
+          == 0);
+
+  /* The first pattern wins, whatever the order of the lines, and the
+     port is reset when the pattern doesn't give one.  */
+  ASSERT (lookup_redirect (wq, "\r\n"
+                           "ReferralServer: whois://rwhois.example:4321\r\n"
+                           "   Whois Server: whois.registrar.example\r\n"
+                           "Status: active\r\n", &log) == 1);
+  ASSERT (STREQ (wq->host, "whois.registrar.example") && wq->port == 0);
+  ASSERT (STREQ (log.data, "[Redirected to whois.registrar.example]\n"));
+
+  /* The second pattern gives the port.  */
+  wq_set_host (wq, "whois.thin.example");
+  buffer_reset (&log);
+  ASSERT (lookup_redirect (wq, "Comment: none\n"
+                           "ReferralServer: whois://rwhois.example:4321\n",
+                           &log) == 1);
+  ASSERT (STREQ (wq->host, "rwhois.example") && wq->port == 4321);
+  ASSERT (STREQ (log.data, "[Redirected to rwhois.example:4321]\n"));
+
+  /* A port which isn't a number is an error.  */
+  wq_set_host (wq, "whois.thin.example");
+  ASSERT (lookup_redirect (wq, "ReferralServer: whois://a:b\n", &log) == -1);
+
+  /* An invalid pattern is an error, and other hosts are not redirected.  */
+  wq_set_host (wq, "whois.bad.example");
+  ASSERT (lookup_redirect (wq, "Whois Server: x\n", &log) == -1);
+  wq_set_host (wq, "whois.other.example");
+  ASSERT (lookup_redirect (wq, "Whois Server: x\n", &log) == 0);
+
+  /* An invalid pattern is only an error once it is tried, when the
+     patterns before it don't match.  */
+  wq_set_host (wq, "whois.mixed.example");
+  ASSERT (lookup_redirect (wq, "Status: active\nWhois Server: m\n", &log)
+          == 1);
+  ASSERT (STREQ (wq->host, "m"));
+  wq_set_host (wq, "whois.mixed.example");
+  ASSERT (lookup_redirect (wq, "\r\n", &log) == 0);
+  ASSERT (lookup_redirect (wq, "Status: active\n", &log) == -1);
+
+  /* Lines read so far are matched by their first pattern only, since a
+     later line could still match it, and the query is left as it is
+     until the line is followed.  */
+  wq_set_host (wq, "whois.thin.example");
+  wq->port = 43;
+  ASSERT (lookup_redirect_lines (wq, "ReferralServer: whois://a:1\n", 28,
+                                 &line, &n) == 0);
+  text = "x\r\nWhois Server: b\r\nWhois";
+  ASSERT (lookup_redirect_lines (wq, text, 20, &line, &n) == 1);
+  ASSERT (line == text + 3 && n == 15);
+  ASSERT (STREQ (wq->host, "whois.thin.example") && wq->port == 43);
+  buffer_reset (&log);
+  ASSERT (lookup_redirect_follow (wq, line, n, &log) == 1);
+  ASSERT (STREQ (wq->host, "b") && wq->port == 0);
+  ASSERT (STREQ (log.data, "[Redirected to b]\n"));
+  wq_set_host (wq, "whois.bad.example");
+  ASSERT (lookup_redirect_lines (wq, "Whois Server: x\n", 16, &line, &n)
+          == -1);
+  wq_set_host (wq, "whois.mixed.example");
+  ASSERT (lookup_redirect_lines (wq, "Whois Server: x\n", 16, &line, &n)
+          == 1);
+
+  buffer_free (&log);
+  wq_free (wq);
+  jconfig_free ();
+  return EXIT_SUCCESS;
+}
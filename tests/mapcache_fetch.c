@@ -0,0 +1,89 @@
+/* Test of mapcache_fetch function.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "mapcache.h"
+
+#include "macros.h"
+
+int
+main (void)
+{
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H
+  struct mapcache writer, reader;
+  char name[] = "mapcache_fetch.XXXXXX";
+  char key[32], text[64];
+  const char *data;
+  size_t len;
+  time_t time;
+  int fd, i;
+
+  /* Start from a new file.  */
+  fd = mkstemp (name);
+  ASSERT (fd >= 0);
+  close (fd);
+  unlink (name);
+
+  ASSERT (mapcache_open (&writer, name) == 0);
+  ASSERT (mapcache_open (&reader, name) == 0);
+  ASSERT (mapcache_fetch (&reader, "host:query", &len, &time) == NULL);
+
+  ASSERT (mapcache_store (&writer, "host:query", "answer\n", 7, 42) == 0);
+  data = mapcache_fetch (&reader, "host:query", &len, &time);
+  ASSERT (data && len == 7 && time == 42);
+  ASSERT (STREQ (data, "answer\n"));
+
+  /* The latest record of a key replaces the previous ones.  */
+  ASSERT (mapcache_store (&writer, "host:query", "new answer\n", 11, 43) == 0);
+  data = mapcache_fetch (&reader, "host:query", &len, &time);
+  ASSERT (data && len == 11 && time == 43);
+  ASSERT (STREQ (data, "new answer\n"));
+
+  /* Enough records to extend the file and rebuild the hash table a few
+     times, while the reader keeps its handle.  */
+  for (i = 0; i < 5000; i++)
+    {
+      sprintf (key, "key %d", i);
+      sprintf (text, "text of key %d", i);
+      ASSERT (mapcache_store (&writer, key, text, strlen (text), i) == 0);
+    }
+  for (i = 0; i < 5000; i++)
+    {
+      sprintf (key, "key %d", i);
+      sprintf (text, "text of key %d", i);
+      data = mapcache_fetch (&reader, key, &len, &time);
+      ASSERT (data && len == strlen (text) && time == i);
+      ASSERT (STREQ (data, text));
+    }
+  data = mapcache_fetch (&reader, "host:query", &len, &time);
+  ASSERT (data && STREQ (data, "new answer\n"));
+
+  /* The records outlive the handles.  */
+  mapcache_close (&writer);
+  mapcache_close (&reader);
+  ASSERT (mapcache_open (&reader, name) == 0);
+  data = mapcache_fetch (&reader, "key 4999", &len, &time);
+  ASSERT (data && STREQ (data, "text of key 4999"));
+  mapcache_close (&reader);
+
+  unlink (name);
+#endif
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+/* Test of mapcache_store function.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "mapcache.h"
+
+#include <sys/stat.h>
+#include "macros.h"
+
+int
+main (void)
+{
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H
+  struct mapcache mc;
+  char name[] = "mapcache_store.XXXXXX";
+  char key[32], text[1024];
+  const char *data;
+  struct stat st;
+  size_t len;
+  time_t now = time (NULL), stored;
+  int fd, i, n;
+
+  fd = mkstemp (name);
+  ASSERT (fd >= 0);
+  close (fd);
+  unlink (name);
+  memset (text, 'x', sizeof text - 1);
+  text[sizeof text - 1] = '\0';
+
+  /* The number of entries is bounded, and the most recently fetched
+     entries survive.  */
+  ASSERT (mapcache_open (&mc, name) == 0);
+  mc.max_entries = 100;
+  for (i = 0; i < 1000; i++)
+    {
+      sprintf (key, "key %d", i);
+      ASSERT (mapcache_store (&mc, key, key, strlen (key), now) == 0);
+      ASSERT (mapcache_fetch (&mc, "key 0", &len, &stored) != NULL);
+    }
+  for (i = n = 0; i < 1000; i++)
+    {
+      sprintf (key, "key %d", i);
+      if ((data = mapcache_fetch (&mc, key, &len, &stored)))
+        {
+          ASSERT (STREQ (data, key));
+          n++;
+        }
+    }
+  ASSERT (n > 0 && n <= 100);
+  ASSERT (mapcache_fetch (&mc, "key 999", &len, &stored) != NULL);
+  mapcache_close (&mc);
+  unlink (name);
+
+  /* So is the size of the file.  */
+  ASSERT (mapcache_open (&mc, name) == 0);
+  mc.max_size = 256 * 1024;
+  for (i = 0; i < 2000; i++)
+    {
+      sprintf (key, "key %d", i);
+      ASSERT (mapcache_store (&mc, key, text, strlen (text), now) == 0);
+    }
+  ASSERT (stat (name, &st) == 0);
+  ASSERT (st.st_size <= 2 * 256 * 1024);
+  ASSERT (mapcache_fetch (&mc, "key 1999", &len, &stored) != NULL);
+  ASSERT (mapcache_fetch (&mc, "key 0", &len, &stored) == NULL);
+  mapcache_close (&mc);
+  unlink (name);
+
+  /* Expired entries are dropped, and rewriting the same entries doesn't
+     make the file grow forever.  */
+  ASSERT (mapcache_open (&mc, name) == 0);
+  mc.max_age = 60;
+  ASSERT (mapcache_store (&mc, "old", "old", 3, now - 3600) == 0);
+  for (i = 0; i < 20000; i++)
+    {
+      sprintf (key, "key %d", i % 10);
+      ASSERT (mapcache_store (&mc, key, text, strlen (text), now) == 0);
+    }
+  ASSERT (stat (name, &st) == 0);
+  ASSERT (st.st_size <= 1024 * 1024);
+  ASSERT (mapcache_fetch (&mc, "old", &len, &stored) == NULL);
+  data = mapcache_fetch (&mc, "key 9", &len, &stored);
+  ASSERT (data && len == strlen (text) && stored == now);
+  mapcache_close (&mc);
+  unlink (name);
+#endif
+
+  return EXIT_SUCCESS;
+}
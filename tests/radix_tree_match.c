@@ -0,0 +1,76 @@
+/* Test of radix_tree_match function.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "radix.h"
+
+#include "macros.h"
+
+int
+main (void)
+{
+  struct radix_tree tree;
+  unsigned int bits = 99;
+
+  const unsigned char net8[4] = { 203, 0, 0, 0 };
+  const unsigned char net24[4] = { 203, 0, 113, 0 };
+  const unsigned char host[4] = { 203, 0, 113, 9 };
+  const unsigned char other[4] = { 204, 1, 2, 3 };
+
+  const unsigned char net6[16] = { 0x20, 0x01, 0x48, 0x00 };
+  const unsigned char host6[16] = { 0x20, 0x01, 0x49, 0xff, 0, 0, 0, 1 };
+
+  radix_tree_init (&tree);
+  ASSERT (radix_tree_match (&tree, host, 32, &bits) == -1);
+  ASSERT (bits == 99);
+
+  radix_tree_insert (&tree, net8, 8, 1);
+  radix_tree_insert (&tree, net24, 24, 2);
+
+  /* The longest prefix wins.  */
+  ASSERT (radix_tree_match (&tree, host, 32, &bits) == 2);
+  ASSERT (bits == 24);
+  ASSERT (radix_tree_match (&tree, net8, 32, &bits) == 1);
+  ASSERT (bits == 8);
+  ASSERT (radix_tree_match (&tree, other, 32, &bits) == -1);
+
+  /* Prefixes longer than the maximum length are ignored.  */
+  ASSERT (radix_tree_match (&tree, host, 16, &bits) == 1);
+
+  /* A zero length prefix matches everything.  */
+  radix_tree_insert (&tree, other, 0, 3);
+  ASSERT (radix_tree_match (&tree, other, 32, &bits) == 3);
+  ASSERT (bits == 0);
+
+  /* Inserting a prefix again replaces its value.  */
+  radix_tree_insert (&tree, host, 8, 4);
+  ASSERT (radix_tree_match (&tree, net8, 32, &bits) == 4);
+
+  radix_tree_free (&tree);
+
+  /* IPv6 prefixes use the same trees.  */
+  radix_tree_init (&tree);
+  radix_tree_insert (&tree, net6, 23, 1);
+  ASSERT (radix_tree_match (&tree, host6, 128, &bits) == 1);
+  ASSERT (bits == 23);
+  ASSERT (radix_tree_match (&tree, host6, 22, &bits) == -1);
+  radix_tree_free (&tree);
+
+  return EXIT_SUCCESS;
+}
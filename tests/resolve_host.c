@@ -0,0 +1,146 @@
+/* resolve_host.c -- unit test for resolve_host
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "resolve.h"
+
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "cache.h"
+#include "init.h"
+#include "macros.h"
+
+/* Return the port of the IPv4 address AI, and store the address in
+   ADDRESS.  */
+static int
+address (const struct addrinfo *ai, char *address)
+{
+  const struct sockaddr_in *sin = (const struct sockaddr_in *) ai->ai_addr;
+
+  ASSERT (ai->ai_family == AF_INET && ai->ai_socktype == SOCK_STREAM);
+  ASSERT (inet_ntop (AF_INET, &sin->sin_addr, address, INET_ADDRSTRLEN));
+  return ntohs (sin->sin_port);
+}
+
+/* Number of lookups made by count.  */
+static int lookups;
+
+/* Look a numeric host up, counting the lookups.  */
+static int
+count (const char *node, const char *service, const struct addrinfo *hints,
+       struct addrinfo **res)
+{
+  lookups++;
+  return getaddrinfo (node, service, hints, res);
+}
+
+int
+main (void)
+{
+  struct addrinfo *res, *again;
+  char text[INET6_ADDRSTRLEN];
+  char *name;
+  int port;
+
+  /* Without a query cache, the addresses are kept in memory.  */
+  arguments->cache = false;
+  ASSERT (resolve_host (&res, "127.0.0.1", 4343) == 0);
+  ASSERT (res && !res->ai_next);
+  ASSERT (address (res, text) == 4343 && STREQ (text, "127.0.0.1"));
+  ASSERT (resolve_host (&again, "127.0.0.1", 4343) == 0);
+  ASSERT (again != res && again->ai_addrlen == res->ai_addrlen);
+  ASSERT (memcmp (again->ai_addr, res->ai_addr, res->ai_addrlen) == 0);
+  resolve_free (res);
+  resolve_free (again);
+
+  name = resolve_canonical ("127.0.0.1");
+  ASSERT (name && STREQ (name, "127.0.0.1"));
+  free (name);
+  ASSERT (resolve_canonical ("example.invalid") == NULL);
+  resolve_clear ();
+
+  /* Not every host looked up is kept.  */
+  resolve_set_function (count);
+  for (port = 1; port <= 4000; port++)
+    {
+      ASSERT (resolve_host (&res, "127.0.0.1", port) == 0);
+      resolve_free (res);
+    }
+  ASSERT (lookups == 4000);
+  ASSERT (resolve_host (&res, "127.0.0.1", 1) == 0);
+  resolve_free (res);
+  ASSERT (lookups == 4001);
+  ASSERT (resolve_host (&res, "127.0.0.1", 4000) == 0);
+  resolve_free (res);
+  ASSERT (lookups == 4001);
+  resolve_set_function (NULL);
+  resolve_clear ();
+
+#ifndef NOCACHE
+  char file[] = "mmap:resolve_host.XXXXXX";
+  char local[] = "@dns:127.0.0.1:4343";
+  char known[] = "@dns:whois.example.invalid:43";
+  char canonical[] = "@dns:whois.example.invalid:0";
+  char old[] = "@dns:old.example.invalid:43";
+  struct cache_view view;
+  int fd;
+
+  fd = mkstemp (file + 5);
+  ASSERT (fd >= 0);
+  close (fd);
+  unlink (file + 5);
+  arguments->cache = true;
+  arguments->cfname = file;
+  arguments->cfexpire = 0;
+
+  /* Addresses are stored in the query cache...  */
+  ASSERT (resolve_host (&res, "127.0.0.1", 4343) == 0);
+  resolve_free (res);
+  ASSERT (cache_read (local, &view) == 1);
+  ASSERT (strncmp (view.text, "127.0.0.1\n", 10) == 0);
+  ASSERT (strstr (view.text, " 4343 127.0.0.1\n"));
+  cache_release (&view);
+
+  /* ...where the addresses of later runs are found until they expire.  */
+  ASSERT (cache_store (known, "192.0.2.1\n2001:db8::1\n"
+                       "4000000000 43 whois.example.invalid\n") == 0);
+  ASSERT (cache_store (canonical, "192.0.2.1\n"
+                       "4000000000 43 canonical.example.invalid\n") == 0);
+  ASSERT (cache_store (old, "192.0.2.2\n1 43 old.example.invalid\n") == 0);
+  ASSERT (resolve_host (&res, "whois.example.invalid", 43) == 0);
+  ASSERT (address (res, text) == 43 && STREQ (text, "192.0.2.1"));
+  ASSERT (res->ai_next && res->ai_next->ai_family == AF_INET6
+          && !res->ai_next->ai_next);
+  resolve_free (res);
+  name = resolve_canonical ("whois.example.invalid");
+  ASSERT (name && STREQ (name, "canonical.example.invalid"));
+  free (name);
+  ASSERT (resolve_host (&res, "old.example.invalid", 43) != 0);
+
+  cache_close ();
+  unlink (file + 5);
+  resolve_clear ();
+#endif
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+/* resolve_start.c -- unit test for resolve_start
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "resolve.h"
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#ifdef HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+#include "init.h"
+#include "macros.h"
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* Number of lookups of "slow.test" made by the stub.  */
+static int slow_lookups;
+
+/* Requests in the order they completed.  */
+static struct resolve_request *completed[4];
+static int count;
+
+/* Look up the loopback address for "fast.test" at once, and for
+   "slow.test" after a while.  Other hosts don't exist.  */
+static int
+stub (const char *node, const char *service, const struct addrinfo *hints,
+      struct addrinfo **res)
+{
+  struct addrinfo numeric = *hints;
+
+  if (STREQ (node, "slow.test"))
+    {
+#ifdef HAVE_PTHREAD_H
+      pthread_mutex_lock (&lock);
+#endif
+      slow_lookups++;
+#ifdef HAVE_PTHREAD_H
+      pthread_mutex_unlock (&lock);
+#endif
+      usleep (300000);
+    }
+  else if (!STREQ (node, "fast.test"))
+    return EAI_NONAME;
+
+  numeric.ai_flags = AI_NUMERICHOST;
+  return getaddrinfo ("127.0.0.1", service, &numeric, res);
+}
+
+static void
+done (struct resolve_request *r)
+{
+  ASSERT (count < 4);
+  completed[count++] = r;
+}
+
+/* Start R for HOST, and complete it at once unless it waits for the
+   pool.  */
+static void
+start (struct resolve_request *r, const char *host)
+{
+  r->done = done;
+  r->data = NULL;
+  if (resolve_start (r, host, 43) == 0)
+    done (r);
+}
+
+int
+main (void)
+{
+  struct resolve_request slow, again, fast, none, cached;
+  struct pollfd pfd;
+  int i;
+
+  arguments->cache = false;
+  resolve_set_function (stub);
+
+  start (&slow, "slow.test");
+  start (&again, "slow.test");
+  start (&fast, "fast.test");
+  start (&none, "none.test");
+
+  pfd.fd = resolve_fd ();
+  pfd.events = POLLIN;
+  while (count < 4)
+    {
+      ASSERT (pfd.fd >= 0);
+      ASSERT (poll (&pfd, 1, 5000) == 1);
+      resolve_finish ();
+    }
+
+  /* Both requests for the slow host waited for one lookup, which didn't
+     hold up the others.  */
+  ASSERT (slow_lookups == 1);
+  if (pfd.fd >= 0)
+    {
+      ASSERT (completed[2] == &slow && completed[3] == &again);
+      for (i = 0; i < 2; i++)
+        ASSERT (completed[i] == &fast || completed[i] == &none);
+    }
+
+  ASSERT (fast.error == 0 && fast.addrs && slow.error == 0 && slow.addrs);
+  ASSERT (again.error == 0 && again.addrs && again.addrs != slow.addrs);
+  ASSERT (none.error == EAI_NONAME && none.addrs == NULL);
+
+  /* The addresses found are kept.  */
+  ASSERT (resolve_start (&cached, "slow.test", 43) == 0);
+  ASSERT (cached.error == 0 && cached.addrs);
+  ASSERT (slow_lookups == 1);
+
+  resolve_free (slow.addrs);
+  resolve_free (again.addrs);
+  resolve_free (fast.addrs);
+  resolve_free (cached.addrs);
+  resolve_clear ();
+  return EXIT_SUCCESS;
+}
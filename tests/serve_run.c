@@ -0,0 +1,240 @@
+/* serve_run.c -- unit test for serve_run
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "serve.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include "macros.h"
+
+/* Answer QUERY in a child process.  */
+static int
+lookup (const char *query)
+{
+  printf ("answer to %s\n", query);
+  return 0;
+}
+
+/* A query answered by the engine.  */
+struct fake {
+  struct engine_query q;
+  batch_done_t done;
+  void *data;
+};
+
+static void
+fake_done (struct engine_query *q)
+{
+  struct fake *f = q->data;
+
+  f->done (f->data, q->status);
+  free (f);
+}
+
+/* End the answer to the query ARG in a child process.  */
+static int
+child (void *arg)
+{
+  printf ("answer to %s\n", (const char *) arg);
+  return 0;
+}
+
+/* Answer the queries but those of .org domains with the engine, from a
+   pipe, "cached" and "sleep" at once, the latter after a second, and
+   end the answers to those of .info domains in a child process.  */
+static int
+start (struct engine *e, const char *query, struct buffer *out,
+       batch_done_t done, batch_spawn_t spawn, void *data)
+{
+  struct fake *f;
+  int fds[2];
+  char answer[64];
+
+  if (STREQ (query, "cached"))
+    {
+      buffer_printf (out, "[Cached]\n");
+      done (data, 0);
+      return 0;
+    }
+  if (STREQ (query, "sleep"))
+    {
+      sleep (1);
+      buffer_printf (out, "[Slept]\n");
+      done (data, 0);
+      return 0;
+    }
+  if (strstr (query, ".org"))
+    return -1;
+  if (strstr (query, ".info"))
+    {
+      buffer_printf (out, "engine ");
+      ASSERT (spawn (data, child, (void *) query) == 0);
+      return 0;
+    }
+
+  ASSERT (pipe (fds) == 0);
+  sprintf (answer, "engine answer to %s\n", query);
+  ASSERT (write (fds[1], answer, strlen (answer))
+          == (ssize_t) strlen (answer));
+  close (fds[1]);
+
+  f = xmalloc (sizeof *f);
+  f->done = done;
+  f->data = data;
+  f->q.text = out;
+  f->q.done = fake_done;
+  f->q.data = f;
+  engine_read (e, &f->q, fds[0]);
+  return 0;
+}
+
+/* Return a socket connected to the Unix domain socket PATH.  */
+static int
+connect_unix (const char *path)
+{
+  struct sockaddr_un sun;
+  int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+
+  ASSERT (fd >= 0);
+  memset (&sun, 0, sizeof sun);
+  sun.sun_family = AF_UNIX;
+  strcpy (sun.sun_path, path);
+  ASSERT (connect (fd, (struct sockaddr *) &sun, sizeof sun) == 0);
+  return fd;
+}
+
+/* Return a socket connected to PORT of the IPv4 loopback address.  */
+static int
+connect_tcp (int port)
+{
+  struct sockaddr_in sin;
+  int fd = socket (AF_INET, SOCK_STREAM, 0);
+
+  ASSERT (fd >= 0);
+  memset (&sin, 0, sizeof sin);
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons (port);
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  ASSERT (connect (fd, (struct sockaddr *) &sin, sizeof sin) == 0);
+  return fd;
+}
+
+/* Send REQUEST on FD, and return what is read until the end of the
+   connection in OUT.  */
+static const char *
+ask (int fd, const char *request, struct buffer *out)
+{
+  ASSERT (write (fd, request, strlen (request))
+          == (ssize_t) strlen (request));
+  buffer_reset (out);
+  while (buffer_read (out, fd) > 0)
+    ;
+  close (fd);
+  return out->data;
+}
+
+int
+main (void)
+{
+  struct batch_ops ops = { .lookup = lookup, .start = start };
+  struct sockaddr_in sin;
+  socklen_t len = sizeof sin;
+  struct buffer out;
+  char dir[] = "/tmp/serve_runXXXXXX", path[64], line[2048];
+  int fds[3], fd, other, port, status, count, i;
+  pid_t pid;
+
+  signal (SIGPIPE, SIG_IGN);
+  buffer_init (&out);
+  ASSERT (mkdtemp (dir));
+  sprintf (path, "%s/socket", dir);
+
+  /* A socket left by a server which is gone is replaced, but not one
+     which is listened on.  */
+  fds[0] = serve_listen_unix (path);
+  ASSERT (fds[0] >= 0);
+  ASSERT (serve_listen_unix (path) < 0 && errno == EADDRINUSE);
+  close (fds[0]);
+  fds[0] = serve_listen_unix (path);
+  ASSERT (fds[0] >= 0);
+  count = serve_listen_tcp (0, fds + 1);
+  ASSERT (count >= 1);
+  ASSERT (getsockname (fds[1], (struct sockaddr *) &sin, &len) == 0);
+  port = ntohs (sin.sin_port);
+
+  pid = fork ();
+  ASSERT (pid >= 0);
+  if (pid == 0)
+    _exit (serve_run (fds, count + 1, 2, &ops) < 0
+           ? EXIT_FAILURE : EXIT_SUCCESS);
+  for (i = 0; i <= count; i++)
+    close (fds[i]);
+
+  /* Each connection is answered as whois servers do, whether the query
+     is made by the engine or by a child process.  */
+  ASSERT (STREQ (ask (connect_unix (path), "example.org\r\n", &out),
+                 "answer to example.org\n"));
+  ASSERT (STREQ (ask (connect_unix (path), " example.net \n", &out),
+                 "engine answer to example.net\n"));
+  ASSERT (STREQ (ask (connect_tcp (port), "cached\r\n", &out),
+                 "[Cached]\n"));
+  ASSERT (STREQ (ask (connect_unix (path), "example.info\r\n", &out),
+                 "engine answer to example.info\n"));
+
+  /* A client slow to send its query doesn't hold up the others.  */
+  fd = connect_unix (path);
+  ASSERT (write (fd, "slow", 4) == 4);
+  other = connect_tcp (port);
+  ASSERT (STREQ (ask (other, "e1\r\n", &out), "engine answer to e1\n"));
+  ASSERT (STREQ (ask (fd, ".org\r\n", &out), "answer to slow.org\n"));
+
+  /* A line which is too long, or empty, is not answered.  */
+  memset (line, 'x', sizeof line - 3);
+  strcpy (line + sizeof line - 3, "\r\n");
+  ASSERT (STREQ (ask (connect_unix (path), line, &out), ""));
+  ASSERT (STREQ (ask (connect_unix (path), "\r\n", &out), ""));
+
+  /* The server stops once it is sent SIGTERM, even when a client it has
+     accepted sends its query at the same time: the query is not
+     answered.  */
+  fd = connect_unix (path);
+  ASSERT (STREQ (ask (connect_unix (path), "cached\r\n", &out),
+                 "[Cached]\n"));
+  other = connect_unix (path);
+  ASSERT (write (other, "sleep\r\n", 7) == 7);
+  usleep (200000);
+  ASSERT (write (fd, "late.net\r\n", 10) == 10);
+  ASSERT (kill (pid, SIGTERM) == 0);
+  ASSERT (STREQ (ask (other, "", &out), "[Slept]\n"));
+  ASSERT (STREQ (ask (fd, "", &out), ""));
+  ASSERT (waitpid (pid, &status, 0) == pid);
+  ASSERT (WIFEXITED (status) && WEXITSTATUS (status) == EXIT_SUCCESS);
+
+  unlink (path);
+  rmdir (dir);
+  buffer_free (&out);
+  return EXIT_SUCCESS;
+}
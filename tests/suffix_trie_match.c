@@ -0,0 +1,66 @@
+/* Test of suffix_trie_match function.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "suffix.h"
+
+#include "macros.h"
+
+static int
+match (const struct suffix_trie *trie, const char *s, size_t *len)
+{
+  return suffix_trie_match (trie, s, strlen (s), len);
+}
+
+int
+main (void)
+{
+  struct suffix_trie trie;
+  size_t len = 0;
+
+  suffix_trie_init (&trie);
+  ASSERT (match (&trie, "gnu.org", &len) == -1);
+
+  suffix_trie_insert (&trie, ".uk", 3, 1);
+  suffix_trie_insert (&trie, ".co.uk", 6, 2);
+  suffix_trie_insert (&trie, ".org", 4, 3);
+  suffix_trie_insert (&trie, "-RIPE", 5, 4);
+
+  /* The longest suffix wins.  */
+  ASSERT (match (&trie, "example.co.uk", &len) == 2);
+  ASSERT (len == 6);
+  ASSERT (match (&trie, "example.uk", &len) == 1);
+  ASSERT (len == 3);
+
+  /* Matching is case insensitive.  */
+  ASSERT (match (&trie, "GNU.ORG", &len) == 3);
+  ASSERT (match (&trie, "foo-ripe", &len) == 4);
+
+  /* The whole string can match, but only suffixes do.  */
+  ASSERT (match (&trie, ".org", &len) == 3);
+  ASSERT (match (&trie, "org", &len) == -1);
+  ASSERT (match (&trie, "gnu.org.se", &len) == -1);
+
+  /* Inserting a suffix again replaces its value.  */
+  suffix_trie_insert (&trie, ".ORG", 4, 5);
+  ASSERT (match (&trie, "gnu.org", &len) == 5);
+
+  suffix_trie_free (&trie);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+/* utils_get_whois_server_option.c -- unit test for get_whois_server_option
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "utils.h"
+
+#include "jconfig.h"
+#include "macros.h"
+
+/* Return the value of KEY for HOST, or "" if there is none.  */
+static const char *
+option (const char *host, const char *key)
+{
+  const char *value = get_whois_server_option (host, key);
+
+  return value ? value : "";
+}
+
+int
+main (void)
+{
+  char host[32];
+  int i;
+
+  jconfig_add ("jwhois|server-options|whois\\.example\\.net", "http",
+               "true", 1);
+  jconfig_add ("jwhois|server-options|whois\\.example\\.net",
+               "query-format", "net $*", 2);
+  jconfig_add ("jwhois|server-options|whois\\.", "query-format", "any $*",
+               3);
+
+  /* The first block matching the start of the host wins, regardless of
+     case, and asking again gives the same answer.  */
+  ASSERT (STREQ (option ("whois.example.net", "query-format"), "net $*"));
+  ASSERT (STREQ (option ("WHOIS.Example.NET", "http"), "true"));
+  ASSERT (STREQ (option ("whois.example.net", "query-format"), "net $*"));
+  ASSERT (STREQ (option ("whois.example.org", "query-format"), "any $*"));
+  ASSERT (STREQ (option ("whois.example.org", "http"), ""));
+  ASSERT (STREQ (option ("rwhois.example.net", "query-format"), ""));
+  ASSERT (get_whois_server_domain_path ("rwhois.example.net") == NULL);
+
+  /* The blocks added since are found.  */
+  jconfig_add ("jwhois|server-options|rwhois\\.", "rwhois", "true", 4);
+  ASSERT (STREQ (option ("rwhois.example.net", "rwhois"), "true"));
+
+  /* Many hosts don't change the answers.  */
+  for (i = 0; i < 3000; i++)
+    {
+      sprintf (host, "whois.%d.example", i);
+      ASSERT (STREQ (option (host, "query-format"), "any $*"));
+      sprintf (host, "%d.example", i);
+      ASSERT (STREQ (option (host, "query-format"), ""));
+    }
+  ASSERT (STREQ (option ("whois.example.net", "query-format"), "net $*"));
+  ASSERT (STREQ (option ("rwhois.example.net", "rwhois"), "true"));
+
+  /* Blocks after an invalid pattern are not reached.  */
+  jconfig_free ();
+  jconfig_add ("jwhois|server-options|a\\.example", "http", "true", 1);
+  jconfig_add ("jwhois|server-options|\\(", "http", "true", 2);
+  jconfig_add ("jwhois|server-options|b\\.example", "http", "true", 3);
+  ASSERT (STREQ (option ("a.example", "http"), "true"));
+  ASSERT (STREQ (option ("b.example", "http"), ""));
+  ASSERT (STREQ (option ("whois.example.net", "query-format"), ""));
+
+  jconfig_free ();
+  return EXIT_SUCCESS;
+}
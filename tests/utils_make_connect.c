@@ -0,0 +1,210 @@
+/* utils_make_connect.c -- unit test for make_connect
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "utils.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "engine.h"
+#include "init.h"
+#include "macros.h"
+#include "resolve.h"
+
+/* Return a socket listening on ADDRESS and PORT, or on a port of its
+   own stored in PORT if it is 0, with room for BACKLOG connections.  */
+static int
+listen_on (const char *address, int *port, int backlog)
+{
+  struct sockaddr_in sin;
+  socklen_t len = sizeof sin;
+  int fd = socket (AF_INET, SOCK_STREAM, 0);
+
+  ASSERT (fd >= 0);
+  memset (&sin, 0, sizeof sin);
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons (*port);
+  ASSERT (inet_pton (AF_INET, address, &sin.sin_addr) == 1);
+  ASSERT (bind (fd, (struct sockaddr *) &sin, sizeof sin) == 0);
+  ASSERT (listen (fd, backlog) == 0);
+  ASSERT (getsockname (fd, (struct sockaddr *) &sin, &len) == 0);
+  *port = ntohs (sin.sin_port);
+  return fd;
+}
+
+/* Return the address of the peer of FD.  */
+static const char *
+peer (int fd, char *address)
+{
+  struct sockaddr_in sin;
+  socklen_t len = sizeof sin;
+
+  ASSERT (getpeername (fd, (struct sockaddr *) &sin, &len) == 0);
+  ASSERT (inet_ntop (AF_INET, &sin.sin_addr, address, INET_ADDRSTRLEN));
+  return address;
+}
+
+/* Return the time in milliseconds.  */
+static long
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/* Give "race.test" the address 127.0.0.1, which doesn't answer, before
+   127.0.0.2, "fail.test" 127.0.0.3, which refuses the connection, in
+   between, and "dead.test" only the first one.  */
+static int
+stub (const char *node, const char *service, const struct addrinfo *hints,
+      struct addrinfo **res)
+{
+  struct addrinfo numeric = *hints;
+  int error;
+
+  ASSERT (STREQ (node, "race.test") || STREQ (node, "fail.test")
+          || STREQ (node, "dead.test"));
+  numeric.ai_flags = AI_NUMERICHOST;
+  error = getaddrinfo ("127.0.0.1", service, &numeric, res);
+  if (error == 0 && STREQ (node, "fail.test"))
+    {
+      error = getaddrinfo ("127.0.0.3", service, &numeric, &(*res)->ai_next);
+      res = &(*res)->ai_next;
+    }
+  if (error == 0 && !STREQ (node, "dead.test"))
+    error = getaddrinfo ("127.0.0.2", service, &numeric, &(*res)->ai_next);
+  return error;
+}
+
+static void
+done (struct engine_query *q)
+{
+  (void) q;
+}
+
+int
+main (void)
+{
+  struct engine e;
+  struct engine_query q;
+  struct buffer text;
+  struct sockaddr_in sin;
+  socklen_t len = sizeof sin;
+  char address[INET_ADDRSTRLEN];
+  int port = 0, full, filler, server, fd;
+  long start;
+
+  signal (SIGPIPE, SIG_IGN);
+  arguments->cache = false;
+  arguments->connect_timeout = 10;
+  resolve_set_function (stub);
+
+  /* A listening socket whose backlog is full drops the connections, as a
+     host which can't be reached would.  */
+  full = listen_on ("127.0.0.1", &port, 0);
+  filler = socket (AF_INET, SOCK_STREAM, 0);
+  ASSERT (filler >= 0);
+  ASSERT (fcntl (filler, F_SETFL, O_NONBLOCK) == 0);
+  ASSERT (getsockname (full, (struct sockaddr *) &sin, &len) == 0);
+  connect (filler, (struct sockaddr *) &sin, len);
+  usleep (100000);
+  server = listen_on ("127.0.0.2", &port, 8);
+
+  /* The second address is tried without waiting for the first one.  */
+  start = now ();
+  fd = make_connect ("race.test", port, 0);
+  ASSERT (fd >= 0);
+  ASSERT (now () - start < 2000);
+  ASSERT (STREQ (peer (fd, address), "127.0.0.2"));
+  close (fd);
+  close (accept (server, NULL, NULL));
+
+  /* An attempt which fails doesn't hold up the next address until the
+     connection attempt delay is over.  */
+  start = now ();
+  fd = make_connect ("fail.test", port, 0);
+  ASSERT (fd >= 0);
+  ASSERT (now () - start < 450);
+  ASSERT (STREQ (peer (fd, address), "127.0.0.2"));
+  close (fd);
+  close (accept (server, NULL, NULL));
+
+  /* The attempts are given up at the deadline.  */
+  start = now ();
+  ASSERT (make_connect ("dead.test", port, clock_ms () + 300) < 0);
+  ASSERT (now () - start >= 250 && now () - start < 2000);
+
+  /* So does the engine.  */
+  ASSERT (engine_init (&e) == 0);
+  buffer_init (&text);
+  q.wq = wq_init ();
+  wq_set_host (q.wq, "race.test");
+  q.wq->port = port;
+  wq_set_query (q.wq, "query");
+  q.text = &text;
+  q.done = done;
+  q.lines = NULL;
+  start = now ();
+  engine_whois (&e, &q);
+  while (q.state != ENGINE_READ)
+    ASSERT (engine_wait (&e, 100) == 1 && now () - start < 2000);
+
+  fd = accept (server, NULL, NULL);
+  ASSERT (fd >= 0);
+  ASSERT (read (fd, address, sizeof address) == 7);
+  ASSERT (write (fd, "answer\n", 7) == 7);
+  close (fd);
+  while (engine_wait (&e, -1) > 0)
+    ;
+  ASSERT (q.status == 0 && STREQ (text.data, "[race.test]\nanswer\n"));
+
+  buffer_truncate (&text, 0);
+  wq_set_host (q.wq, "fail.test");
+  start = now ();
+  engine_whois (&e, &q);
+  while (q.state != ENGINE_READ)
+    ASSERT (engine_wait (&e, 100) == 1 && now () - start < 450);
+
+  fd = accept (server, NULL, NULL);
+  ASSERT (fd >= 0);
+  ASSERT (read (fd, address, sizeof address) == 7);
+  ASSERT (write (fd, "answer\n", 7) == 7);
+  close (fd);
+  while (engine_wait (&e, -1) > 0)
+    ;
+  ASSERT (q.status == 0 && STREQ (text.data, "[fail.test]\nanswer\n"));
+
+  buffer_free (&text);
+  wq_free (q.wq);
+  engine_free (&e);
+  close (server);
+  close (filler);
+  close (full);
+  resolve_clear ();
+  return EXIT_SUCCESS;
+}
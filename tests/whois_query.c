@@ -0,0 +1,129 @@
+/* whois_query.c -- unit test for whois_query
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of GNU JWhois.
+
+   GNU JWhois is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   GNU JWhois is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU JWhois.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <config.h>
+#include "system.h"
+
+/* Declaration.  */
+#include "whois.h"
+
+#include <signal.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "engine.h"
+#include "init.h"
+#include "macros.h"
+#include "utils.h"
+
+/* Return a socket listening on a port of the loopback address, which is
+   stored in PORT.  The connections are accepted by the system, but
+   nothing is ever sent to them.  */
+static int
+listen_silent (int *port)
+{
+  struct sockaddr_in sin;
+  socklen_t len = sizeof sin;
+  int fd = socket (AF_INET, SOCK_STREAM, 0);
+
+  ASSERT (fd >= 0);
+  memset (&sin, 0, sizeof sin);
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  ASSERT (bind (fd, (struct sockaddr *) &sin, sizeof sin) == 0);
+  ASSERT (listen (fd, 8) == 0);
+  ASSERT (getsockname (fd, (struct sockaddr *) &sin, &len) == 0);
+  *port = ntohs (sin.sin_port);
+  return fd;
+}
+
+static void
+done (struct engine_query *q)
+{
+  (void) q;
+}
+
+/* Make the query WQ with the engine, and return its status.  */
+static int
+engine_query (whois_query_t wq)
+{
+  struct engine e;
+  struct engine_query q;
+  struct buffer text;
+
+  ASSERT (engine_init (&e) == 0);
+  buffer_init (&text);
+  q.wq = wq;
+  q.text = &text;
+  q.done = done;
+  q.lines = NULL;
+  engine_whois (&e, &q);
+  while (engine_wait (&e, -1) > 0)
+    ;
+  engine_free (&e);
+  buffer_free (&text);
+  return q.status;
+}
+
+int
+main (void)
+{
+  whois_query_t wq;
+  struct buffer text;
+  uint64_t start;
+  int fd, port;
+
+  signal (SIGPIPE, SIG_IGN);
+  arguments->cache = false;
+  arguments->connect_timeout = 10;
+  fd = listen_silent (&port);
+
+  wq = wq_init ();
+  wq_set_host (wq, "127.0.0.1");
+  wq->port = port;
+  wq_set_query (wq, "query");
+
+  /* A server which stays silent is given up after the read timeout.  */
+  arguments->read_timeout = 1;
+  buffer_init (&text);
+  start = clock_ms ();
+  ASSERT (whois_query (wq, &text) == -1);
+  ASSERT (clock_ms () - start >= 900 && clock_ms () - start < 5000);
+  start = clock_ms ();
+  ASSERT (engine_query (wq) == -3);
+  ASSERT (clock_ms () - start >= 900 && clock_ms () - start < 5000);
+
+  /* The deadline of the query comes first.  */
+  arguments->read_timeout = 10;
+  start = clock_ms ();
+  wq->deadline = start + 300;
+  ASSERT (whois_query (wq, &text) == -1);
+  ASSERT (clock_ms () - start >= 250 && clock_ms () - start < 5000);
+  start = clock_ms ();
+  wq->deadline = start + 300;
+  ASSERT (engine_query (wq) == -4);
+  ASSERT (clock_ms () - start >= 250 && clock_ms () - start < 5000);
+
+  /* A deadline already reached doesn't let the query start.  */
+  wq->deadline = clock_ms ();
+  ASSERT (engine_query (wq) == -4);
+
+  buffer_free (&text);
+  wq_free (wq);
+  close (fd);
+  return EXIT_SUCCESS;
+}